@@ -5,6 +5,11 @@ Call summary.py with NO arguments.  It will automatically detect all of the
 run ids within the ../output folder.  It will also automatically break these
 run ids into groups based on (a) number of direction requests and (b) annealing
 method.
+
+Where ../output/results.csv, the table of results that the solver appends to
+as runs finish (see src/Results.h), covers every run id, everything is read
+from it and the progress of annealing is plotted at every tenth of the
+epochs.  Otherwise every run's output files are read instead.
 """
 
 from collections import defaultdict
@@ -18,6 +23,7 @@ SUMMARY_FOLDER = '../output-summary/'
 OUTPUT_FULL    = '../output/'
 OUTPUT_FORMAT  = '../output/run-%d/'
 INPUT_FILE_FORMAT = '../input/directions-%d.txt'
+RESULTS_TABLE  = '../output/results.csv'
 
 ##################################################
 
@@ -71,12 +77,47 @@ def read_sa_settings(run_id):
     last_epochs = max(list_epochs(run_id, False))
     return (num_locs, last_epochs, cooling_method)
 
+def read_results_table(run_ids):
+    # The last row of the results table for each run id and rep mode,
+    # indexed by (RunId, no_sr), or None unless the table has the progress
+    # of annealing for every one of run_ids.
+    if not os.path.exists(RESULTS_TABLE):
+        return None
+    table = pd.read_csv(RESULTS_TABLE, sep=', ', engine='python')
+    table['NoSR'] = (table['SecondRep'] == 'no')
+    table = table.drop_duplicates(subset=['RunId', 'NoSR'], keep='last')
+    table = table.set_index(['RunId', 'NoSR'])
+    for run_id in run_ids:
+        for no_sr in [False, True]:
+            if (run_id, no_sr) not in table.index \
+                    or table.loc[(run_id, no_sr), 'Best0'] < 0:
+                return None
+    return table
+
+def table_sa_settings(table, run_id):
+    # As read_sa_settings(run_id), from the results table.
+    row = table.loc[(run_id, False)]
+    cooling_method = ('Initial temperature %g, multiplied by %g every %d epochs.\n'
+                        % (row['CoolInit'], row['CoolBase'], row['CoolFlatEpochs']))
+    return (int(row['NumLocs']), int(row['NumEpochs']), cooling_method)
+
+def table_progress(table, run_id, no_sr):
+    # The best objective at every tenth of the epochs, as the rows of a
+    # full annealing log.
+    row = table.loc[(run_id, no_sr)]
+    tenths = range(0, 11)
+    return pd.DataFrame({
+        'Epoch': [row['NumEpochs'] * k // 10 for k in tenths],
+        'Best Objective': [row['Best%d' % (10 * k)] for k in tenths]
+    })
+
 ##################################################
 
 if __name__ == '__main__':
     folders = [f for f in os.listdir(OUTPUT_FULL)
                 if f.startswith('run-')]
     RUN_IDS = [int(f.split('run-')[-1]) for f in folders]
+    TABLE = read_results_table(RUN_IDS)
 
     os.makedirs(SUMMARY_FOLDER, exist_ok=True)
 
@@ -84,7 +125,8 @@ if __name__ == '__main__':
     # each run_id into a list with its group.
     GROUPS = defaultdict(lambda: [])
     for run_id in RUN_IDS:
-        settings = read_sa_settings(run_id)
+        settings = (read_sa_settings(run_id) if TABLE is None
+                        else table_sa_settings(TABLE, run_id))
         GROUPS[settings].append(run_id)
 
     # Now, for each group, generate plots and summary files.
@@ -118,10 +160,22 @@ if __name__ == '__main__':
         greedy_scores  = {False: {}, True: {}}
         greedy_times   = {False: {}, True: {}}
         simanneal_data = {False: {}, True: {}}
+        ## The time annealing took to beat the greedy score, if it did.
+        match_times    = {False: {}, True: {}}
 
         for run_id in run_id_list:
             for no_sr in [False, True]:
                 ## Note:  no_sr = no second rep = without_second_rep
+                if TABLE is not None:
+                    row = TABLE.loc[(run_id, no_sr)]
+                    greedy_scores[no_sr][run_id] = row['GreedyObjective']
+                    greedy_times[no_sr][run_id] = row['GreedyTimeNs']
+                    simanneal_data[no_sr][run_id] = \
+                        table_progress(TABLE, run_id, no_sr)
+                    if row['TimeToGreedyNs'] >= 0:
+                        match_times[no_sr][run_id] = row['TimeToGreedyNs']
+                    continue
+
                 run_id_folder = (OUTPUT_FORMAT % run_id) + (
                                     'no-second-rep/' if no_sr
                                     else '')
@@ -143,6 +197,12 @@ if __name__ == '__main__':
                                         header=0,
                                         sep=', ',
                                         engine='python')
+                sad = simanneal_data[no_sr][run_id]
+                anneal_better = (sad['Best Objective']
+                                    < greedy_scores[no_sr][run_id])
+                if anneal_better.any():
+                    idx = anneal_better.argmax() # First true
+                    match_times[no_sr][run_id] = sad['Wall Time (ns)'].iloc[idx]
 
         ##################################################
         ## DONE LOADING DATA FOR THE GROUP
@@ -210,23 +270,13 @@ if __name__ == '__main__':
                 figsize=FIGSIZE,
                 dpi=DPI
             )
-            match_times = {}
-            no_match = []
-            for run_id in run_id_list:
-                gr_score = greedy_scores[no_sr][run_id]
-                anneal_better = (simanneal_data[no_sr][run_id]['Best Objective']
-                                    < gr_score)
-                if anneal_better.any():
-                    idx = anneal_better.argmax() # First true
-                    match_times[run_id] = \
-                            simanneal_data[no_sr][run_id]['Wall Time (ns)'].iloc[idx]
-                else:
-                    no_match.append(run_id)
+            no_match = [run_id for run_id in run_id_list
+                            if run_id not in match_times[no_sr]]
 
             ## Convert from nanoseconds to milliseconds, just for better
             ## readability:
             times_greedy = [gt / 1_000_000.0 for gt in greedy_times[no_sr].values()]
-            times_match  = [mt / 1_000_000.0 for mt in match_times.values()]
+            times_match  = [mt / 1_000_000.0 for mt in match_times[no_sr].values()]
             time_units = 'milliseconds'
 
             all_values = times_greedy + times_match
@@ -0,0 +1,117 @@
+#include "Affinity.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+	/* Reads a Linux CPU list such as "0-3,8-11". */
+	vector<int> read_cpu_list(const string& list) {
+		vector<int> cpus {};
+		stringstream ss { list };
+		string range {};
+		while (getline(ss, range, ',')) {
+			if (range.empty() or range == "\n")
+				continue;
+			auto dash { range.find('-') };
+			int first { stoi(range.substr(0, dash)) };
+			int last { dash == string::npos ? first : stoi(range.substr(dash + 1)) };
+			for (int c {first}; c <= last; c++)
+				cpus.push_back(c);
+		}
+		return cpus;
+	}
+
+	string describe_cpus(const vector<int>& cpus) {
+		string s {};
+		for (size_t k {0}; k < cpus.size(); k++)
+			s += (k == 0 ? "" : ",") + to_string(cpus[k]);
+		return s;
+	}
+}
+
+CpuTopology CpuTopology::detect() {
+	CpuTopology topology {};
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+		return topology;
+
+	/* Node directories are numbered, but not necessarily contiguously. */
+	for (int node {0}, missing {0}; missing < 64; node++) {
+		ifstream in { "/sys/devices/system/node/node" + to_string(node) + "/cpulist" };
+		if (not in) {
+			missing++;
+			continue;
+		}
+		string list {};
+		getline(in, list);
+		vector<int> cpus {};
+		for (int c : read_cpu_list(list)) {
+			if (c < CPU_SETSIZE and CPU_ISSET(c, &allowed))
+				cpus.push_back(c);
+		}
+		if (not cpus.empty())
+			topology.node_cpus.push_back(move(cpus));
+	}
+	if (topology.node_cpus.empty()) {
+		vector<int> cpus {};
+		for (int c {0}; c < CPU_SETSIZE; c++) {
+			if (CPU_ISSET(c, &allowed))
+				cpus.push_back(c);
+		}
+		topology.node_cpus.push_back(move(cpus));
+	}
+#endif
+	return topology;
+}
+
+size_t CpuTopology::num_cpus() const {
+	size_t n {0};
+	for (auto& cpus : node_cpus)
+		n += cpus.size();
+	return n;
+}
+
+string CpuTopology::describe() const {
+	return to_string(num_cpus()) + " CPUs on "
+			+ to_string(node_cpus.size()) + " NUMA node"
+			+ (node_cpus.size() == 1 ? "" : "s");
+}
+
+string pin_worker(const CpuTopology& topology, const string& mode,
+			size_t worker, size_t cpus_per_worker) {
+	if (mode == "none" or topology.num_cpus() == 0)
+		return "";
+
+	vector<int> cpus {};
+	if (mode == "node") {
+		cpus = topology.node_cpus[worker % topology.node_cpus.size()];
+	} else if (mode == "core") {
+		vector<int> all {};
+		for (auto& node : topology.node_cpus)
+			all.insert(all.end(), node.begin(), node.end());
+		cpus_per_worker = std::clamp<size_t>(cpus_per_worker, 1, all.size());
+		for (size_t k {0}; k < cpus_per_worker; k++)
+			cpus.push_back(all[(worker * cpus_per_worker + k) % all.size()]);
+	} else {
+		throw runtime_error("Unknown pinning mode \"" + mode + "\".");
+	}
+
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int c : cpus)
+		CPU_SET(c, &set);
+	if (int err { pthread_setaffinity_np(pthread_self(), sizeof(set), &set) };
+			err != 0) {
+		throw runtime_error("Could not pin worker " + to_string(worker)
+				+ " to CPUs " + describe_cpus(cpus) + ": error " + to_string(err));
+	}
+	return "CPUs " + describe_cpus(cpus);
+#else
+	return "";
+#endif
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "includes.h"
+
+/* ************************************************** *
+ * Placing worker threads on CPUs.
+ *
+ * Left alone, the scheduler moves threads between cores, and on a
+ * machine with several NUMA nodes (e.g., two sockets) a thread may end
+ * up far from the memory it allocated, so that the same annealing runs
+ * at uneven and lower epoch rates than a single thread does.  Pinning
+ * each worker to its own CPUs keeps it in place.
+ *
+ * Memory follows:  Linux places a page on the node of the CPU that first
+ * writes to it, and every run id loads its own DirectionDatabase (and
+ * metric table, if any), and builds its own schedules, on the worker
+ * thread that solves it.  So once a worker is pinned, before it loads
+ * anything, all of its data is local to its node, and read-only data
+ * such as a metric table is replicated per worker rather than shared
+ * across nodes.  Threads started by a pinned worker (islands, or the
+ * pool of --run-threads) inherit its CPUs.
+ *
+ * The topology comes from /sys/devices/system/node, without needing
+ * libnuma.  Elsewhere than on Linux, pinning does nothing.
+ */
+
+/* The CPUs this process may run on, grouped by NUMA node.  Without NUMA
+ * information, all of them form a single node. */
+struct CpuTopology {
+	vector<vector<int>> node_cpus {};
+
+	static CpuTopology detect();
+
+	size_t num_cpus() const;
+
+	/* E.g. "8 CPUs on 2 NUMA nodes". */
+	string describe() const;
+};
+
+/* Pins the calling thread, as worker number worker, according to mode:
+ *
+ *   - "none" leaves it alone;
+ *   - "core" gives it cpus_per_worker CPUs of its own, taking the CPUs
+ *     node by node, so that a worker's CPUs share a node where possible;
+ *   - "node" lets it run on any CPU of one node, the workers taking the
+ *     nodes in turn.
+ *
+ * Once the workers outnumber the CPUs (or nodes), they wrap around and
+ * share.  Returns a description of the CPUs chosen, for the log, or an
+ * empty string if the thread was not pinned.
+ */
+string pin_worker(const CpuTopology& topology, const string& mode,
+			size_t worker, size_t cpus_per_worker=1);
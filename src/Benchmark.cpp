@@ -0,0 +1,336 @@
+#include "Benchmark.h"
+
+#include <filesystem>
+
+#include "Counters.h"
+#include "SimAnneal.h"
+#include "TelAnnealer.h"
+#include "TelConstructor.h"
+#include "TelGreedy.h"
+#include "TwoLevelSchedule.h"
+
+namespace {
+	using clock_type = chrono::high_resolution_clock;
+
+	bool yes(const string& s) {
+		return s == "yes" or s == "y" or s == "true";
+	}
+
+	/* Nearest-rank quantile of sorted values. */
+	double quantile(const vector<double>& sorted, double q) {
+		size_t rank { static_cast<size_t>(std::ceil(q * sorted.size())) };
+		return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+	}
+
+	template<typename S>
+	Benchmark::Outcome anneal_once(const Benchmark::Instance& inst,
+				const RunSettings& settings, bool without_second_rep,
+				int repeat, double target) {
+		auto start { clock_type::now() };
+		unique_ptr<Schedule> start_sch {};
+		double cool_init { settings.cool_init };
+		if (settings.start != "identity") {
+			start_sch = construction::build(settings.start, inst.dirdata,
+								without_second_rep, settings);
+			cool_init = construction::seeded_cool_init(settings, *start_sch, inst.dirdata);
+		}
+
+		unique_ptr<cooling::CoolingFn> coolptr {
+			new cooling::PiecewiseConstGeomCool
+					{ cool_init, settings.cool_base, settings.cool_flat_epochs }
+		};
+		TelAnnealerFor<S> annealer { inst.run_id, move(coolptr),
+									inst.dirdata, without_second_rep };
+		annealer.set_file_output(false);
+		annealer.set_chain_index(repeat);
+		annealer.set_rejection_free_below(settings.rejection_free_below);
+		annealer.set_acceptance(cooling::acceptance_from_name(settings.acceptance),
+							 settings.lahc_history);
+		if (start_sch)
+			annealer.start_from(*construction::convert<S>(*start_sch, inst.dirdata));
+		annealer.begin_run(settings.num_epochs, 0);
+
+		/* Wall times in the log count from here. */
+		nanos setup { clock_type::now() - start };
+		annealer.advance(settings.num_epochs);
+		annealer.finish_run();
+		nanos total { clock_type::now() - start };
+
+		nanos ttt { -1 };
+		for (auto& row : annealer.get_log_rows()) {
+			if (row.obj_best <= target) {
+				ttt = setup + row.wall_time_ns;
+				break;
+			}
+		}
+		return { annealer.get_obj_best(), ttt, total };
+	}
+
+	template<typename Reps>
+	Benchmark::Outcome anneal_array_once(const Benchmark::Instance& inst,
+				const RunSettings& settings, bool without_second_rep,
+				int repeat, double target) {
+		if (BasicSchedule<uint16_t, Reps>::fits(*inst.dirdata))
+			return anneal_once<BasicSchedule<uint16_t, Reps>>(inst, settings,
+						without_second_rep, repeat, target);
+		else
+			return anneal_once<BasicSchedule<dir_id_t, Reps>>(inst, settings,
+						without_second_rep, repeat, target);
+	}
+}
+
+/* ************************************************** */
+
+Benchmark::Benchmark(const string& folder, int repeats, double target_gap) :
+	folder {folder},
+	repeats {repeats},
+	target_gap {target_gap},
+	instances {},
+	configs {} {
+	if (repeats <= 0)
+		throw runtime_error("A benchmark needs at least one repeat.");
+	read_corpus();
+	read_configs();
+}
+
+void Benchmark::read_corpus() {
+	for (auto& row : read_csv(folder + "/corpus.csv", 5)) {
+		Instance inst {};
+		inst.run_id = stoi(row[0]);
+		inst.num_dir = stoul(strip_underscores(row[1]));
+		double fingerprint { stod(row[2]) };
+		inst.reference = stod(row[3]);
+		inst.reference_no_second_rep = stod(row[4]);
+
+		string filename { folder + "/corpus/directions-" + to_string(inst.run_id) + ".txt" };
+		inst.dirdata = load_directions(inst.run_id, filename);
+		double sum {0};
+		for (dir_id_t id {0}; id < inst.dirdata->get_num_directions_defined(); id++) {
+			const Direction& d { inst.dirdata->get_direction(id, false) };
+			sum += d.get_theta() + d.get_phi();
+		}
+		if (inst.dirdata->get_num_directions_defined() != inst.num_dir
+				or std::abs(sum - fingerprint) > 1e-6) {
+			throw runtime_error("Instance \"" + filename + "\" does not match"
+					" corpus.csv; the corpus must stay frozen.");
+		}
+		instances.push_back(move(inst));
+	}
+}
+
+void Benchmark::read_configs() {
+	for (auto& row : read_csv(folder + "/configs.csv", 9)) {
+		Config config {};
+		config.name = row[0];
+		config.num_dir = (row[1] == "*" ? 0 : stoul(strip_underscores(row[1])));
+		config.solver = row[2];
+		config.second_rep = yes(row[3]);
+		if (config.solver == "anneal") {
+			config.settings.num_epochs = stol(strip_underscores(row[4]));
+			config.settings.cool_init = stod(row[5]);
+			config.settings.cool_base = stod(row[6]);
+			config.settings.cool_flat_epochs = stol(strip_underscores(row[7]));
+			if (config.settings.num_epochs <= 0 or config.settings.cool_init <= 0.0
+					or config.settings.cool_base <= 0.0 or config.settings.cool_base >= 1.0
+					or config.settings.cool_flat_epochs <= 0) {
+				throw runtime_error("Configuration \"" + config.name
+						+ "\" has annealing settings out of range.");
+			}
+		} else if (config.solver != "greedy") {
+			throw runtime_error("Configuration \"" + config.name
+					+ "\" has unknown solver \"" + config.solver + "\".");
+		}
+		stringstream options { row[8] };
+		string opt {};
+		while (options >> opt)
+			apply_option(config.settings, opt);
+		if (config.settings.islands > 1 or config.settings.region_size > 0
+				or config.settings.metric != "chebyshev"
+				or config.settings.lanes > 0 or config.settings.fixed_point_bits > 0
+				or config.settings.memetic > 0 or not config.settings.sky.empty()
+				or config.settings.time_slice > 0 or config.settings.renumber != "none") {
+			throw runtime_error("Configuration \"" + config.name + "\": islands,"
+					" decomposition, lanes, memetic annealing, other metrics,"
+					" the sky, time slices and renumbering are not benchmarked.");
+		}
+		configs.push_back(move(config));
+	}
+}
+
+Benchmark::Outcome Benchmark::run_once(const Instance& inst, const Config& config,
+			int repeat) {
+	bool without_second_rep { not config.second_rep };
+	double target { (without_second_rep ? inst.reference_no_second_rep : inst.reference)
+						* (1 + target_gap) };
+	const RunSettings& settings { config.settings };
+
+	if (config.solver == "greedy") {
+		TelGreedy telgreedy { inst.run_id, inst.dirdata, without_second_rep };
+		double obj { telgreedy.run() };
+		nanos t { telgreedy.get_time_running() };
+		return { obj, (obj <= target ? t : nanos {-1}), t };
+	} else if (settings.two_level_list) {
+		return anneal_once<TwoLevelSchedule>(inst, settings, without_second_rep,
+					repeat, target);
+	} else if (without_second_rep) {
+		return anneal_array_once<SingleRep>(inst, settings, without_second_rep,
+					repeat, target);
+	} else {
+		return anneal_array_once<DualRep>(inst, settings, without_second_rep,
+					repeat, target);
+	}
+}
+
+int Benchmark::run(const string& baseline_file) {
+	const string out_folder { OUTPUT_FOLDER + "benchmark/" };
+	ofstream runs { file_writer(out_folder + "runs.csv") };
+	runs.setf(ios_base::fixed);
+	runs << setprecision(10);
+	runs << "Config, RunId, NumLocs, Repeat, Objective, Gap, TimeToTargetNs, TotalTimeNs\n";
+
+	/* Per run and phase, with -1 for unavailable counters; see Counters.h. */
+	ofstream counted {};
+	if constexpr (counters::COMPILED_IN) {
+		counted = file_writer(out_folder + "counters.csv");
+		counted.setf(ios_base::fixed);
+		counted << setprecision(0);
+		counted << "Config, RunId, Repeat, Phase, Calls, TimeNs";
+		for (size_t e {0}; e < counters::NUM_EVENTS; e++) {
+			string name { counters::event_name(static_cast<counters::Event>(e)) };
+			name.erase(std::remove(name.begin(), name.end(), ' '), name.end());
+			counted << ", " << name;
+		}
+		counted << "\n";
+	}
+
+	SummaryTable summaries {};
+	for (auto& config : configs) {
+		for (auto& inst : instances) {
+			if (config.num_dir != 0 and config.num_dir != inst.num_dir)
+				continue;
+			double reference { config.second_rep ? inst.reference
+										: inst.reference_no_second_rep };
+			cout << "Benchmarking " << config.name << " on run id "
+					<< inst.run_id << " (" << inst.num_dir << " directions)..." << endl;
+
+			vector<double> ttts {}, gaps {};
+			Summary& sum { summaries[{config.name, inst.run_id}] };
+			for (int r {0}; r < repeats; r++) {
+				counters::Tally counted_before { counters::thread_tally() };
+				Outcome outcome { run_once(inst, config, r) };
+				if constexpr (counters::COMPILED_IN) {
+					counters::Tally tally { counters::difference(
+							counters::thread_tally(), counted_before) };
+					for (size_t k {0}; k < counters::NUM_PHASES; k++) {
+						counted << config.name << ", " << inst.run_id << ", " << r
+								<< ", " << counters::phase_name(static_cast<counters::Phase>(k))
+								<< ", " << tally[k].calls << ", " << tally[k].time_ns;
+						for (double v : tally[k].events)
+							counted << ", " << (v < 0 ? -1.0 : v);
+						counted << "\n";
+					}
+				}
+				double gap { outcome.objective / reference - 1 };
+				runs << config.name << ", " << inst.run_id << ", " << inst.num_dir
+					 << ", " << r << ", " << outcome.objective << ", " << gap
+					 << ", " << outcome.time_to_target.count()
+					 << ", " << outcome.time_total.count() << "\n";
+				gaps.push_back(gap);
+				if (outcome.time_to_target.count() >= 0) {
+					ttts.push_back(outcome.time_to_target.count());
+					sum.reached++;
+				} else {
+					ttts.push_back(numeric_limits<double>::infinity());
+				}
+			}
+			std::sort(ttts.begin(), ttts.end());
+			std::sort(gaps.begin(), gaps.end());
+			auto finite_or_none = [] (double t) { return std::isinf(t) ? -1.0 : t; };
+			sum.runs = repeats;
+			sum.ttt_median_ns = finite_or_none(quantile(ttts, 0.5));
+			sum.ttt_q90_ns = finite_or_none(quantile(ttts, 0.9));
+			sum.gap_min = gaps.front();
+			sum.gap_q25 = quantile(gaps, 0.25);
+			sum.gap_median = quantile(gaps, 0.5);
+			sum.gap_q75 = quantile(gaps, 0.75);
+			sum.gap_max = gaps.back();
+		}
+	}
+	runs.close();
+	counted.close();
+
+	int regressions { flag_regressions(summaries, baseline_file) };
+
+	ofstream o { file_writer(out_folder + "summary.csv") };
+	o.setf(ios_base::fixed);
+	o << setprecision(6);
+	o << "Config, RunId, Runs, Reached, TTTMedianNs, TTTQ90Ns,"
+		 " GapMin, GapQ25, GapMedian, GapQ75, GapMax, Flag\n";
+	for (auto& [key, sum] : summaries) {
+		o << key.first << ", " << key.second << ", " << sum.runs << ", " << sum.reached
+		  << ", " << static_cast<long long>(sum.ttt_median_ns)
+		  << ", " << static_cast<long long>(sum.ttt_q90_ns)
+		  << ", " << sum.gap_min << ", " << sum.gap_q25 << ", " << sum.gap_median
+		  << ", " << sum.gap_q75 << ", " << sum.gap_max << ", " << sum.flag << "\n";
+		cout << key.first << " on " << key.second << ": " << sum.reached << "/"
+			 << sum.runs << " reached the target, median time "
+			 << (sum.ttt_median_ns < 0 ? string {"-"}
+					: to_string(sum.ttt_median_ns / 1e6) + " ms")
+			 << ", median gap " << to_string(sum.gap_median)
+			 << " (" << sum.flag << ")" << endl;
+	}
+	o.close();
+	cout << "Results written to " << out_folder << endl;
+	return regressions;
+}
+
+Benchmark::SummaryTable Benchmark::read_summary(const string& filename) {
+	SummaryTable table {};
+	for (auto& row : read_csv(filename, 12)) {
+		Summary sum {};
+		sum.runs = stoi(row[2]);
+		sum.reached = stoi(row[3]);
+		sum.ttt_median_ns = stod(row[4]);
+		sum.ttt_q90_ns = stod(row[5]);
+		sum.gap_min = stod(row[6]);
+		sum.gap_q25 = stod(row[7]);
+		sum.gap_median = stod(row[8]);
+		sum.gap_q75 = stod(row[9]);
+		sum.gap_max = stod(row[10]);
+		sum.flag = row[11];
+		table[{row[0], stoi(row[1])}] = sum;
+	}
+	return table;
+}
+
+int Benchmark::flag_regressions(SummaryTable& summaries, const string& baseline_file) {
+	if (not std::filesystem::exists(baseline_file))
+		return 0;
+	SummaryTable baseline { read_summary(baseline_file) };
+	int regressions {0};
+	for (auto& [key, sum] : summaries) {
+		auto found { baseline.find(key) };
+		if (found == baseline.end())
+			continue;
+		const Summary& base { found->second };
+		/* Compare success rates, as the number of runs may differ. */
+		string why {};
+		if (sum.reached * base.runs < base.reached * sum.runs)
+			why += " fewer reached the target;";
+		if (sum.gap_median > base.gap_median + GAP_SLACK)
+			why += " median gap grew;";
+		if (base.ttt_median_ns >= 0 and (sum.ttt_median_ns < 0
+				or sum.ttt_median_ns > base.ttt_median_ns * (1 + TIME_SLACK)))
+			why += " median time to target grew;";
+		if (why.empty()) {
+			sum.flag = "ok";
+		} else {
+			why.pop_back();
+			sum.flag = "REGRESSION:" + why;
+			regressions++;
+			cout << "REGRESSION in " << key.first << " on run id " << key.second
+				 << ":" << why << endl;
+		}
+	}
+	return regressions;
+}
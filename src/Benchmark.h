@@ -0,0 +1,114 @@
+#pragma once
+
+#include "includes.h"
+
+#include <map>
+
+#include "Direction.h"
+#include "RunSettings.h"
+
+using nanos = std::chrono::nanoseconds;
+
+class Benchmark {
+/* Measures how long each solver configuration takes to reach a given
+ * quality, over a fixed corpus of instances, so that a change can be
+ * judged end to end rather than by epochs per second alone.
+ *
+ * A benchmark folder (see benchmark/ at the top of the repository)
+ * holds:
+ *
+ *   - corpus/directions-ID.txt, the frozen instances, in the usual
+ *     input format;
+ *
+ *   - corpus.csv, listing each instance's run id, number of Directions,
+ *     fingerprint (the sum of all thetas and phis, which catches an
+ *     instance file that has changed) and reference objectives (the best
+ *     known, with and without the second rep);
+ *
+ *   - configs.csv, listing the solver configurations:  a name, the
+ *     number of Directions of the instances it applies to ("*" for all),
+ *     the solver ("greedy" or "anneal"), whether the second rep is
+ *     allowed, the annealing epochs and cooling settings (as the
+ *     positional arguments), and any options of RunSettings.h, separated
+ *     by spaces;
+ *
+ *   - optionally baseline.csv, a summary from an earlier benchmark (see
+ *     below) to compare against.
+ *
+ * Each configuration runs repeats times on each instance it applies to,
+ * one run at a time so that runs do not disturb each other's timing.
+ * Annealing runs differ by their random streams (as islands do; see
+ * SimAnnealer::set_chain_index(...)), and write no files.  A run reaches
+ * the target once its best objective is within target_gap (a fraction)
+ * of the reference; its time to target counts from the very start,
+ * including any construction of a starting schedule.
+ *
+ * The results go to output/benchmark/:  runs.csv, one row per run, and
+ * summary.csv, one row per configuration and instance, with the number
+ * of runs reaching the target, quantiles of the time to target (-1 where
+ * the quantile did not reach it) and quantiles of the final gap to the
+ * reference.  Copying summary.csv to the benchmark folder as baseline.csv
+ * makes it the baseline for later benchmarks, which flag a regression
+ * where fewer runs reach the target, the median gap grows by more than
+ * GAP_SLACK, or the median time to target grows by more than TIME_SLACK
+ * (a fraction).  A build counting hardware events (see Counters.h)
+ * also writes counters.csv, one row per run and phase.
+ */
+public:
+	Benchmark(const string& folder, int repeats, double target_gap);
+	~Benchmark() = default;
+	Benchmark(Benchmark&)  = delete;
+	Benchmark(Benchmark&&) = delete;
+
+	/* Runs the whole benchmark, compares it with the baseline file if
+	 * that exists, and returns the number of regressions flagged. */
+	int run(const string& baseline_file);
+
+	static constexpr double GAP_SLACK  { 0.005 };
+	static constexpr double TIME_SLACK { 0.25 };
+
+	struct Instance {
+		int run_id;
+		size_t num_dir;
+		double reference;
+		double reference_no_second_rep;
+		shared_ptr<DirectionDatabase> dirdata;
+	};
+
+	struct Config {
+		string name;
+		size_t num_dir;  // 0 for all
+		string solver;
+		bool second_rep;
+		RunSettings settings;
+	};
+
+	struct Outcome {
+		double objective;
+		nanos time_to_target;  // negative if not reached
+		nanos time_total;
+	};
+
+	struct Summary {
+		int runs {0}, reached {0};
+		double ttt_median_ns {-1}, ttt_q90_ns {-1};
+		double gap_min {}, gap_q25 {}, gap_median {}, gap_q75 {}, gap_max {};
+		string flag {"new"};
+	};
+
+private:
+	void read_corpus();
+	void read_configs();
+	Outcome run_once(const Instance& inst, const Config& config, int repeat);
+
+	/* Keyed by configuration name and run id. */
+	using SummaryTable = std::map<pair<string, int>, Summary>;
+	static SummaryTable read_summary(const string& filename);
+	int flag_regressions(SummaryTable& summaries, const string& baseline_file);
+
+	string folder;
+	int repeats;
+	double target_gap;
+	vector<Instance> instances;
+	vector<Config> configs;
+};
@@ -0,0 +1,166 @@
+#include "ChainScheduler.h"
+
+#include <filesystem>
+
+ChainScheduler::Share ChainScheduler::share_from_name(const string& name) {
+	if (name == "equal")
+		return Share::equal;
+	else if (name == "size")
+		return Share::size;
+	else if (name == "order")
+		return Share::order;
+	throw runtime_error("Unknown time slice share \"" + name + "\"; use"
+			" \"equal\", \"size\" or \"order\".");
+}
+
+ChainScheduler::ChainScheduler(size_t num_workers, unsigned long slice_epochs,
+			Share share, function<void(size_t)> on_start) :
+	slice_epochs {slice_epochs},
+	share {share} {
+	workers.reserve(num_workers);
+	for (size_t k {0}; k < num_workers; k++) {
+		workers.emplace_back([this, k, on_start] () {
+			if (on_start)
+				on_start(k);
+			work();
+		});
+	}
+}
+
+ChainScheduler::~ChainScheduler() {
+	wait();
+	{
+		std::lock_guard<std::mutex> lock {state_mutex};
+		stopping = true;
+	}
+	work_ready.notify_all();
+	for (auto& w : workers)
+		w.join();
+}
+
+void ChainScheduler::add_setup(function<void()> setup) {
+	{
+		std::lock_guard<std::mutex> lock {state_mutex};
+		setups.push_back(move(setup));
+	}
+	work_ready.notify_one();
+}
+
+void ChainScheduler::add_chain(unique_ptr<Chain> chain, int run_id,
+			bool without_second_rep, size_t num_dir, unsigned long num_epochs) {
+	{
+		std::lock_guard<std::mutex> lock {state_mutex};
+		double stride { 0.0 };
+		if (share == Share::equal)
+			stride = slice_epochs;
+		else if (share == Share::size)
+			stride = static_cast<double>(slice_epochs) / std::max<size_t>(num_dir, 1);
+		size_t k { entries.size() };
+		statuses.push_back({ run_id, without_second_rep, num_dir, chain->get_epoch(),
+							 num_epochs, chain->get_obj_best(), false });
+		entries.push_back({ move(chain), stride, floor_pass });
+		ready.insert({ floor_pass, k });
+	}
+	work_ready.notify_one();
+}
+
+vector<ChainScheduler::Status> ChainScheduler::status() const {
+	std::lock_guard<std::mutex> lock {state_mutex};
+	return statuses;
+}
+
+void ChainScheduler::wait() {
+	std::unique_lock<std::mutex> lock {state_mutex};
+	all_done.wait(lock, [this] () {
+		return setups.empty() and ready.empty() and busy == 0;
+	});
+}
+
+void ChainScheduler::work() {
+	std::unique_lock<std::mutex> lock {state_mutex};
+	while (true) {
+		work_ready.wait(lock, [this] () {
+			return stopping or not setups.empty() or not ready.empty();
+		});
+		if (not setups.empty()) {
+			auto setup { move(setups.front()) };
+			setups.pop_front();
+			busy++;
+			lock.unlock();
+			try {
+				setup();
+			} catch (exception& e) {
+				cerr << "ERROR: " << e.what() << endl;
+			}
+			lock.lock();
+			busy--;
+		} else if (not ready.empty()) {
+			auto [pass, k] { *ready.begin() };
+			ready.erase(ready.begin());
+			floor_pass = pass;
+			/* The chain is ours until it is back in ready:  entries may
+			 * grow meanwhile, but the chain itself stays put. */
+			Chain* chain { entries[k].chain.get() };
+			busy++;
+			lock.unlock();
+			bool more { slice(*chain) };
+			lock.lock();
+			busy--;
+
+			Status& s { statuses[k] };
+			s.epoch = chain->get_epoch();
+			s.obj_best = chain->get_obj_best();
+			if (more) {
+				entries[k].pass += entries[k].stride;
+				ready.insert({ entries[k].pass, k });
+				work_ready.notify_one();
+			} else {
+				s.finished = true;
+				cout << "Chain of run id " << s.run_id << ", allowing second rep "
+						<< (s.without_second_rep == false) << ", finished after "
+						<< s.epoch << " epochs:  best objective " << s.obj_best << endl;
+				entries[k].chain.reset();
+			}
+			lock.unlock();
+			try {
+				write_status();
+			} catch (exception& e) {
+				cerr << "Warning: " << e.what() << endl;
+			}
+			lock.lock();
+		} else
+			return;
+		if (setups.empty() and ready.empty() and busy == 0)
+			all_done.notify_all();
+	}
+}
+
+bool ChainScheduler::slice(Chain& chain) {
+	try {
+		if (chain.advance(slice_epochs))
+			return true;
+		chain.finish();
+	} catch (exception& e) {
+		cerr << "ERROR: " << e.what() << endl;
+	}
+	return false;
+}
+
+void ChainScheduler::write_status() {
+	/* Written aside and renamed into place, so that readers never see
+	 * half a table; the snapshot is taken in turn, so that an older one
+	 * never replaces a newer. */
+	std::lock_guard<std::mutex> lock {file_mutex};
+	vector<Status> snapshot { status() };
+	string filename { OUTPUT_FOLDER + "chains.csv" };
+	ofstream o { file_writer(filename + ".tmp") };
+	o << setprecision(10);
+	o << "RunId, SecondRep, NumLocs, Epoch, NumEpochs, BestObjective, Finished\n";
+	for (auto& s : snapshot) {
+		o << s.run_id << ", " << (s.without_second_rep ? "no" : "yes")
+		  << ", " << s.num_dir << ", " << s.epoch << ", " << s.num_epochs
+		  << ", " << s.obj_best << ", " << (s.finished ? "yes" : "no") << "\n";
+	}
+	o.close();
+	std::filesystem::rename(filename + ".tmp", filename);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "includes.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "SimAnneal.h"
+
+class ChainScheduler {
+/* Many annealing chains sharing a fixed number of worker threads, each
+ * chain annealing a slice of slice_epochs epochs at a time, so that a
+ * batch of more run ids than threads makes progress on all of them at
+ * once rather than one after another.  With --time-slice=EPOCHS, main()
+ * solves its run ids this way.
+ *
+ * A chain is a SimAnnealer whose run has begun (see begin_run(...) in
+ * SimAnneal.h); a slice is one call of its advance(...), after which the
+ * annealer keeps everything it needs to go on, on any worker, so no
+ * coroutines are needed.  Random streams belong to the annealers, so a
+ * chain's outcome is that of annealing it in one go.  Only the wall
+ * time of its slices counts towards its times.
+ *
+ * Work comes in two kinds:
+ *
+ * - setup work, given to add_setup(...), such as loading a run id,
+ *   running the greedy heuristic and handing over its chains.  Setup
+ *   always goes first, so every chain is under way early on.
+ *
+ * - chains, given to add_chain(...) or add_annealer(...).  Once a chain
+ *   has no epochs left, its finish() runs, on the worker of its last
+ *   slice; for an annealer, finish_run() and then on_finish.
+ *
+ * Which chain gets the next free worker depends on the Share:
+ *
+ * - equal:  chains advance by the same number of epochs, in turn;
+ *
+ * - size:   chains advance in proportion to their number of Directions,
+ *   as larger instances need more epochs to converge;
+ *
+ * - order:  chains run in the order they were added, as without time
+ *   slices, but with every thread on the first few chains left.
+ *
+ * That is stride scheduling:  each chain has a pass, which a slice moves
+ * on by slice_epochs divided by the chain's weight (1 or its number of
+ * Directions), and the chain with the least pass goes next, ties by the
+ * order added.  A chain added late starts at the pass of the chain
+ * picked last, so that it neither starves the others nor falls behind.
+ *
+ * status() gives every chain's epoch and best objective as of its last
+ * slice, at any time and from any thread.  The same table is rewritten
+ * to OUTPUT_FOLDER/chains.csv after every slice, for watching a batch
+ * from outside; the best states themselves are saved as they improve,
+ * as ever.
+ *
+ * If given, on_start(k) runs first on worker k, as for ThreadPool.
+ */
+public:
+	enum class Share { equal, size, order };
+
+	/* Throws an error message for a name other than those above. */
+	static Share share_from_name(const string& name);
+
+	/* One chain, as the scheduler sees it. */
+	class Chain {
+	public:
+		virtual ~Chain() = default;
+		/* Anneals at most max_epochs more epochs; true if any are left. */
+		virtual bool advance(unsigned long max_epochs) = 0;
+		virtual void finish() = 0;
+		virtual double get_obj_best() const = 0;
+		virtual unsigned long get_epoch() const = 0;
+	};
+
+	template<typename T>
+	class AnnealerChain : public Chain {
+	public:
+		using OnFinish = function<void(SimAnnealer<T>&)>;
+
+		AnnealerChain(unique_ptr<SimAnnealer<T>> annealer, OnFinish on_finish) :
+			annealer {move(annealer)},
+			on_finish {move(on_finish)} {}
+
+		bool advance(unsigned long max_epochs) override {
+			return annealer->advance(max_epochs);
+		}
+
+		void finish() override {
+			annealer->finish_run();
+			if (on_finish)
+				on_finish(*annealer);
+		}
+
+		double get_obj_best() const override {
+			return annealer->get_obj_best();
+		}
+
+		unsigned long get_epoch() const override {
+			return annealer->get_epoch();
+		}
+
+	private:
+		unique_ptr<SimAnnealer<T>> annealer;
+		OnFinish on_finish;
+	};
+
+	struct Status {
+		int run_id;
+		bool without_second_rep;
+		size_t num_dir;
+		unsigned long epoch;
+		unsigned long num_epochs;
+		double obj_best;
+		bool finished;
+	};
+
+	ChainScheduler(size_t num_workers, unsigned long slice_epochs, Share share,
+				function<void(size_t)> on_start={});
+	/* Waits for all work added so far, then joins the workers. */
+	~ChainScheduler();
+	ChainScheduler(ChainScheduler&)  = delete;
+	ChainScheduler(ChainScheduler&&) = delete;
+
+	void add_setup(function<void()> setup);
+
+	/* Takes a chain with num_epochs epochs to anneal, of run_id in the
+	 * given rep mode, on num_dir Directions. */
+	void add_chain(unique_ptr<Chain> chain, int run_id, bool without_second_rep,
+				size_t num_dir, unsigned long num_epochs);
+
+	/* Takes an annealer, after begin_run(...) for num_epochs epochs. */
+	template<typename T>
+	void add_annealer(unique_ptr<SimAnnealer<T>> annealer, bool without_second_rep,
+				size_t num_dir, unsigned long num_epochs,
+				typename AnnealerChain<T>::OnFinish on_finish={}) {
+		int run_id { annealer->get_run_id() };
+		add_chain(make_unique<AnnealerChain<T>>(move(annealer), move(on_finish)),
+				run_id, without_second_rep, num_dir, num_epochs);
+	}
+
+	vector<Status> status() const;
+
+	/* Blocks until all work added so far is done, including any that it
+	 * adds in turn. */
+	void wait();
+
+private:
+	struct Entry {
+		unique_ptr<Chain> chain;
+		double stride;
+		double pass;
+	};
+
+	void work();
+	/* One slice of chain, then finish() if it is done; false once it
+	 * is done or has failed. */
+	bool slice(Chain& chain);
+	void write_status();
+
+	unsigned long slice_epochs;
+	Share share;
+
+	mutable std::mutex state_mutex {};
+	std::condition_variable work_ready {}, all_done {};
+	std::deque<function<void()>> setups {};
+	vector<Entry> entries {};
+	vector<Status> statuses {};
+	/* The chains waiting for a slice, by (pass, index). */
+	std::set<pair<double, size_t>> ready {};
+	/* The pass of the chain sliced last, where new chains start. */
+	double floor_pass {0.0};
+	size_t busy {0};
+	bool stopping {false};
+
+	std::mutex file_mutex {};
+	vector<std::thread> workers {};
+};
@@ -0,0 +1,203 @@
+#include "Counters.h"
+
+#if defined(TSA_COUNTERS) and defined(__linux__)
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define TSA_COUNTERS_PERF
+#endif
+
+namespace counters {
+
+	const char* phase_name(Phase phase) {
+		switch (phase) {
+			case Phase::anneal:         return "anneal";
+			case Phase::total_distance: return "total_distance";
+			case Phase::flip_segment:   return "flip_segment";
+			case Phase::greedy:         return "greedy";
+			default:                    return "?";
+		}
+	}
+
+	const char* event_name(Event event) {
+		switch (event) {
+			case Event::cycles:        return "Cycles";
+			case Event::instructions:  return "Instructions";
+			case Event::cache_misses:  return "Cache Misses";
+			case Event::branch_misses: return "Branch Misses";
+			default:                   return "?";
+		}
+	}
+
+	namespace {
+		/* The calling thread's counters.  group is the file descriptor
+		 * of the first counter opened, which the others join, so that
+		 * one read gives them all; slot[e] is where event e comes in a
+		 * read, or -1 if it is unavailable. */
+		struct Counters {
+			bool opened {false};
+			int group {-1};
+			vector<int> fds {};
+			std::array<int, NUM_EVENTS> slot {};
+			Tally tally {};
+
+			~Counters() {
+#ifdef TSA_COUNTERS_PERF
+				for (int fd : fds)
+					close(fd);
+#endif
+			}
+		};
+
+		Counters& mine() {
+			thread_local Counters c {};
+			return c;
+		}
+
+#ifdef TSA_COUNTERS_PERF
+		void open_counters(Counters& c) {
+			const std::array<unsigned long long, NUM_EVENTS> configs {
+				PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+				PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+			};
+			int first_error {0};
+			for (size_t e {0}; e < NUM_EVENTS; e++) {
+				perf_event_attr attr {};
+				attr.size = sizeof(attr);
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = configs[e];
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_GROUP
+						| PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				int fd { static_cast<int>(syscall(SYS_perf_event_open, &attr,
+							0, -1, c.group, 0)) };
+				if (fd < 0) {
+					if (first_error == 0)
+						first_error = errno;
+					c.slot[e] = -1;
+					continue;
+				}
+				if (c.group < 0)
+					c.group = fd;
+				c.slot[e] = c.fds.size();
+				c.fds.push_back(fd);
+			}
+			if (first_error != 0) {
+				static std::atomic<bool> warned {false};
+				if (not warned.exchange(true)) {
+					cerr << "WARNING: Some hardware counters are unavailable ("
+						 << std::strerror(first_error) << "); they are reported"
+						 " as n/a." << endl;
+				}
+			}
+		}
+#else
+		void open_counters(Counters& c) {
+			c.slot.fill(-1);
+		}
+#endif
+	}
+
+	Scope::Reading Scope::read() {
+		Counters& c { mine() };
+		if (not c.opened) {
+			c.opened = true;
+			open_counters(c);
+			for (size_t e {0}; e < NUM_EVENTS; e++) {
+				if (c.slot[e] < 0) {
+					for (auto& p : c.tally)
+						p.events[e] = -1;
+				}
+			}
+		}
+		Reading r {};
+		r.time_ns = chrono::duration_cast<chrono::nanoseconds>(
+				chrono::steady_clock::now().time_since_epoch()).count();
+#ifdef TSA_COUNTERS_PERF
+		if (c.group >= 0) {
+			/* nr, time enabled, time running, then the values in order. */
+			unsigned long long buf[3 + NUM_EVENTS] {};
+			if (::read(c.group, buf, sizeof(buf)) > 0) {
+				r.enabled = buf[1];
+				r.running = buf[2];
+				for (size_t k {0}; k < buf[0] and k < NUM_EVENTS; k++)
+					r.values[k] = buf[3 + k];
+			}
+		}
+#endif
+		return r;
+	}
+
+	Scope::Scope(Phase phase) :
+		phase {phase},
+		start {read()} {}
+
+	Scope::~Scope() {
+		Reading stop { read() };
+		Counters& c { mine() };
+		PhaseCounts& p { c.tally[static_cast<size_t>(phase)] };
+		p.calls++;
+		p.time_ns += stop.time_ns - start.time_ns;
+		/* Scaled up for the time the counters were switched out, if the
+		 * kernel had more counters to run than registers to run them. */
+		double running { static_cast<double>(stop.running - start.running) };
+		double scale { running > 0 ? (stop.enabled - start.enabled) / running : 1.0 };
+		for (size_t e {0}; e < NUM_EVENTS; e++) {
+			if (c.slot[e] >= 0)
+				p.events[e] += (stop.values[c.slot[e]] - start.values[c.slot[e]]) * scale;
+		}
+	}
+
+	Tally thread_tally() {
+		return mine().tally;
+	}
+
+	Tally difference(const Tally& later, const Tally& earlier) {
+		Tally d { later };
+		for (size_t k {0}; k < NUM_PHASES; k++) {
+			d[k].calls -= earlier[k].calls;
+			d[k].time_ns -= earlier[k].time_ns;
+			for (size_t e {0}; e < NUM_EVENTS; e++) {
+				if (d[k].events[e] >= 0)
+					d[k].events[e] -= earlier[k].events[e];
+			}
+		}
+		return d;
+	}
+
+	void write_table(ostream& o, const Tally& tally) {
+		auto value = [&] (double v) {
+			if (v < 0)
+				o << ", n/a";
+			else
+				o << ", " << static_cast<long long>(v);
+		};
+		auto ratio = [&] (double num, double den, double times) {
+			if (num < 0 or den <= 0)
+				o << ", n/a";
+			else
+				o << ", " << times * num / den;
+		};
+		o << "Phase, Calls, Time (ns)";
+		for (size_t e {0}; e < NUM_EVENTS; e++)
+			o << ", " << event_name(static_cast<Event>(e));
+		o << ", Instructions per Cycle, Cache Misses per 1000 Instructions"
+			 ", Branch Misses per 1000 Instructions\n";
+		for (size_t k {0}; k < NUM_PHASES; k++) {
+			const PhaseCounts& p { tally[k] };
+			auto ev = [&] (Event e) { return p.events[static_cast<size_t>(e)]; };
+			o << phase_name(static_cast<Phase>(k)) << ", " << p.calls << ", " << p.time_ns;
+			for (double v : p.events)
+				value(v);
+			ratio(ev(Event::instructions), ev(Event::cycles), 1);
+			ratio(ev(Event::cache_misses), ev(Event::instructions), 1000);
+			ratio(ev(Event::branch_misses), ev(Event::instructions), 1000);
+			o << "\n";
+		}
+	}
+
+} // namespace counters
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "includes.h"
+
+#include <array>
+
+/* ************************************************** *
+ * Hardware performance counters per phase, to tell whether a slowdown
+ * comes from memory (cache misses) or from computation (cycles per
+ * instruction, branch misses) without running under an external
+ * profiler.
+ *
+ * Counting is compiled in only when TSA_COUNTERS is defined (compile
+ * with -DTSA_COUNTERS), and otherwise COUNT_PHASE(...) below expands to
+ * nothing, so a normal build pays nothing for it.  A counting build
+ * writes, for every run id, run-<id>/counters.txt, and a benchmark
+ * writes output/benchmark/counters.csv.
+ *
+ * - COUNT_PHASE(phase) counts from that line to the end of the enclosing
+ *   block towards phase, one of the Phase values.  The phases are the
+ *   annealing loop (SimAnnealer::advance(...)), total_distance(),
+ *   flip_segment(...) and the greedy heuristic's selection loop.  They
+ *   nest:  the annealing loop's counts include those of the steps it
+ *   takes.
+ *
+ * - thread_tally() is what the calling thread has counted so far, so that
+ *   the difference of two tallies is what was counted in between.
+ *
+ * The counters are those of Linux's perf_event_open(2), for the calling
+ * thread only and in user space only (so that the usual setting of
+ * kernel.perf_event_paranoid allows them).  Each thread opens its own
+ * on its first phase.  Where the kernel, a container or a virtual
+ * machine does not provide a counter, it is reported as unavailable
+ * ("n/a", or -1 in CSV files) while calls and times are still counted;
+ * on other systems, every counter is unavailable.
+ *
+ * Each phase reads the counters at its start and end, a system call
+ * each, which costs about a microsecond.  That is nothing for the
+ * annealing loop, but doubles the time of a short flip_segment(...), so
+ * the epochs per second of a counting build say little:  compare the
+ * counts per call instead.
+ */
+namespace counters {
+
+	enum class Phase { anneal, total_distance, flip_segment, greedy, count };
+	constexpr size_t NUM_PHASES { static_cast<size_t>(Phase::count) };
+	const char* phase_name(Phase phase);
+
+	enum class Event { cycles, instructions, cache_misses, branch_misses, count };
+	constexpr size_t NUM_EVENTS { static_cast<size_t>(Event::count) };
+	const char* event_name(Event event);
+
+	/* Event values are negative if the counter is unavailable. */
+	struct PhaseCounts {
+		unsigned long long calls {0};
+		long long time_ns {0};
+		std::array<double, NUM_EVENTS> events {};
+	};
+	using Tally = std::array<PhaseCounts, NUM_PHASES>;
+
+	constexpr bool COMPILED_IN {
+#ifdef TSA_COUNTERS
+		true
+#else
+		false
+#endif
+	};
+
+	Tally thread_tally();
+	Tally difference(const Tally& later, const Tally& earlier);
+
+	/* A table of tally, one line per phase, with instructions per cycle
+	 * and misses per thousand instructions where available. */
+	void write_table(ostream& o, const Tally& tally);
+
+	class Scope {
+	public:
+		Scope(Phase phase);
+		~Scope();
+		Scope(Scope&)  = delete;
+		Scope(Scope&&) = delete;
+	private:
+		struct Reading {
+			long long time_ns;
+			unsigned long long enabled, running;
+			std::array<unsigned long long, NUM_EVENTS> values;
+		};
+		static Reading read();
+		Phase phase;
+		Reading start;
+	};
+
+} // namespace counters
+
+#ifdef TSA_COUNTERS
+
+#define COUNT_CONCAT_(a, b) a##b
+#define COUNT_CONCAT(a, b) COUNT_CONCAT_(a, b)
+#define COUNT_PHASE(phase) \
+	::counters::Scope COUNT_CONCAT(count_phase_, __LINE__) { ::counters::Phase::phase }
+
+#else
+
+#define COUNT_PHASE(phase) ((void) 0)
+
+#endif
@@ -1,7 +1,12 @@
 #include "Direction.h"
+#include "Trace.h"
 
 Direction::Direction(dir_id_t id, double theta, double phi) :
+	Direction {id, theta, phi, id} {}
+
+Direction::Direction(dir_id_t id, double theta, double phi, dir_id_t input_id) :
 	id {id},
+	input_id {input_id},
 	theta   {},
 	theta_o {},
 	phi     {},
@@ -144,14 +149,66 @@ bool DirectionDatabase::place_direction(Direction&& d) {
 }
 
 
-size_t DirectionDatabase::get_num_directions_defined() const {
-	return DIRECTION_PRIME.size();
+dir_id_t DirectionDatabase::add_direction(double theta, double phi) {
+	dir_id_t id { static_cast<dir_id_t>(get_num_directions_defined()) };
+	place_direction(Direction { id, theta, phi });
+	return id;
 }
 
-const Direction& DirectionDatabase::get_direction(dir_id_t id, bool other_rep) const {
-	return (other_rep ?
-				DIRECTION_OTHER.at(id)
-				: DIRECTION_PRIME.at(id));
+dir_id_t DirectionDatabase::remove_direction(dir_id_t id) {
+	dir_id_t last_id { static_cast<dir_id_t>(get_num_directions_defined() - 1) };
+	if (id == 0 or id > last_id) {
+		throw std::runtime_error("Cannot remove direction " + to_string(id)
+				+ " from " + to_string(last_id + 1) + " directions.");
+	}
+	/* Directions cannot be assigned (their ids are const), so the gap is
+	 * filled by rebuilding the vectors. */
+	const Direction& last { DIRECTION_PRIME[last_id] };
+	vector<Direction> prime {}, other {};
+	prime.reserve(DIRECTION_PRIME.capacity());
+	other.reserve(DIRECTION_OTHER.capacity());
+	for (dir_id_t k {0}; k < last_id; k++) {
+		if (k == id) {
+			prime.push_back(Direction { id, last.get_theta(), last.get_phi() });
+			Direction otherrep { prime.back() }; // copy on purpose
+			otherrep.switch_rep();
+			other.push_back(move(otherrep));
+		} else {
+			prime.push_back(move(DIRECTION_PRIME[k]));
+			other.push_back(move(DIRECTION_OTHER[k]));
+		}
+	}
+	DIRECTION_PRIME = move(prime);
+	DIRECTION_OTHER = move(other);
+	return last_id;
+}
+
+shared_ptr<DirectionDatabase> DirectionDatabase::renumbered(
+		const vector<dir_id_t>& order) const {
+	size_t num_dir { get_num_directions_defined() };
+	vector<bool> seen(num_dir, false);
+	for (dir_id_t old_id : order) {
+		if (old_id >= num_dir or seen[old_id]) {
+			throw std::runtime_error("Cannot renumber " + to_string(num_dir)
+					+ " directions by an order that is not a permutation.");
+		}
+		seen[old_id] = true;
+	}
+	if (order.size() != num_dir or (num_dir > 0 and order[0] != 0)) {
+		throw std::runtime_error("Cannot renumber " + to_string(num_dir)
+				+ " directions by an order that does not cover them all,"
+				" starting with direction 0.");
+	}
+	auto dirdata { make_shared<DirectionDatabase>(num_dir) };
+	for (dir_id_t id {0}; id < num_dir; id++) {
+		const Direction& d { DIRECTION_PRIME[order[id]] };
+		dirdata->place_direction(Direction { id, d.get_theta(), d.get_phi(), d.input_id });
+	}
+	return dirdata;
+}
+
+size_t DirectionDatabase::get_num_directions_defined() const {
+	return DIRECTION_PRIME.size();
 }
 
 void DirectionDatabase::reserve_directions(size_t n) {
@@ -162,7 +219,44 @@ void DirectionDatabase::reserve_directions(size_t n) {
 /* ************************************************** */
 
 ostream& operator<<(ostream& s, const Direction& d) {
-	return s << "Direction(id=" << d.id
+	return s << "Direction(id=" << d.input_id
 			<< ", theta=" << d.get_theta()
 			<< ", phi=" << d.get_phi() << ")";
 }
+
+/* ************************************************** */
+
+shared_ptr<DirectionDatabase> load_directions(int run_id) {
+	return load_directions(run_id, get_input_filename(run_id));
+}
+
+shared_ptr<DirectionDatabase> load_directions(int run_id, const string& filename) {
+	TRACE_SPAN_ID("load_directions", run_id);
+	ifstream infile { file_reader(filename) };
+
+	constexpr int LEN_RUNID_LABEL = string_view("Run id: ").length();
+	infile.ignore(LEN_RUNID_LABEL);
+	int run_id_check;
+	infile >> run_id_check;
+	if (run_id != run_id_check) {
+		throw std::runtime_error("Run id was incorrect in an input file.\n"
+				"Run id in file name: " + to_string(run_id) + "\n"
+				"Run id within input: " + to_string(run_id_check));
+	}
+
+	constexpr int LEN_NUMDIRS_LABEL
+		= string_view("Num directions: ").length();
+	infile.ignore(LEN_NUMDIRS_LABEL);
+	int num_directions;
+	infile >> num_directions;
+
+	auto dirdata = make_shared<DirectionDatabase>(num_directions);
+	for (dir_id_t expected_id { 0 };
+			expected_id < num_directions;
+			expected_id++) {
+		auto d = Direction::read_from(infile);
+		dirdata->place_direction(move(d));
+	}
+	infile.close();
+	return dirdata;
+}
@@ -2,11 +2,14 @@
 
 #include "includes.h"
 
+#include <type_traits>
+
 using dir_id_t = unsigned int;
 
 struct Direction {
 public:
 	Direction(dir_id_t id, double theta, double phi);
+	Direction(dir_id_t id, double theta, double phi, dir_id_t input_id);
 	~Direction()             = default;
 	Direction(Direction& d)  = default;
 	Direction(Direction&& d) = default;
@@ -25,10 +28,63 @@ public:
 	static Direction read_from(string s);
 
 	const dir_id_t id;
+	/* The id in the input, which schedules are written with; the same
+	 * as id unless the Directions were renumbered (see
+	 * DirectionDatabase::renumbered(...)). */
+	const dir_id_t input_id;
 private:
 	double theta, theta_o, phi, phi_o;
 };
 
+/* ************************************************** *
+ * Angles in fixed point, for distance kernels over many Directions:  the
+ * full circle is 2^B units, B being the number of bits of U (uint32_t
+ * or uint16_t), so that arithmetic on U is arithmetic modulo a full
+ * turn.  The shorter way from one theta to another is then the smaller
+ * of their two differences, with no test against 2 pi, and as phi only
+ * ever turns by up to half a circle, the same holds for phi.  The other
+ * rep of (theta, phi) is (theta + half a turn, -phi), again modulo a
+ * full turn, so only the prime rep needs storing.  A unit is about
+ * 1.5e-9 radians for 32 bits and 9.6e-5 radians for 16 bits; sums of
+ * distances in units are exact.
+ */
+template<typename U>
+struct FixedAngles {
+	static_assert(std::is_unsigned_v<U> and sizeof(U) <= 4,
+			"Fixed-point angles need an unsigned type of at most 32 bits.");
+
+	static constexpr double UNITS_PER_TURN { 65536.0 * (sizeof(U) == 4 ? 65536.0 : 1.0) };
+	static constexpr double RADIANS_PER_UNIT { TWO_PI / UNITS_PER_TURN };
+	static constexpr U HALF_TURN { static_cast<U>(U {1} << (8 * sizeof(U) - 1)) };
+
+	static U encode(double angle) {
+		/* Converting a negative integer to U wraps it around, as wanted. */
+		return static_cast<U>(std::llround(angle / RADIANS_PER_UNIT));
+	}
+
+	static U other_theta(U theta) {
+		return static_cast<U>(theta + HALF_TURN);
+	}
+
+	static U other_phi(U phi) {
+		return static_cast<U>(U {0} - phi);
+	}
+
+	/* The shorter turn between two angles, in units. */
+	static U turn(U a, U b) {
+		return std::min(static_cast<U>(a - b), static_cast<U>(b - a));
+	}
+
+	/* Direction::dist_between(...), in units. */
+	static U dist(U theta1, U phi1, U theta2, U phi2) {
+		return std::max(turn(theta1, theta2), turn(phi1, phi2));
+	}
+
+	/* The prime rep of every Direction, by id. */
+	vector<U> theta {};
+	vector<U> phi {};
+};
+
 struct DirectionDatabase {
 public:
 	DirectionDatabase(size_t num_dirs_reserved=0) {
@@ -46,11 +102,54 @@ public:
 	void reserve_directions(size_t n);
 	bool place_direction(Direction&& dptr);
 
+	/* Changes to the Directions after loading, for re-planning.  Neither
+	 * may happen while anything else is using the database.
+	 *
+	 * - add_direction(theta, phi) adds a Direction with the next free
+	 *   id, and returns that id.
+	 *
+	 * - remove_direction(id) removes Direction id.  To keep the ids
+	 *   incremental, the Direction with the last id moves into the gap
+	 *   and takes over id; the last id is returned, and every schedule
+	 *   must then rename it (it equals id if id was the last).  Direction
+	 *   0 cannot be removed, as every schedule starts there.
+	 */
+	dir_id_t add_direction(double theta, double phi);
+	dir_id_t remove_direction(dir_id_t id);
+
+	/* A copy in which Direction order[k] becomes Direction k, keeping its
+	 * input id, so that Directions close in space may also be close in
+	 * memory; see construction::curve_order(...) in TelConstructor.h.
+	 * order must be a permutation of the ids starting with 0, as every
+	 * schedule starts there.
+	 */
+	shared_ptr<DirectionDatabase> renumbered(const vector<dir_id_t>& order) const;
+
 	size_t get_num_directions_defined() const;
-	const Direction& get_direction(dir_id_t id, bool other_rep) const;
+
+	/* Defined here so that it inlines into the annealers' inner loops,
+	 * where other_rep is often known at compile time. */
+	const Direction& get_direction(dir_id_t id, bool other_rep) const {
+		return (other_rep ?
+					DIRECTION_OTHER.at(id)
+					: DIRECTION_PRIME.at(id));
+	}
 
 	bool is_id_already_defined(dir_id_t look_for_id) const;
 
+	/* The Directions as they are now, in fixed point; see FixedAngles. */
+	template<typename U>
+	FixedAngles<U> fixed_angles() const {
+		FixedAngles<U> fixed {};
+		fixed.theta.reserve(DIRECTION_PRIME.size());
+		fixed.phi.reserve(DIRECTION_PRIME.size());
+		for (const Direction& d : DIRECTION_PRIME) {
+			fixed.theta.push_back(FixedAngles<U>::encode(d.get_theta()));
+			fixed.phi.push_back(FixedAngles<U>::encode(d.get_phi()));
+		}
+		return fixed;
+	}
+
 private:
 	/* NOTE:
 	 *
@@ -67,3 +166,9 @@ private:
 };
 
 ostream& operator<<(ostream& s, const Direction& d);
+
+/* Reads the Directions of run_id from its input file (see
+ * get_input_filename(...)), or from filename, which must hold the same
+ * run id. */
+shared_ptr<DirectionDatabase> load_directions(int run_id);
+shared_ptr<DirectionDatabase> load_directions(int run_id, const string& filename);
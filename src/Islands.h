@@ -0,0 +1,211 @@
+#pragma once
+
+#include "includes.h"
+
+#include <atomic>
+#include <thread>
+
+#include "SimAnneal.h"
+#include "Trace.h"
+
+/* ************************************************** *
+ * Island-model annealing:  several chains anneal the same problem on
+ * their own threads, each from its own random stream.  Every so often
+ * each chain publishes its best state to a shared board, and any chain
+ * that has fallen well behind the board's best restarts from it (after
+ * a few random steps, so the chains do not all collapse onto one state).
+ */
+
+template<typename T>
+class IslandBoard {
+/* The board holds a single atomic pointer to the best state published
+ * so far.  Entries are never changed after they are published, and
+ * nothing is freed until the board itself is destroyed, so a chain
+ * may read the state behind the pointer without any locking while
+ * other chains publish better ones.  Only improvements are published,
+ * which keeps the number of retained entries small.
+ */
+public:
+	struct Entry {
+		double objective;
+		int island;
+		unique_ptr<T> state;
+	};
+
+	IslandBoard(int num_islands) :
+		best {nullptr},
+		published(num_islands) {}
+	~IslandBoard() = default;
+	IslandBoard(IslandBoard&)  = delete;
+	IslandBoard(IslandBoard&&) = delete;
+
+	/* Returns true if state became the best on the board.  Each island
+	 * must only publish from its own thread.
+	 */
+	bool publish(int island, double objective, unique_ptr<T>&& state) {
+		const Entry* expected { best.load(std::memory_order_acquire) };
+		if (expected != nullptr and not (objective < expected->objective))
+			return false;
+
+		auto& mine { published.at(island) };
+		mine.push_back(make_unique<Entry>(Entry { objective, island, move(state) }));
+		const Entry* desired { mine.back().get() };
+		while (expected == nullptr or objective < expected->objective) {
+			if (best.compare_exchange_weak(expected, desired,
+						std::memory_order_acq_rel,
+						std::memory_order_acquire))
+				return true;
+		}
+		mine.pop_back();
+		return false;
+	}
+
+	/* The best entry so far, or nullptr if nothing is published yet. */
+	const Entry* read() const {
+		return best.load(std::memory_order_acquire);
+	}
+
+private:
+	std::atomic<const Entry*> best;
+	vector<vector<unique_ptr<Entry>>> published;
+};
+
+/* ************************************************** */
+
+template<typename T>
+class IslandAnnealer {
+/* Explanation of the parameters:
+ *
+ * - chains are the annealers, one per island.  They should all solve
+ *   the same problem (and share a run id), since the state from one
+ *   chain is copied into another.
+ *
+ * - migrate_every is how many epochs each chain runs between visits to
+ *   the board.
+ *
+ * - lag_tolerance decides which chains are lagging:  those whose current
+ *   objective exceeds the board's best by this fraction.
+ *
+ * - perturb_steps is how many random steps follow each restart.
+ */
+public:
+	IslandAnnealer(vector<unique_ptr<SimAnnealer<T>>>&& chains,
+					unsigned long migrate_every,
+					double lag_tolerance,
+					unsigned long perturb_steps=3) :
+		chains {move(chains)},
+		migrate_every {migrate_every},
+		lag_tolerance {lag_tolerance},
+		perturb_steps {perturb_steps},
+		board {static_cast<int>(this->chains.size())} {}
+	~IslandAnnealer() = default;
+	IslandAnnealer(IslandAnnealer&)  = delete;
+	IslandAnnealer(IslandAnnealer&&) = delete;
+
+	/* Runs every chain for num_epochs epochs, then saves the single best
+	 * state and a merged log where the first chain would have saved its
+	 * own.  Returns the best objective.
+	 */
+	double run(unsigned long num_epochs, unsigned long verbose_every=0,
+				const double SAVE_TOLERANCE=0.1) {
+		{
+			vector<thread> threads {};
+			threads.reserve(chains.size());
+			for (size_t k {0}; k < chains.size(); k++) {
+				threads.emplace_back([=] () {
+					TRACE_THREAD_NAME("island " + to_string(k));
+					run_island(k, num_epochs, verbose_every, SAVE_TOLERANCE);
+				});
+			}
+			for (auto& t : threads)
+				t.join();
+		}
+		if (island_error) {
+			rethrow_exception(island_error);
+		}
+
+		auto& winner { *std::min_element(chains.begin(), chains.end(),
+				[] (auto& c1, auto& c2) {
+					return c1->get_obj_best() < c2->get_obj_best();
+				}) };
+		int run_id { winner->get_run_id() };
+		winner->save_best_state(
+				winner->get_annealing_filename_for_epoch(run_id, num_epochs));
+		save_merged_log(winner->get_annealing_filename_for_full_log(run_id));
+		return winner->get_obj_best();
+	}
+
+private:
+	void run_island(size_t k, unsigned long num_epochs,
+			unsigned long verbose_every, const double SAVE_TOLERANCE) {
+		try {
+			auto& chain { *chains[k] };
+			chain.set_chain_index(k);
+			chain.set_file_output(false);
+			chain.begin_run(num_epochs, (k == 0 ? verbose_every : 0),
+							SAVE_TOLERANCE);
+			bool epochs_left {true};
+			while (epochs_left) {
+				epochs_left = chain.advance(migrate_every);
+				board.publish(k, chain.get_obj_best(),
+								chain.duplicate(chain.get_best_state()));
+				auto best { board.read() };
+				if (epochs_left and best->island != static_cast<int>(k)
+						and chain.get_obj_curr()
+								> best->objective * (1.0 + lag_tolerance)) {
+					chain.restart_from(*best->state, perturb_steps);
+				}
+			}
+			chain.finish_run();
+		} catch (...) {
+			/* Keep only the first error, and report it from run(...). */
+			bool expected {false};
+			if (island_failed.compare_exchange_strong(expected, true))
+				island_error = current_exception();
+		}
+	}
+
+	void save_merged_log(string filename) {
+		/* Rows from every chain, in order of wall time.  The Best Objective
+		 * column is the best over all chains up to that time, so that the
+		 * log reads like the log of a single run.
+		 */
+		using Row = typename SimAnnealer<T>::LogRow;
+		vector<pair<Row, size_t>> rows {};
+		for (size_t k {0}; k < chains.size(); k++) {
+			for (auto& row : chains[k]->get_log_rows())
+				rows.push_back({ row, k });
+		}
+		std::stable_sort(rows.begin(), rows.end(),
+				[] (auto& r1, auto& r2) {
+					return r1.first.wall_time_ns < r2.first.wall_time_ns;
+				});
+
+		ofstream o { file_writer(filename) };
+		o << setprecision(10);
+		o << "Run id: " << chains[0]->get_run_id()
+		  << "\nBest objective (over " << chains.size()
+		  << " islands) remained constant between epochs listed below."
+		  << "\n(Current objective may have changed, however.)"
+		  << "\nEpoch, Current Objective, Best Objective, Wall Time (ns), Island\n";
+		double best_so_far { numeric_limits<double>::max() };
+		for (auto& [row, k] : rows) {
+			best_so_far = std::min(best_so_far, row.obj_best);
+			o << row.epoch << ", "
+			  << row.obj_curr << ", "
+			  << best_so_far << ", "
+			  << row.wall_time_ns.count() << ", "
+			  << k << "\n";
+		}
+		o.close();
+	}
+
+	vector<unique_ptr<SimAnnealer<T>>> chains;
+	unsigned long migrate_every;
+	double lag_tolerance;
+	unsigned long perturb_steps;
+	IslandBoard<T> board;
+
+	std::atomic<bool> island_failed {false};
+	exception_ptr island_error {};
+};
@@ -0,0 +1,540 @@
+#pragma once
+
+#include "includes.h"
+
+#include <array>
+#include <type_traits>
+
+#include "Direction.h"
+#include "Schedule.h"
+#include "SimAnneal.h"
+#include "Trace.h"
+
+/* ************************************************** *
+ * Anneals up to L independent problems in lock-step, one per SIMD lane,
+ * for batches of many small instances.  A scalar TelAnnealer spends most
+ * of each epoch on a handful of dependent loads and comparisons, leaving
+ * the vector units of its core idle; stepping L chains at once lets the
+ * compiler evaluate all L proposals with the same vector instructions.
+ *
+ * Each lane is one run id, with or without the second rep, and anneals
+ * exactly as TelAnnealer does with the array schedule and the default
+ * Chebyshev metric:  the same segment reversals (with the same chance of
+ * switching reps), the same objective and acceptance rule, the piecewise
+ * constant geometric cooling of the settings, and the same files, namely
+ * simanneal-EPOCH.txt whenever the best objective has dropped by the
+ * save tolerance and simanneal-full-log.txt.  Only the random streams
+ * differ, so a lane's result is not that of the scalar run with the same
+ * seed, but is just as good on average.
+ *
+ * The data is laid out so that an epoch is mostly loops over the L lanes:
+ *
+ *   - each lane keeps its schedule as arrays, indexed by position, of
+ *     the theta and phi of the rep in use and of the other rep (along
+ *     with the ids and reps, for writing), so a proposal needs no lookups
+ *     in the DirectionDatabase;
+ *
+ *   - each lane has its own xoroshiro128+ stream, whose state is two
+ *     arrays over the lanes, advanced for all lanes in one loop;
+ *
+ *   - the coordinates at the ends of the L proposed reversals are
+ *     gathered into arrays over the lanes, so that the L changes of
+ *     distance (see reversal_delta(...) in ScheduleMoves.h) and the L
+ *     acceptance tests are computed branch-free, one lane per element.
+ *
+ * The coordinates are of type C:  double, or, for fixed-point angles
+ * (see FixedAngles in Direction.h), uint32_t or uint16_t.  Fixed point
+ * halves or quarters the memory of the coordinates, and needs no arrays
+ * for the other rep, as switching reps is an addition and a negation;
+ * the changes of distance are computed in integer vector instructions,
+ * with no test for the theta wrap, and are exact, so the objective never
+ * needs recomputing.  The objectives reported are then those of the
+ * rounded angles, within a unit per Direction of the exact ones.
+ *
+ * Accepted reversals are then applied lane by lane.  Since instances of
+ * any size take constant time per proposal, lanes need not hold
+ * instances of the same size, but on large instances the reversals
+ * dominate and there is little to gain.  Every lane runs the same number
+ * of epochs; a batch of fewer than L problems leaves the other lanes idle.
+ */
+/* One lane's problem.  Annealing starts from start if given, and
+ * otherwise from the identity schedule, at initial temperature cool_init.
+ * Chains other than chain 0 draw from streams of their own, as with
+ * SimAnnealer::set_chain_index(...).
+ */
+struct LockstepProblem {
+	int run_id;
+	shared_ptr<DirectionDatabase> dirdata;
+	bool without_second_rep;
+	double cool_init;
+	unique_ptr<Schedule> start {};
+	int chain_index {0};
+};
+
+template<size_t L, typename C=double>
+class LockstepAnnealer {
+public:
+	static_assert(L > 0, "A lock-step annealer needs at least one lane.");
+
+	static constexpr bool FIXED { not std::is_floating_point_v<C> };
+	using Fixed = FixedAngles<std::conditional_t<FIXED, C, uint32_t>>;
+	/* Distances and their changes:  whole units in fixed point. */
+	using dist_t = std::conditional_t<FIXED, int64_t, double>;
+
+	LockstepAnnealer(vector<LockstepProblem>&& problems, double cool_base,
+						long cool_flat_epochs) :
+		lanes {},
+		cool_flat_epochs {cool_flat_epochs} {
+		if (problems.empty() or problems.size() > L) {
+			throw std::runtime_error("A lock-step annealer with "
+					+ to_string(L) + " lanes cannot anneal "
+					+ to_string(problems.size()) + " problems at once.");
+		}
+		lanes.reserve(problems.size());
+		for (auto& p : problems)
+			lanes.push_back(make_lane(move(p), cool_base));
+	}
+
+	~LockstepAnnealer() = default;
+	LockstepAnnealer(LockstepAnnealer&)  = delete;
+	LockstepAnnealer(LockstepAnnealer&&) = delete;
+
+	/* As SimAnnealer::run(...), for every lane at once. */
+	void run(unsigned long num_epochs, unsigned long verbose_every=50,
+				const double SAVE_TOLERANCE=0.1) {
+		TRACE_SPAN("lockstep: run");
+		const size_t num_active { lanes.size() };
+		cout.setf(ios_base::scientific);
+		cout << setprecision(10);
+
+		/* Per-lane values used in every epoch, over all L lanes so that
+		 * the loops below have a fixed length.  Idle lanes propose
+		 * nothing and never accept. */
+		alignas(64) std::array<uint64_t, L> rng0 {}, rng1 {};
+		alignas(64) std::array<uint64_t, L> range_i {}, range_j {};
+		alignas(64) std::array<dist_t, L> obj {};
+		alignas(64) std::array<double, L> temperature {};
+		temperature.fill(1.0);
+		for (size_t l {0}; l < num_active; l++) {
+			LaneState& s { lanes[l] };
+			seed_stream(s.seed, s.chain_index, rng0[l], rng1[l]);
+			range_i[l] = s.num_dir - 1;
+			range_j[l] = s.num_dir - 2;
+			obj[l] = total_distance(s);
+			s.obj_best = to_objective(obj[l]);
+			s.best_ids  = s.ids;
+			s.best_othr = s.othr;
+			s.obj_prev_saved  = 10 * max(s.obj_best, 1.0);
+			s.obj_prev_logged = 10 * max(s.obj_best, 1.0);
+			s.full_log = file_writer(filename_for_full_log(s));
+			s.full_log << setprecision(10);
+			s.full_log << "Run id: " << s.run_id
+					<< "\nBest objective remained constant between epochs listed below."
+					<< "\n(Current objective may have changed, however.)"
+					<< "\nEpoch, Current Objective, Best Objective, Wall Time (ns)\n";
+		}
+
+		/* The proposals of one epoch:  the random numbers drawn, the
+		 * reversal (i, j, switch_rep) of each lane, and the coordinates
+		 * at its ends.  Writing a for the Direction before i, b for the
+		 * one after j, and a trailing s for the switched rep, the change
+		 * of distance is
+		 *     d(a, js) - d(a, i) + has_b * (d(b, is) - d(b, j)).
+		 */
+		alignas(64) std::array<uint64_t, L> r1 {}, r2 {}, r3 {};
+		alignas(64) std::array<size_t, L> mv_i {}, mv_j {};
+		alignas(64) std::array<bool, L> mv_switch {}, accept {};
+		alignas(64) std::array<C, L> th_a {}, ph_a {}, th_b {}, ph_b {};
+		alignas(64) std::array<C, L> th_i {}, ph_i {}, th_is {}, ph_is {};
+		alignas(64) std::array<C, L> th_j {}, ph_j {}, th_js {}, ph_js {};
+		alignas(64) std::array<dist_t, L> has_b {}, obj_new {};
+		alignas(64) std::array<double, L> unif {};
+
+		const unsigned long first_epoch {1};
+		const unsigned long final_epoch {num_epochs};
+		unsigned long vb_prev_epoch {0};
+		long temperature_block {-1};
+		auto start { clock::now() };
+
+		for (unsigned long epoch {first_epoch}; epoch <= final_epoch; epoch++) {
+			/* The cooling is constant over blocks of cool_flat_epochs. */
+			if (long block { static_cast<long>(epoch) / cool_flat_epochs };
+					block != temperature_block) {
+				temperature_block = block;
+				for (size_t l {0}; l < num_active; l++)
+					temperature[l] = lanes[l].coolfn->coolingfn(epoch);
+			}
+
+			next_random(rng0, rng1, r1);
+			next_random(rng0, rng1, r2);
+			next_random(rng0, rng1, r3);
+
+			/* Sample exactly as TelAnnealer::sample_reversal(...) does,
+			 * and gather the coordinates at the ends of each reversal. */
+			for (size_t l {0}; l < num_active; l++) {
+				const LaneState& s { lanes[l] };
+				size_t i { 1 + static_cast<size_t>(((r1[l] >> 32) * range_i[l]) >> 32) };
+				size_t j { 1 + static_cast<size_t>(((r2[l] >> 32) * range_j[l]) >> 32) };
+				if (i == j)
+					j = range_i[l];
+				if (i > j)
+					std::swap(i, j);
+				bool switch_rep { s.allow_switch and ((r3[l] >> 10) & 1) };
+				mv_i[l] = i;
+				mv_j[l] = j;
+				mv_switch[l] = switch_rep;
+
+				th_a[l]  = s.theta[i - 1];
+				ph_a[l]  = s.phi[i - 1];
+				th_i[l]  = s.theta[i];
+				ph_i[l]  = s.phi[i];
+				th_j[l]  = s.theta[j];
+				ph_j[l]  = s.phi[j];
+				th_is[l] = (switch_rep ? theta_alt(s, i) : s.theta[i]);
+				ph_is[l] = (switch_rep ? phi_alt(s, i)   : s.phi[i]);
+				th_js[l] = (switch_rep ? theta_alt(s, j) : s.theta[j]);
+				ph_js[l] = (switch_rep ? phi_alt(s, j)   : s.phi[j]);
+				bool b_exists { j + 1 < s.num_dir };
+				th_b[l]  = (b_exists ? s.theta[j + 1] : C {});
+				ph_b[l]  = (b_exists ? s.phi[j + 1]   : C {});
+				has_b[l] = (b_exists ? dist_t {1} : dist_t {0});
+				unif[l]  = (r3[l] >> 11) * 0x1.0p-53;
+			}
+
+			/* The changes of objective and the acceptance tests, for all
+			 * lanes at once.  The arithmetic is that of reversal_delta(...)
+			 * and SimAnnealer::advance(...), so with double coordinates the
+			 * objectives agree with theirs to the last bit. */
+			for (size_t l {0}; l < L; l++) {
+				dist_t delta { dist(th_a[l], ph_a[l], th_js[l], ph_js[l])
+								- dist(th_a[l], ph_a[l], th_i[l], ph_i[l]) };
+				delta += has_b[l] * (dist(th_b[l], ph_b[l], th_is[l], ph_is[l])
+								- dist(th_b[l], ph_b[l], th_j[l], ph_j[l]));
+				obj_new[l] = obj[l] + delta;
+			}
+			for (size_t l {0}; l < L; l++) {
+				accept[l] = (obj_new[l] < obj[l]
+						or unif[l] < std::exp(to_objective(obj[l] - obj_new[l])
+												/ temperature[l]));
+			}
+
+			bool first_or_last { epoch == first_epoch or epoch == final_epoch };
+			bool should_vb {
+					verbose_every > 0
+					and epoch / verbose_every != vb_prev_epoch / verbose_every
+				};
+			if (should_vb)
+				vb_prev_epoch = epoch;
+
+			for (size_t l {0}; l < num_active; l++) {
+				LaneState& s { lanes[l] };
+				if (accept[l]) {
+					flip_segment(s, mv_i[l], mv_j[l], mv_switch[l]);
+					obj[l] = obj_new[l];
+				}
+				/* Only ever adding up changes lets rounding errors build
+				 * up, so now and then recompute the objective.  Sums of
+				 * fixed-point distances are exact. */
+				if (not FIXED and epoch % RESYNC_EVERY == 0)
+					obj[l] = total_distance(s);
+
+				double obj_curr { to_objective(obj[l]) };
+				if (obj_curr < s.obj_best) {
+					s.obj_best = obj_curr;
+					s.epoch_best = epoch;
+					s.time_best = clock::now() - start;
+					std::copy(s.ids.begin(), s.ids.end(), s.best_ids.begin());
+					std::copy(s.othr.begin(), s.othr.end(), s.best_othr.begin());
+				}
+
+				bool should_log { s.obj_best < s.obj_prev_logged or first_or_last };
+				bool should_save {
+						s.obj_best < s.obj_prev_saved - SAVE_TOLERANCE
+						or first_or_last
+					};
+				if (should_log or should_save) {
+					nanos time_curr { clock::now() - start };
+					if (should_save) {
+						save_best_state(s, obj_curr, epoch, time_curr);
+						s.obj_prev_saved = s.obj_best;
+					}
+					if (should_log) {
+						s.full_log << epoch << ", " << obj_curr << ", "
+								<< s.obj_best << ", " << time_curr.count() << "\n";
+						s.obj_prev_logged = s.obj_best;
+					}
+				}
+
+				if (should_vb) {
+					cout << "Run id " << s.run_id
+							<< (s.allow_switch ? "" : " (no second rep)")
+							<< ", epoch " << epoch
+							<< ".  Temperature = " << temperature[l]
+							<< ", Objective = "
+							<< obj_curr << " (curr) and "
+							<< s.obj_best << " (best)" << endl;
+				}
+			}
+		}
+
+		for (size_t l {0}; l < num_active; l++) {
+			lanes[l].obj_curr = to_objective(obj[l]);
+			lanes[l].full_log.close();
+		}
+	}
+
+	size_t get_num_lanes() const {
+		return lanes.size();
+	}
+
+	double get_obj_best(size_t lane) const {
+		return lanes.at(lane).obj_best;
+	}
+
+	/* The best schedule found by lane, as a Schedule. */
+	unique_ptr<Schedule> get_best_state(size_t lane) const {
+		const LaneState& s { lanes.at(lane) };
+		return make_unique<Schedule>(
+				vector<dir_id_t>(s.best_ids.begin(), s.best_ids.end()),
+				vector<bool>(s.best_othr.begin(), s.best_othr.end()),
+				s.dirdata);
+	}
+
+private:
+	using clock = std::chrono::high_resolution_clock;
+
+	static constexpr unsigned long RESYNC_EVERY { 1'000'000 };
+
+	struct LaneState {
+		int run_id;
+		shared_ptr<DirectionDatabase> dirdata;
+		size_t num_dir;
+		bool allow_switch;
+		int seed;
+		int chain_index;
+		unique_ptr<cooling::CoolingFn> coolfn;
+
+		/* The schedule, by position.  The coordinates of the other rep
+		 * are only kept for double coordinates. */
+		vector<C> theta {}, phi {}, theta_alt {}, phi_alt {};
+		vector<dir_id_t> ids {};
+		vector<uint8_t> othr {};
+
+		vector<dir_id_t> best_ids {};
+		vector<uint8_t> best_othr {};
+		double obj_curr {}, obj_best {};
+		unsigned long epoch_best {0};
+		nanos time_best {0};
+
+		ofstream full_log {};
+		double obj_prev_saved {}, obj_prev_logged {};
+	};
+
+	LaneState make_lane(LockstepProblem&& p, double cool_base) const {
+		size_t num_dir { p.dirdata->get_num_directions_defined() };
+		if (num_dir < 3) {
+			throw std::runtime_error("Run id " + to_string(p.run_id)
+					+ " has too few Directions to anneal.");
+		}
+		LaneState s {
+			p.run_id, p.dirdata, num_dir, not p.without_second_rep,
+			/* The seed of TelAnnealer::get_rand_seed(). */
+			(p.without_second_rep ? 1'000'000 : 0) + p.run_id,
+			p.chain_index,
+			make_unique<cooling::PiecewiseConstGeomCool>(
+					p.cool_init, cool_base, cool_flat_epochs)
+		};
+		s.theta.resize(num_dir);
+		s.phi.resize(num_dir);
+		if (not FIXED) {
+			s.theta_alt.resize(num_dir);
+			s.phi_alt.resize(num_dir);
+		}
+		Fixed fixed {};
+		if constexpr (FIXED)
+			fixed = s.dirdata->template fixed_angles<C>();
+		s.ids.resize(num_dir);
+		s.othr.resize(num_dir);
+		s.best_ids.resize(num_dir);
+		s.best_othr.resize(num_dir);
+		for (size_t k {0}; k < num_dir; k++) {
+			s.ids[k]  = (p.start ? p.start->get_id_at(k) : k);
+			s.othr[k] = (p.start ? p.start->is_other_at(k) : false);
+			if (s.othr[k] and not s.allow_switch) {
+				throw std::runtime_error("Run id " + to_string(p.run_id)
+						+ " cannot start from a schedule using the second"
+						" rep when annealing without it.");
+			}
+			if constexpr (FIXED) {
+				C theta { fixed.theta[s.ids[k]] }, phi { fixed.phi[s.ids[k]] };
+				s.theta[k] = (s.othr[k] ? Fixed::other_theta(theta) : theta);
+				s.phi[k]   = (s.othr[k] ? Fixed::other_phi(phi) : phi);
+			} else {
+				const Direction& d     { s.dirdata->get_direction(s.ids[k], s.othr[k]) };
+				const Direction& d_alt { s.dirdata->get_direction(s.ids[k], not s.othr[k]) };
+				s.theta[k]     = d.get_theta();
+				s.phi[k]       = d.get_phi();
+				s.theta_alt[k] = d_alt.get_theta();
+				s.phi_alt[k]   = d_alt.get_phi();
+			}
+		}
+		return s;
+	}
+
+	/* Direction::dist_between(...), written so that it vectorises:  with
+	 * both thetas in [0, 2 pi], the shorter way around is the smaller of
+	 * |t1 - t2| and 2 pi - |t1 - t2|, computed with the same roundings. */
+	static double chebyshev(double t1, double p1, double t2, double p2) {
+		double dt { std::abs(t1 - t2) };
+		return std::max(std::abs(p1 - p2), std::min(dt, TWO_PI - dt));
+	}
+
+	static dist_t dist(C t1, C p1, C t2, C p2) {
+		if constexpr (FIXED)
+			return Fixed::dist(t1, p1, t2, p2);
+		else
+			return chebyshev(t1, p1, t2, p2);
+	}
+
+	static double to_objective(dist_t d) {
+		if constexpr (FIXED)
+			return d * Fixed::RADIANS_PER_UNIT;
+		else
+			return d;
+	}
+
+	static C theta_alt(const LaneState& s, size_t k) {
+		if constexpr (FIXED)
+			return Fixed::other_theta(s.theta[k]);
+		else
+			return s.theta_alt[k];
+	}
+
+	static C phi_alt(const LaneState& s, size_t k) {
+		if constexpr (FIXED)
+			return Fixed::other_phi(s.phi[k]);
+		else
+			return s.phi_alt[k];
+	}
+
+	static dist_t total_distance(const LaneState& s) {
+		dist_t total {0};
+		for (size_t k {1}; k < s.num_dir; k++)
+			total += dist(s.theta[k - 1], s.phi[k - 1], s.theta[k], s.phi[k]);
+		return total;
+	}
+
+	/* As Schedule::flip_segment(...), on every array of the lane. */
+	static void flip_segment(LaneState& s, size_t i, size_t j, bool switch_rep) {
+		std::reverse(s.ids.begin() + i, s.ids.begin() + j + 1);
+		std::reverse(s.othr.begin() + i, s.othr.begin() + j + 1);
+		std::reverse(s.theta.begin() + i, s.theta.begin() + j + 1);
+		std::reverse(s.phi.begin() + i, s.phi.begin() + j + 1);
+		if constexpr (FIXED) {
+			if (switch_rep) {
+				for (size_t k {i}; k <= j; k++) {
+					s.theta[k] = Fixed::other_theta(s.theta[k]);
+					s.phi[k]   = Fixed::other_phi(s.phi[k]);
+				}
+			}
+		} else {
+			std::reverse(s.theta_alt.begin() + i, s.theta_alt.begin() + j + 1);
+			std::reverse(s.phi_alt.begin() + i, s.phi_alt.begin() + j + 1);
+			if (switch_rep) {
+				std::swap_ranges(s.theta.begin() + i, s.theta.begin() + j + 1,
+									s.theta_alt.begin() + i);
+				std::swap_ranges(s.phi.begin() + i, s.phi.begin() + j + 1,
+									s.phi_alt.begin() + i);
+			}
+		}
+		if (switch_rep) {
+			for (size_t k {i}; k <= j; k++)
+				s.othr[k] ^= 1;
+		}
+	}
+
+	/* ************************************************** *
+	 * The random streams:  xoroshiro128+ (Blackman and Vigna), seeded
+	 * through splitmix64.  Only additions, shifts and exclusive ors, so
+	 * one loop advances all L streams with vector instructions.  The low
+	 * bits of xoroshiro128+ are its weakest, so only the high ones are
+	 * used above.
+	 */
+	static uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	static void next_random(std::array<uint64_t, L>& s0, std::array<uint64_t, L>& s1,
+							std::array<uint64_t, L>& out) {
+		for (size_t l {0}; l < L; l++) {
+			uint64_t a { s0[l] }, b { s1[l] };
+			out[l] = a + b;
+			b ^= a;
+			s0[l] = rotl(a, 24) ^ b ^ (b << 16);
+			s1[l] = rotl(b, 37);
+		}
+	}
+
+	static void seed_stream(int seed, int chain_index, uint64_t& s0, uint64_t& s1) {
+		uint64_t x { (static_cast<uint64_t>(chain_index) << 32)
+						^ static_cast<uint32_t>(seed) };
+		auto splitmix = [&x] () {
+			uint64_t z { (x += 0x9e3779b97f4a7c15) };
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			return z ^ (z >> 31);
+		};
+		s0 = splitmix();
+		s1 = splitmix();
+	}
+
+	/* ************************************************** *
+	 * Output, in the same files and formats as TelAnnealer and
+	 * SimAnnealer::save_best_state(...).
+	 */
+	static string filename_for_epoch(const LaneState& s, unsigned long epoch) {
+		string sr { (s.allow_switch ? "" : "no-second-rep/") };
+		return get_run_folder(s.run_id) + sr + "simanneal-" + to_string(epoch) + ".txt";
+	}
+
+	static string filename_for_full_log(const LaneState& s) {
+		string sr { (s.allow_switch ? "" : "no-second-rep/") };
+		return get_run_folder(s.run_id) + sr + "simanneal-full-log.txt";
+	}
+
+	void save_best_state(const LaneState& s, double obj_curr,
+							unsigned long epoch, nanos time_curr) const {
+		TRACE_SPAN_ID("lockstep: save_best_state", s.run_id);
+		ofstream o { file_writer(filename_for_epoch(s, epoch)) };
+		o.setf(ios_base::fixed);
+		o << setprecision(10);
+		o << "Run id: " << s.run_id
+		  << "\nCurrent objective: " << obj_curr
+		  << "\nBest objective: " << s.obj_best
+		  << "\n" << SEPARATOR
+		  << "\nCurrent epoch: " << epoch
+		  << "\nTime running (ns): " << time_curr.count()
+		  << "\nCooling method description:\n"
+		  << s.coolfn->descr
+		  << "\n" << SEPARATOR
+		  << "\nRandom start: "
+		  << s.seed << "\n"
+		  << SEPARATOR;
+		o << "\nBest state from epoch: "
+		  << s.epoch_best
+		  << "\nBest found after time (ns): "
+		  << s.time_best.count()
+		  << "\nBest State:\n";
+		Schedule best {
+				vector<dir_id_t>(s.best_ids.begin(), s.best_ids.end()),
+				vector<bool>(s.best_othr.begin(), s.best_othr.end()),
+				s.dirdata };
+		o << best;
+		o << SEPARATOR;
+		o << endl;
+		o.close();
+	}
+
+	vector<LaneState> lanes;
+	long cool_flat_epochs;
+};
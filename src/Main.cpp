@@ -1,52 +1,282 @@
 #include "includes.h"
 
 #include <csignal>
+#include <filesystem>
+#include <optional>
 #include <thread>
 
+#include "Affinity.h"
+#include "Benchmark.h"
+#include "ChainScheduler.h"
+#include "Counters.h"
 #include "Direction.h"
+#include "RunSettings.h"
 #include "SimAnneal.h"
+#include "Sky.h"
+#include "SolverDaemon.h"
+#include "Islands.h"
+#include "LockstepAnnealer.h"
+#include "Memetic.h"
+#include "Results.h"
 #include "TelAnnealer.h"
+#include "TelConstructor.h"
+#include "TelDecomposer.h"
 #include "TelGreedy.h"
+#include "TelSkyAnnealer.h"
+#include "Trace.h"
+#include "Tuner.h"
+#include "WorkQueue.h"
 
-/* ************************************************** */
+/* ************************************************** *
+ * Anneals one run id using the schedule type S, on several islands or
+ * memetically if the settings ask for it.  Annealing starts from
+ * start_sch if given, and otherwise from the identity schedule.
+ * Distances are measured by metric, of S's metric type.  The outcome
+ * goes to result, for the results table.  With a scheduler, a single
+ * chain is handed over to it instead, to anneal in time slices and then
+ * append result to the results table itself.
+ */
+template<typename S, typename Start=Schedule>
+void anneal(int run_id, shared_ptr<DirectionDatabase> dirdata,
+			bool without_second_rep, const RunSettings& settings,
+			ResultsTable::Row& result, const Start* start_sch=nullptr,
+			const typename S::metric_type& metric={},
+			ChainScheduler* scheduler=nullptr) {
+	unique_ptr<S> start_state {};
+	double cool_init { settings.cool_init };
+	if (start_sch) {
+		start_state = construction::convert<S, Start>(*start_sch, dirdata);
+		cool_init = construction::seeded_cool_init(settings, *start_sch, dirdata);
+		cout << "Starting from " << settings.start << " schedule of distance "
+				<< start_sch->total_distance() << ", with initial temperature "
+				<< cool_init << endl;
+	}
 
-shared_ptr<DirectionDatabase> load_directions(int run_id) {
-	ifstream infile { file_reader(get_input_filename(run_id)) };
-
-	constexpr int LEN_RUNID_LABEL = string_view("Run id: ").length();
-	infile.ignore(LEN_RUNID_LABEL);
-	int run_id_check;
-	infile >> run_id_check;
-	if (run_id != run_id_check) {
-		throw std::runtime_error("Run id was incorrect in an input file.\n"
-				"Run id in file name: " + to_string(run_id) + "\n"
-				"Run id within input: " + to_string(run_id_check));
+	auto make_annealer = [&] (const S* from, double temperature) {
+		unique_ptr<cooling::CoolingFn> coolptr {
+			new cooling::PiecewiseConstGeomCool
+					{ temperature, settings.cool_base,
+					  settings.cool_flat_epochs }
+		};
+		auto annealer { make_unique<TelAnnealerFor<S>>(
+				run_id, move(coolptr), dirdata, without_second_rep, false, metric) };
+		annealer->set_rejection_free_below(settings.rejection_free_below);
+		annealer->set_acceptance(cooling::acceptance_from_name(settings.acceptance),
+								 settings.lahc_history);
+		if (from)
+			annealer->start_from(*from);
+		return annealer;
+	};
+
+	if (settings.islands > 1) {
+		cout << "Annealing on " << settings.islands
+				<< " islands..." << endl;
+		vector<unique_ptr<SimAnnealer<S>>> chains {};
+		for (int k {0}; k < settings.islands; k++)
+			chains.push_back(make_annealer(start_state.get(), cool_init));
+		IslandAnnealer<S> islands { move(chains),
+				settings.migrate_every, settings.island_lag };
+		result.method = "islands";
+		result.objective = islands.run(settings.num_epochs, settings.vb_every);
+	} else if (settings.memetic > 0) {
+		cout << "Annealing memetically, with a population of "
+				<< settings.memetic << "..." << endl;
+		/* Offspring are already fairly good, so they start cooler, as a
+		 * constructed start does. */
+		auto make_chain = [&] (const S* from) -> unique_ptr<SimAnnealer<S>> {
+			if (not from)
+				return make_annealer(start_state.get(), cool_init);
+			return make_annealer(from, construction::seeded_cool_init(settings,
+					*construction::convert<Schedule, S>(*from, dirdata), dirdata));
+		};
+		MemeticAnnealer<S> memetic { dirdata, without_second_rep, make_chain,
+				settings.memetic, settings.memetic_generations,
+				static_cast<size_t>(settings.run_threads) };
+		result.method = "memetic";
+		result.objective = memetic.run(settings.num_epochs);
+	} else {
+		auto telannealer { make_annealer(start_state.get(), cool_init) };
+		telannealer->set_target(result.greedy_objective);
+		if (scheduler) {
+			cout << "Annealing in time slices of " << settings.time_slice
+					<< " epochs..." << endl;
+			telannealer->begin_run(settings.num_epochs, settings.vb_every);
+			scheduler->add_annealer<S>(move(telannealer), without_second_rep,
+					dirdata->get_num_directions_defined(), settings.num_epochs,
+					[result] (SimAnnealer<S>& annealer) mutable {
+						result.take_run(annealer);
+						ResultsTable {}.append(result);
+					});
+			return;
+		}
+		cout << "Annealing..." << endl;
+		telannealer->run(settings.num_epochs, settings.vb_every);
+		result.take_run(*telannealer);
 	}
+}
+
+/* Anneals with the array schedule, specialised to the instance: 16-bit
+ * ids whenever they fit, and no rep storage at all without the second
+ * rep.
+ */
+template<typename Reps, typename Metric, typename Start>
+void anneal_array(int run_id, shared_ptr<DirectionDatabase> dirdata,
+			bool without_second_rep, const RunSettings& settings,
+			ResultsTable::Row& result, const Start* start_sch, const Metric& metric,
+			ChainScheduler* scheduler) {
+	if (BasicSchedule<uint16_t, Reps, Metric>::fits(*dirdata))
+		anneal<BasicSchedule<uint16_t, Reps, Metric>>(run_id, dirdata,
+					without_second_rep, settings, result, start_sch, metric, scheduler);
+	else
+		anneal<BasicSchedule<dir_id_t, Reps, Metric>>(run_id, dirdata,
+					without_second_rep, settings, result, start_sch, metric, scheduler);
+}
+
+/* The greedy schedule, then whichever solver the settings ask for, all
+ * by the slew-cost metric.  Only the default Chebyshev metric reaches
+ * the constructions, decomposition and the list schedule; main() refuses
+ * settings that combine them with any other.  With a scheduler,
+ * annealing goes on after this returns; see anneal(...).
+ */
+template<typename Metric>
+void solve(int run_id, shared_ptr<DirectionDatabase> dirdata,
+			bool without_second_rep, const RunSettings& settings,
+			const Metric& metric, ChainScheduler* scheduler) {
+	/* The greedy schedule comes first, so annealing may start from it. */
+	cout << "Trying greedy approach..." << endl;
+	TelGreedyFor<Metric> telgreedy { run_id, dirdata, without_second_rep, metric };
+	double greedy_dist { telgreedy.run_and_save() };
+	cout << "Greedy distance: " << greedy_dist << endl;
+	ResultsTable::Row result { run_id, dirdata->get_num_directions_defined(),
+								without_second_rep, settings };
+	result.greedy_objective = greedy_dist;
+	result.greedy_time = telgreedy.get_time_running();
+
+	if constexpr (not std::is_same_v<Metric, metric::Chebyshev>) {
+		auto start_sch { (settings.start == "greedy"
+							? &telgreedy.get_schedule() : nullptr) };
+		if (without_second_rep)
+			anneal_array<SingleRep>(run_id, dirdata, without_second_rep,
+										settings, result, start_sch, metric, scheduler);
+		else
+			anneal_array<DualRep>(run_id, dirdata, without_second_rep,
+										settings, result, start_sch, metric, scheduler);
+	} else {
+		unique_ptr<Schedule> start_sch {};
+		if (settings.start == "greedy") {
+			start_sch = telgreedy.get_schedule().duplicate();
+		} else if (settings.start != "identity") {
+			cout << "Constructing " << settings.start << " schedule..." << endl;
+			TelConstructor telconstructor { run_id, dirdata,
+										without_second_rep, settings };
+			start_sch = telconstructor.run_and_save(settings.start);
+		}
 
-	constexpr int LEN_NUMDIRS_LABEL
-		= string_view("Num directions: ").length();
-	infile.ignore(LEN_NUMDIRS_LABEL);
-	int num_directions;
-	infile >> num_directions;
-
-	auto dirdata = make_shared<DirectionDatabase>(num_directions);
-	for (dir_id_t expected_id { 0 };
-			expected_id < num_directions;
-			expected_id++) {
-		auto d = Direction::read_from(infile);
-		dirdata->place_direction(move(d));
+		if (settings.region_size > 0) {
+			cout << "Annealing by decomposition..." << endl;
+			TelDecomposer teldecomposer { run_id, dirdata,
+										without_second_rep, settings };
+			double decomp_dist { teldecomposer.run_and_save() };
+			cout << "Decomposition distance: " << decomp_dist << endl;
+			result.method = "decompose";
+			result.objective = decomp_dist;
+		} else if (settings.two_level_list)
+			anneal<TwoLevelSchedule>(run_id, dirdata, without_second_rep,
+										settings, result, start_sch.get(), {}, scheduler);
+		else if (without_second_rep)
+			anneal_array<SingleRep>(run_id, dirdata, without_second_rep,
+										settings, result, start_sch.get(), metric, scheduler);
+		else
+			anneal_array<DualRep>(run_id, dirdata, without_second_rep,
+										settings, result, start_sch.get(), metric, scheduler);
 	}
-	infile.close();
-	return dirdata;
+	if (not scheduler)
+		ResultsTable {}.append(result);
+}
+
+/* Calls solve(...) with the metric that settings.metric describes. */
+void solve_by_metric(int run_id, shared_ptr<DirectionDatabase> dirdata,
+			bool without_second_rep, const RunSettings& settings,
+			ChainScheduler* scheduler) {
+	const string& spec { settings.metric };
+	auto kind { spec.substr(0, spec.find(':')) };
+	if (kind == "weighted")
+		solve(run_id, dirdata, without_second_rep, settings,
+				metric::WeightedChebyshev::from_spec(spec), scheduler);
+	else if (kind == "accel")
+		solve(run_id, dirdata, without_second_rep, settings,
+				metric::AccelLimited::from_spec(spec), scheduler);
+	else if (kind == "table")
+		solve(run_id, dirdata, without_second_rep, settings,
+				metric::Table::from_spec(spec), scheduler);
+	else
+		solve(run_id, dirdata, without_second_rep, settings,
+				metric::Chebyshev {}, scheduler);
+}
+
+/* Solves a run id whose Directions are targets on the sky (see Sky.h):
+ * the greedy schedule of the targets as they are at the start, then
+ * annealing of the time spent slewing.
+ */
+void solve_sky(int run_id, shared_ptr<DirectionDatabase> targets,
+			bool without_second_rep, const RunSettings& settings) {
+	auto sky { make_shared<const sky::Sky>(*targets,
+						sky::Site::from_spec(settings.sky)) };
+	auto dirdata { sky->directions_at(0.0) };
+
+	cout << "Trying greedy approach, on the targets at the start..." << endl;
+	TelGreedy telgreedy { run_id, dirdata, without_second_rep };
+	double greedy_dist { telgreedy.run_and_save() };
+	sky::Timeline greedy_times { sky };
+	greedy_times.rebuild(telgreedy.get_schedule());
+	cout << "Greedy distance: " << greedy_dist << ", taking "
+			<< greedy_times.objective() << " s to slew" << endl;
+
+	double cool_init { settings.cool_init };
+	if (settings.start == "greedy")
+		cool_init = construction::seeded_cool_init(settings,
+				telgreedy.get_schedule(), dirdata);
+	unique_ptr<cooling::CoolingFn> coolptr {
+		new cooling::PiecewiseConstGeomCool
+				{ cool_init, settings.cool_base, settings.cool_flat_epochs }
+	};
+	TelSkyAnnealer annealer { run_id, move(coolptr), sky, dirdata,
+								without_second_rep };
+	annealer.set_acceptance(cooling::acceptance_from_name(settings.acceptance),
+							settings.lahc_history);
+	if (settings.start == "greedy")
+		annealer.start_from(telgreedy.get_schedule());
+	annealer.set_target(greedy_times.objective());
+	cout << "Annealing the slew time..." << endl;
+	annealer.run(settings.num_epochs, settings.vb_every);
+
+	/* Objectives in seconds of slewing, the greedy schedule's too. */
+	ResultsTable::Row result { run_id, dirdata->get_num_directions_defined(),
+								without_second_rep, settings };
+	result.method = "sky";
+	result.greedy_objective = greedy_times.objective();
+	result.greedy_time = telgreedy.get_time_running();
+	result.take_run(annealer);
+	ResultsTable {}.append(result);
 }
 
 /* ************************************************** */
 
-int run(int run_id, long run_num_epochs, long vb_every,
-		double cool_init, double cool_base, long cool_flat_epochs) {
+/* The Directions of run_id, renumbered if the settings ask for it. */
+shared_ptr<DirectionDatabase> load_for_run(int run_id, const RunSettings& settings) {
+	auto dirdata { load_directions(run_id) };
+	if (settings.renumber == "curve")
+		dirdata = dirdata->renumbered(construction::curve_order(*dirdata));
+	return dirdata;
+}
+
+/* Solves run_id, both with and without the second rep.  With a
+ * scheduler, their chains are handed over to it; see anneal(...). */
+int run(int run_id, const RunSettings& settings, ChainScheduler* scheduler=nullptr) {
+	TRACE_SPAN_ID("run", run_id);
 	shared_ptr<DirectionDatabase> dirdata;
 	try {
-		dirdata = load_directions(run_id);
+		dirdata = load_for_run(run_id, settings);
 	} catch (exception& e) {
 		cerr << "ERROR: " << e.what() << endl;
 		return -3;
@@ -58,24 +288,27 @@ int run(int run_id, long run_num_epochs, long vb_every,
 		cout.setf(ios_base::boolalpha);
 		cout << "Setup for run id = " << run_id << endl;
 
+		counters::Tally counted_before { counters::thread_tally() };
 		for (int sr {0}; sr < 2; sr++) {
 			bool without_second_rep { (sr == 1) };
 			cout << "Allowing second rep "
 						<< (without_second_rep == false) << endl;
-
-			unique_ptr<cooling::CoolingFn> coolptr {
-				new cooling::PiecewiseConstGeomCool
-						{ cool_init, cool_base, cool_flat_epochs }
-			};
-			TelAnnealer telannealer { run_id, move(coolptr), dirdata,
-										without_second_rep };
-			cout << "Annealing..." << endl;
-			telannealer.run(run_num_epochs, vb_every);
-
-			cout << "Trying greedy approach..." << endl;
-			TelGreedy telgreedy { run_id, dirdata, without_second_rep };
-			double greedy_dist { telgreedy.run_and_save() };
-			cout << "Greedy distance: " << greedy_dist << endl;
+			if (settings.sky.empty())
+				solve_by_metric(run_id, dirdata, without_second_rep, settings, scheduler);
+			else
+				solve_sky(run_id, dirdata, without_second_rep, settings);
+		}
+		if constexpr (counters::COMPILED_IN) {
+			ofstream o { file_writer(get_run_folder(run_id) + "counters.txt") };
+			o << setprecision(4);
+			o << "Run id: " << run_id
+			  << "\nHardware counters of the thread of this run id, per phase,"
+				 " with and without the second rep together."
+			  << "\n(Phases nest; chains on threads of their own, as with"
+				 " --islands or --memetic, or in time slices, are left out.)\n";
+			counters::write_table(o, counters::difference(
+					counters::thread_tally(), counted_before));
+			o.close();
 		}
 	} catch (exception& e) {
 		cerr << "ERROR: " << e.what() << endl;
@@ -85,6 +318,87 @@ int run(int run_id, long run_num_epochs, long vb_every,
 	return 0;
 }
 
+/* Anneals the problems in batches of L, in lock-step; see
+ * LockstepAnnealer.h. */
+template<size_t L, typename C>
+void anneal_lockstep(vector<LockstepProblem>& problems,
+			const RunSettings& settings) {
+	for (size_t first {0}; first < problems.size(); first += L) {
+		size_t last { std::min(first + L, problems.size()) };
+		vector<LockstepProblem> batch {};
+		cout << "Annealing in lock-step:";
+		for (size_t k {first}; k < last; k++) {
+			cout << " " << problems[k].run_id
+					<< (problems[k].without_second_rep ? " (no second rep)" : "");
+			batch.push_back(move(problems[k]));
+		}
+		cout << endl;
+		LockstepAnnealer<L, C> annealer { move(batch), settings.cool_base,
+											settings.cool_flat_epochs };
+		annealer.run(settings.num_epochs, settings.vb_every);
+	}
+}
+
+/* As run(...) for each of run_ids, except that the annealing, with and
+ * without the second rep, goes to the lanes of a LockstepAnnealer:  each
+ * run id is loaded and its greedy schedules found first, and its two
+ * annealing problems then take a lane each.
+ */
+int run_lockstep(const vector<int>& run_ids, const RunSettings& settings) {
+	vector<LockstepProblem> problems {};
+	for (int run_id : run_ids) {
+		TRACE_SPAN_ID("run", run_id);
+		try {
+			auto dirdata { load_for_run(run_id, settings) };
+			cout.setf(ios_base::boolalpha);
+			cout << "Setup for run id = " << run_id << endl;
+			for (int sr {0}; sr < 2; sr++) {
+				bool without_second_rep { (sr == 1) };
+				cout << "Allowing second rep "
+							<< (without_second_rep == false) << endl;
+				cout << "Trying greedy approach..." << endl;
+				TelGreedy telgreedy { run_id, dirdata, without_second_rep };
+				double greedy_dist { telgreedy.run_and_save() };
+				cout << "Greedy distance: " << greedy_dist << endl;
+
+				LockstepProblem problem {
+					run_id, dirdata, without_second_rep, settings.cool_init };
+				if (settings.start == "greedy") {
+					problem.start = telgreedy.get_schedule().duplicate();
+					problem.cool_init = construction::seeded_cool_init(
+											settings, *problem.start, dirdata);
+				}
+				problems.push_back(move(problem));
+			}
+		} catch (exception& e) {
+			cerr << "ERROR: " << e.what() << endl;
+		}
+	}
+
+	/* The coordinates are given by type, as doubles or in fixed point. */
+	auto anneal_lanes = [&] (auto coordinate) {
+		using C = decltype(coordinate);
+		if (settings.lanes == 4)
+			anneal_lockstep<4, C>(problems, settings);
+		else if (settings.lanes == 8)
+			anneal_lockstep<8, C>(problems, settings);
+		else
+			anneal_lockstep<16, C>(problems, settings);
+	};
+	try {
+		if (settings.fixed_point_bits == 32)
+			anneal_lanes(uint32_t {});
+		else if (settings.fixed_point_bits == 16)
+			anneal_lanes(uint16_t {});
+		else
+			anneal_lanes(double {});
+	} catch (exception& e) {
+		cerr << "ERROR: " << e.what() << endl;
+		return -4;
+	}
+	return 0;
+}
+
 /*
  * NOTE:  This is a very simple stand-in for the "jthread" class, as
  * is explained here:
@@ -108,6 +422,169 @@ private:
 	thread t;
 };
 
+/* Throws an error message if settings are out of range or do not go
+ * together. */
+void check_settings(const RunSettings& settings) {
+	if (settings.num_epochs <= 0) {
+		throw runtime_error("Provided number of epochs "
+				+ to_string(settings.num_epochs) + ", however "
+				"this value must be strictly positive.");
+	} else if (settings.vb_every <= 0) {
+		throw runtime_error("Provided verbose frequency "
+				+ to_string(settings.vb_every) + ", however "
+				"this value must be strictly positive.");
+	} else if (settings.cool_init <= 0.0) {
+		throw runtime_error("Provided cooling initial scale "
+				+ to_string(settings.cool_init) + ", however "
+				"this value must be strictly positive.");
+	} else if (settings.cool_base <= 0.0 or settings.cool_base >= 1.0) {
+		throw runtime_error("Provided cooling exponential base "
+				+ to_string(settings.cool_base) + ", however "
+				"this value must be strictly between 0.0 and 1.0.");
+	} else if (settings.cool_flat_epochs <= 0) {
+		throw runtime_error("Provided cooling flat epochs "
+				+ to_string(settings.cool_flat_epochs) + ", however "
+				"this value must be strictly positive.");
+	} else if (settings.region_size > 0 and settings.start != "identity") {
+		throw runtime_error("Option --start=" + settings.start + " cannot"
+				" be combined with --decompose, which builds its own"
+				" schedule region by region.");
+	} else if (settings.metric != "chebyshev"
+			and (settings.region_size > 0 or settings.two_level_list
+				or (settings.start != "identity" and settings.start != "greedy"))) {
+		throw runtime_error("Option --metric=" + settings.metric + " works"
+				" only with the array schedule, starting from the identity"
+				" or greedy schedule.");
+	} else if (settings.lanes > 0
+			and (settings.islands > 1 or settings.region_size > 0
+				or settings.two_level_list or settings.metric != "chebyshev"
+				or settings.rejection_free_below > 0.0
+				or settings.acceptance != "metropolis"
+				or (settings.start != "identity" and settings.start != "greedy"))) {
+		throw runtime_error("Option --lanes works only with the array"
+				" schedule and the chebyshev metric, starting from the"
+				" identity or greedy schedule, without islands,"
+				" rejection-free annealing or other acceptance rules.");
+	} else if (settings.memetic > 0
+			and (settings.islands > 1 or settings.region_size > 0
+				or settings.lanes > 0 or settings.metric != "chebyshev")) {
+		throw runtime_error("Option --memetic works only with the chebyshev"
+				" metric, without islands, decomposition or lanes.");
+	} else if (not settings.sky.empty()
+			and (settings.islands > 1 or settings.region_size > 0
+				or settings.two_level_list or settings.metric != "chebyshev"
+				or settings.lanes > 0 or settings.memetic > 0
+				or (settings.start != "identity" and settings.start != "greedy"))) {
+		throw runtime_error("Option --sky works only with the array schedule"
+				" and the chebyshev metric, starting from the identity or"
+				" greedy schedule, without islands, decomposition, lanes or"
+				" memetic annealing.");
+	} else if (settings.fixed_point_bits > 0 and settings.lanes == 0) {
+		throw runtime_error("Option --fixed-point works only with --lanes.");
+	} else if (settings.time_slice > 0
+			and (settings.islands > 1 or settings.memetic > 0
+				or settings.region_size > 0 or settings.lanes > 0
+				or not settings.sky.empty())) {
+		throw runtime_error("Option --time-slice works only without islands,"
+				" memetic annealing, decomposition, lanes or the sky.");
+	}
+	if (not settings.sky.empty())
+		sky::Site::from_spec(settings.sky);
+}
+
+/* The settings that a run id was queued with (see WorkQueue.h):
+ * positional arguments 2-6 of the command line, then any options. */
+RunSettings read_queued_settings(const string& args) {
+	stringstream ss { args };
+	vector<string> items {};
+	string item {};
+	while (ss >> item)
+		items.push_back(item);
+	if (items.size() < 5)
+		throw runtime_error("Queued arguments \"" + args + "\" are too few.");
+	RunSettings settings {};
+	settings.num_epochs       = stol(strip_underscores(items[0]));
+	settings.vb_every         = stol(strip_underscores(items[1]));
+	settings.cool_init        = stod(strip_underscores(items[2]));
+	settings.cool_base        = stod(strip_underscores(items[3]));
+	settings.cool_flat_epochs = stol(strip_underscores(items[4]));
+	for (size_t k {5}; k < items.size(); k++)
+		apply_option(settings, items[k]);
+	check_settings(settings);
+	if (settings.lanes > 0 or settings.time_slice > 0)
+		throw runtime_error("Options --lanes and --time-slice do not apply to queued runs.");
+	return settings;
+}
+
+/* Works through the run ids of the queue file on num_workers threads;
+ * see WorkQueue.h.  Each run's files are written under a staging folder
+ * of the worker's own, output/.staging/HOST:PID-K/, and moved to
+ * output/run-<id>/ once the run has finished, so that a run folder
+ * appears whole or not at all.  A run id whose folder is already there
+ * is not run again.  The staging folders of a process that died are
+ * deleted once another process puts its claims back in the queue.
+ */
+int run_queue(const string& queue_file, size_t num_workers) {
+	WorkQueue queue { queue_file, OUTPUT_FOLDER + ".staging" };
+	cout << "Working through the queue " << queue_file << " as "
+			<< WorkQueue::this_owner() << ", with " << num_workers
+			<< " workers" << endl;
+	{
+		vector<thread_manager> workers {};
+		workers.reserve(num_workers);
+		for (size_t k {0}; k < num_workers; k++) {
+			workers.push_back(thread_manager { [&queue, k] () {
+				TRACE_THREAD_NAME("worker " + to_string(k));
+				string staging_root { OUTPUT_FOLDER + ".staging/"
+						+ WorkQueue::this_owner() + "-" + to_string(k) + "/" };
+				set_run_folder_root(staging_root);
+				while (true) {
+					std::optional<WorkQueue::Claim> claim {};
+					try {
+						claim = queue.claim();
+					} catch (exception& e) {
+						cerr << "ERROR: " << e.what() << endl;
+						break;
+					}
+					if (not claim)
+						break;
+					int run_id { claim->run_id };
+					filesystem::path staged { filesystem::path { get_run_folder(run_id) }.parent_path() };
+					filesystem::path final { OUTPUT_FOLDER + "run-" + to_string(run_id) };
+					bool succeeded {false};
+					try {
+						if (filesystem::exists(final)) {
+							cout << "Run id " << run_id << " is already done." << endl;
+							succeeded = true;
+						} else {
+							RunSettings settings { read_queued_settings(claim->args) };
+							filesystem::remove_all(staged);
+							succeeded = (run(run_id, settings) == 0);
+							if (succeeded)
+								filesystem::rename(staged, final);
+						}
+					} catch (exception& e) {
+						cerr << "ERROR: Run id " << run_id << ": " << e.what() << endl;
+						succeeded = false;
+					}
+					try {
+						queue.finish(run_id, succeeded);
+					} catch (exception& e) {
+						cerr << "ERROR: " << e.what() << endl;
+						break;
+					}
+				}
+				std::error_code ignored {};
+				filesystem::remove_all(staging_root, ignored);
+			} });
+		}
+	}
+	/* The workers have all been joined by now. */
+	std::error_code ignored {};
+	filesystem::remove(OUTPUT_FOLDER + ".staging", ignored);
+	return 0;
+}
+
 /* ************************************************** */
 
 int main(int argc, char** argv) {
@@ -116,7 +593,175 @@ int main(int argc, char** argv) {
 			throw runtime_error("Program interrupted.");
 		});
 
-	if (argc < 8) {
+	/* Options of the form --name=value may appear anywhere; everything
+	 * else is a positional argument, in the order listed below.
+	 */
+	vector<string> positional {};
+	vector<string> options {};
+	for (int i {1}; i < argc; i++) {
+		string arg { argv[i] };
+		if (is_option(arg))
+			options.push_back(arg);
+		else
+			positional.push_back(arg);
+	}
+
+	/* In service mode, --serve=stdio or --serve=SOCKET_PATH, problems
+	 * arrive through the service rather than as positional arguments; see
+	 * SolverDaemon.h.  The other options then give defaults for every
+	 * problem, and --workers the number of problems solved at once.
+	 */
+	if (auto serve { std::find_if(options.begin(), options.end(),
+				[] (auto& opt) { return opt.rfind("--serve=", 0) == 0; }) };
+			serve != options.end()) {
+		try {
+			string serve_on { serve->substr(string_view("--serve=").length()) };
+			size_t workers { std::max(1u, std::thread::hardware_concurrency()) };
+			RunSettings defaults {};
+			for (auto& opt : options) {
+				if (opt.rfind("--serve=", 0) == 0)
+					continue;
+				else if (opt.rfind("--workers=", 0) == 0) {
+					string value { opt.substr(string_view("--workers=").length()) };
+					wrap_regex_match(value, "[1-9][0-9]*",
+							"Option --workers must be a positive integer.");
+					workers = stoul(value);
+				} else
+					apply_option(defaults, opt);
+			}
+			{
+				SolverDaemon daemon { workers, defaults };
+				if (serve_on == "stdio")
+					daemon.serve_stdio();
+				else
+					daemon.serve_socket(serve_on);
+			}
+			TRACE_WRITE(OUTPUT_FOLDER + "trace.json");
+		} catch (exception& e) {
+			cerr << "ERROR: " << e.what() << endl;
+			return -5;
+		}
+		return 0;
+	}
+
+	/* In benchmark mode, --bench=FOLDER, every solver configuration of
+	 * the benchmark folder runs on its corpus; see Benchmark.h.  The
+	 * options --repeats, --target and --baseline set the runs per
+	 * configuration and instance, the target gap to the reference
+	 * objective, and the summary to compare against.
+	 */
+	if (auto bench { std::find_if(options.begin(), options.end(),
+				[] (auto& opt) { return opt.rfind("--bench=", 0) == 0; }) };
+			bench != options.end()) {
+		int regressions {0};
+		try {
+			string folder { bench->substr(string_view("--bench=").length()) };
+			int repeats {5};
+			double target_gap {0.03};
+			string baseline { folder + "/baseline.csv" };
+			for (auto& opt : options) {
+				auto match = wrap_regex_match(opt, "--([a-z\\-]+)=(.*)",
+						"Options must look like --name=value, but found \"" + opt + "\"");
+				string name { match[1] }, value { match[2] };
+				if (name == "bench")
+					continue;
+				else if (name == "repeats") {
+					wrap_regex_match(value, "[1-9][0-9]*",
+							"Option --repeats must be a positive integer.");
+					repeats = stoi(value);
+				} else if (name == "target") {
+					wrap_regex_match(value, "(0|([1-9][0-9]*))(.[0-9]*)?",
+							"Option --target must be a decimal.");
+					target_gap = stod(value);
+				} else if (name == "baseline")
+					baseline = value;
+				else
+					throw runtime_error("Option " + opt + " does not apply to"
+							" benchmarks; set options per configuration in"
+							" configs.csv instead.");
+			}
+			Benchmark benchmark { folder, repeats, target_gap };
+			regressions = benchmark.run(baseline);
+		} catch (exception& e) {
+			cerr << "ERROR: " << e.what() << endl;
+			return -6;
+		}
+		return (regressions > 0 ? -7 : 0);
+	}
+
+	/* In tuning mode, --tune=FILE, the cooling settings of each group of
+	 * instances in FILE are tuned by successive halving; see Tuner.h.
+	 * The options --workers and --samples set the number of threads and
+	 * the number of configurations drawn at random from each grid (by
+	 * default, the whole grid).
+	 */
+	if (auto tune { std::find_if(options.begin(), options.end(),
+				[] (auto& opt) { return opt.rfind("--tune=", 0) == 0; }) };
+			tune != options.end()) {
+		try {
+			string tuning_file { tune->substr(string_view("--tune=").length()) };
+			size_t workers { std::max(1u, std::thread::hardware_concurrency()) };
+			size_t samples {0};
+			for (auto& opt : options) {
+				auto match = wrap_regex_match(opt, "--([a-z\\-]+)=(.*)",
+						"Options must look like --name=value, but found \"" + opt + "\"");
+				string name { match[1] }, value { match[2] };
+				if (name == "tune")
+					continue;
+				else if (name == "workers" or name == "samples") {
+					wrap_regex_match(value, "[1-9][0-9]*",
+							"Option --" + name + " must be a positive integer.");
+					(name == "workers" ? workers : samples) = stoul(value);
+				} else
+					throw runtime_error("Option " + opt + " does not apply to"
+							" tuning; the tuning file gives the settings to try.");
+			}
+			Tuner tuner { tuning_file, workers, samples };
+			tuner.run();
+		} catch (exception& e) {
+			cerr << "ERROR: " << e.what() << endl;
+			return -8;
+		}
+		return 0;
+	}
+
+	/* A queue file shared by several processes, --queue=FILE; see
+	 * WorkQueue.h.  With no positional arguments, the process only works
+	 * through the run ids already queued, on --workers threads.  With
+	 * them, it first adds its run ids to the queue, to run with its
+	 * settings, and then works through the queue on its threads.
+	 */
+	string queue_file {};
+	if (auto queue { std::find_if(options.begin(), options.end(),
+				[] (auto& opt) { return opt.rfind("--queue=", 0) == 0; }) };
+			queue != options.end()) {
+		queue_file = queue->substr(string_view("--queue=").length());
+		if (positional.empty()) {
+			try {
+				size_t workers { std::max(1u, std::thread::hardware_concurrency()) };
+				for (auto& opt : options) {
+					if (opt.rfind("--queue=", 0) == 0)
+						continue;
+					else if (opt.rfind("--workers=", 0) == 0) {
+						string value { opt.substr(string_view("--workers=").length()) };
+						wrap_regex_match(value, "[1-9][0-9]*",
+								"Option --workers must be a positive integer.");
+						workers = stoul(value);
+					} else
+						throw runtime_error("Option " + opt + " does not apply to"
+								" a worker; each queued run id has its own settings.");
+				}
+				run_queue(queue_file, workers);
+				TRACE_WRITE(OUTPUT_FOLDER + "trace.json");
+			} catch (exception& e) {
+				cerr << "ERROR: " << e.what() << endl;
+				return -9;
+			}
+			return 0;
+		}
+	}
+
+	if (positional.size() < 7) {
 		cerr << "Wrong number of command line arguments provided."
 				" Must specify, in order:\n"
 				"  1. number of threads to use\n"
@@ -125,31 +770,26 @@ int main(int argc, char** argv) {
 				"  4. cooling initial scale (strictly positive) \n"
 				"  5. cooling exponential base (strictly between 0 and 1) \n"
 				"  6. flat cooling exponential scale (strictly positive)\n"
-				"  7. run id, or a list of ids"
+				"  7. run id, or a list of ids\n"
+				<< describe_options()
 				<< endl;
 		return -1;
 	}
 	int NUM_THREADS;
-	long run_num_epochs;
-	long vb_every;
-
-	double cool_init;
-	double cool_base;
-	long cool_flat_epochs;
+	RunSettings settings {};
 
 	vector<int> run_id_list {};
 
 	try {
 		vector<string> params {};
-		for (int i {1}; i < argc; i++) {
-			/* Do nothing with parameter i=0, which is the program name.
-			 * For every other parameter, allow underscores so numbers are easy
+		for (size_t i {1}; i <= positional.size(); i++) {
+			/* For every parameter, allow underscores so numbers are easy
 			 * to read (e.g., 1_000_000 instead of 1000000).  These need to be
 			 * removed.  After removing them, however, remember to erase
 			 * the extra space at the end!  (Refer to the discussion on
 			 * pp. 604-605 in Lospinoso's "C++ Crash Course".)
 			 */
-			string param { argv[i] };
+			string param { positional[i-1] };
 			auto s_orig_end { param.end() };
 			auto s_new_end { std::remove(param.begin(), s_orig_end, '_') };
 			param.erase(s_new_end, s_orig_end);
@@ -171,57 +811,74 @@ int main(int argc, char** argv) {
 			 * ensures the parameter actually had the correct form. */
 			params.push_back(param);
 		}
-		NUM_THREADS    = { stoi(params[0]) };
-		run_num_epochs = { stol(params[1]) };
-		vb_every       = { stol(params[2]) };
+		NUM_THREADS          = { stoi(params[0]) };
+		settings.num_epochs  = { stol(params[1]) };
+		settings.vb_every    = { stol(params[2]) };
 
-		cool_init        = { stod(params[3]) };
-		cool_base        = { stod(params[4]) };
-		cool_flat_epochs = { stol(params[5]) };
+		settings.cool_init        = { stod(params[3]) };
+		settings.cool_base        = { stod(params[4]) };
+		settings.cool_flat_epochs = { stol(params[5]) };
 
 		for (size_t idx {6}; idx < params.size(); idx++) {
 			run_id_list.push_back(stoi(params[idx]));
 		}
 
+		for (auto& opt : options) {
+			if (opt.rfind("--queue=", 0) != 0)
+				apply_option(settings, opt);
+		}
+
 		// Do some routine input verification.
-		if (NUM_THREADS <= 0) {
-			throw runtime_error("Provided number of threads "
-					+ to_string(NUM_THREADS) + ", however "
-					"this value must be strictly positive.");
-		} else if (auto hc {std::thread::hardware_concurrency()};
+		if (auto hc {std::thread::hardware_concurrency()};
 					hc > 0 and NUM_THREADS >= hc) {
+			/* Only a warning, so it must not skip the checks below. */
 			cerr << "Warning: Specified "
 					<< NUM_THREADS
 					<< " threads, but runtime says only "
 					<< hc
 					<< " might be available."
 					<< endl;
-		} else if (run_num_epochs <= 0) {
-			throw runtime_error("Provided number of epochs "
-					+ to_string(run_num_epochs) + ", however "
-					"this value must be strictly positive.");
-		} else if (vb_every <= 0) {
-			throw runtime_error("Provided verbose frequency "
-					+ to_string(vb_every) + ", however "
-					"this value must be strictly positive.");
-		} else if (cool_init <= 0.0) {
-			throw runtime_error("Provided cooling initial scale "
-					+ to_string(cool_init) + ", however "
-					"this value must be strictly positive.");
-		} else if (cool_base <= 0.0 or cool_base >= 1.0) {
-			throw runtime_error("Provided cooling exponential base "
-					+ to_string(cool_base) + ", however "
-					"this value must be strictly between 0.0 and 1.0.");
-		} else if (cool_flat_epochs <= 0) {
-			throw runtime_error("Provided cooling flat epochs "
-					+ to_string(cool_flat_epochs) + ", however "
+		}
+		if (NUM_THREADS <= 0) {
+			throw runtime_error("Provided number of threads "
+					+ to_string(NUM_THREADS) + ", however "
 					"this value must be strictly positive.");
 		}
+		check_settings(settings);
+		if (not queue_file.empty() and (settings.lanes > 0 or settings.time_slice > 0))
+			throw runtime_error("Options --lanes and --time-slice cannot be"
+					" combined with --queue.");
 	} catch (exception& e) {
 		cerr << "ERROR: " << e.what() << endl;
 		return -2;
 	};
 
+	if (not queue_file.empty()) {
+		try {
+			/* Positional arguments 2-6, without underscores, then the
+			 * options, as read_queued_settings(...) expects them. */
+			string args {};
+			for (size_t k {1}; k < 6; k++)
+				args += strip_underscores(positional[k]) + " ";
+			for (auto& opt : options) {
+				if (opt.rfind("--queue=", 0) == 0)
+					continue;
+				if (opt.find_first_of(" \t") != string::npos)
+					throw runtime_error("Option " + opt + " cannot be queued, as it has spaces.");
+				args += opt + " ";
+			}
+			args.pop_back();
+			WorkQueue queue { queue_file };
+			queue.enqueue(run_id_list, args);
+			run_queue(queue_file, NUM_THREADS);
+			TRACE_WRITE(OUTPUT_FOLDER + "trace.json");
+		} catch (exception& e) {
+			cerr << "ERROR: " << e.what() << endl;
+			return -9;
+		}
+		return 0;
+	}
+
 	/* Figure out how many run ids will be computed on
 	 * each thread.
 	 */
@@ -231,26 +888,77 @@ int main(int argc, char** argv) {
 		num_ids += (NUM_THREADS - remainder);
 	}
 	size_t ids_per_thread { num_ids / NUM_THREADS };
+
+	/* Each worker pins itself before loading anything, so that its data
+	 * is allocated on its own node; see Affinity.h. */
+	CpuTopology topology { CpuTopology::detect() };
+	size_t cpus_per_worker { static_cast<size_t>(std::max(settings.islands, settings.run_threads)) };
+	if (settings.pin != "none")
+		cout << "Pinning workers by " << settings.pin << ", on "
+				<< topology.describe() << endl;
+	auto start_worker = [&topology, &settings, cpus_per_worker] (size_t i) {
+		TRACE_THREAD_NAME("worker " + to_string(i));
+		try {
+			if (auto cpus { pin_worker(topology, settings.pin, i, cpus_per_worker) };
+					not cpus.empty())
+				cout << "Worker " << i << " pinned to " << cpus << endl;
+		} catch (exception& e) {
+			cerr << "Warning: " << e.what() << endl;
+		}
+	};
+
+	/* With time slices, the workers share every run id's chains instead
+	 * of each taking its own run ids; see ChainScheduler.h. */
+	if (settings.time_slice > 0) {
+		try {
+			ChainScheduler scheduler { static_cast<size_t>(NUM_THREADS),
+					settings.time_slice,
+					ChainScheduler::share_from_name(settings.slice_share),
+					start_worker };
+			for (int run_id : run_id_list) {
+				scheduler.add_setup([&settings, &scheduler, run_id] () {
+					run(run_id, settings, &scheduler);
+				});
+			}
+			scheduler.wait();
+		} catch (exception& e) {
+			cerr << e.what() << endl;
+		}
+		TRACE_WRITE(OUTPUT_FOLDER + "trace.json");
+		return 0;
+	}
+
 	try {
 		vector<thread_manager> all_threads;
 		all_threads.reserve(NUM_THREADS);
 
 		for (size_t i {0}; i < NUM_THREADS; i++) {
-			auto start {ids_per_thread *  i };
+			/* With the count rounded up, the last chunks may run past the
+			 * end of the list, or be empty. */
+			auto start { std::min(ids_per_thread * i, run_id_list.size()) };
 			auto end   { i == NUM_THREADS - 1 ?
 							run_id_list.size()
-						 :	ids_per_thread * (i+1) };
+						 :	std::min(ids_per_thread * (i+1), run_id_list.size()) };
+			if (start >= end)
+				continue;
 
 			all_threads.push_back(thread_manager { [=]() {
+				start_worker(i);
+				if (settings.lanes > 0) {
+					run_lockstep(vector<int>(run_id_list.begin() + start,
+										run_id_list.begin() + end), settings);
+					return;
+				}
 				for (size_t idx {start}; idx < end; idx++) {
 					auto run_id {run_id_list[idx]};
-					run(run_id, run_num_epochs, vb_every,
-							cool_init, cool_base, cool_flat_epochs);
+					run(run_id, settings);
 				}
 			} });
 		}
 	} catch (exception& e) {
 		cerr << e.what() << endl;
 	}
+	/* The workers have all been joined by now. */
+	TRACE_WRITE(OUTPUT_FOLDER + "trace.json");
 	return 0;
 }
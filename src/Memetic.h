@@ -0,0 +1,323 @@
+#pragma once
+
+#include "includes.h"
+
+#include <functional>
+
+#include "NeighbourGrid.h"
+#include "SimAnneal.h"
+#include "TelConstructor.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+/* ************************************************** *
+ * Memetic annealing:  a population of schedules, each annealed on its
+ * own, is recombined generation after generation.  Every offspring of
+ * two parents is built by a crossover that keeps the edges the parents
+ * share, and is then improved by a short burst of annealing of its own.
+ * Good stretches found by different chains thus end up in one schedule,
+ * which on large instances gets further per CPU-hour than annealing more
+ * independent chains (see --islands for chains that share whole states).
+ */
+
+namespace memetic {
+
+	/* The order of an offspring of schedules a and b, by greedy edge
+	 * recombination.  From Direction 0, the offspring repeatedly takes
+	 * an edge of either parent to an unvisited Direction:  one that both
+	 * parents have if there is one, and otherwise the shortest.  Where
+	 * neither parent offers an edge, it goes to the nearest unvisited
+	 * rep instead.
+	 *
+	 * Edges know about reps.  Switching the reps of both ends of an edge
+	 * leaves its length unchanged (see greedy_edge(...) in
+	 * TelConstructor.h), so an edge is a pair of Directions together with
+	 * whether their reps differ, and two parents only share an edge if
+	 * they agree on that as well.  Once the order is set, the reps are
+	 * chosen afresh by construction::best_reps(...), which can only
+	 * shorten the schedule that the edges taken describe.
+	 *
+	 * This is a simpler relative of edge assembly and partition
+	 * crossover, for which see Y. Nagata and S. Kobayashi, "A powerful
+	 * genetic algorithm using edge assembly crossover for the traveling
+	 * salesman problem", INFORMS J. Computing 25 (2013), and D. Whitley,
+	 * D. Hains and A. Howe, "Tunneling between optima: partition
+	 * crossover for the traveling salesman problem", GECCO 2009.
+	 */
+	template<typename S>
+	unique_ptr<S> crossover(const S& a, const S& b,
+			shared_ptr<DirectionDatabase> dirdata, bool without_second_rep) {
+		size_t num_dir { dirdata->get_num_directions_defined() };
+		const dir_id_t NONE { static_cast<dir_id_t>(num_dir) };
+
+		/* links[4x + 2p + s] is the Direction before (s = 0) or after
+		 * (s = 1) Direction x in parent p, and whether their reps differ. */
+		struct Link {
+			dir_id_t id;
+			bool parity;
+		};
+		vector<Link> links(4 * num_dir, Link { NONE, false });
+		auto record = [&] (const S& sch, int p) {
+			for (size_t k {0}; k + 1 < num_dir; k++) {
+				dir_id_t x { sch.get_id_at(k) };
+				dir_id_t y { sch.get_id_at(k+1) };
+				bool parity { sch.is_other_at(k) != sch.is_other_at(k+1) };
+				links[4 * x + 2 * p + 1] = { y, parity };
+				links[4 * y + 2 * p + 0] = { x, parity };
+			}
+		};
+		record(a, 0);
+		record(b, 1);
+		auto in_parent = [&] (dir_id_t x, const Link& l, int p) {
+			for (int s {0}; s < 2; s++) {
+				const Link& m { links[4 * x + 2 * p + s] };
+				if (m.id == l.id and m.parity == l.parity)
+					return true;
+			}
+			return false;
+		};
+
+		NeighbourGrid grid { dirdata, without_second_rep };
+		vector<bool> visited(num_dir, false);
+		vector<dir_id_t> order { 0 };
+		order.reserve(num_dir);
+		visited[0] = true;
+		grid.remove_direction(0);
+		dir_id_t x {0};
+		bool rep {false};
+		while (order.size() < num_dir) {
+			const Direction& here { dirdata->get_direction(x, rep) };
+			Link next { NONE, false };
+			bool next_shared {false};
+			double next_dist { numeric_limits<double>::infinity() };
+			for (int p {0}; p < 2; p++) {
+				for (int s {0}; s < 2; s++) {
+					const Link& l { links[4 * x + 2 * p + s] };
+					if (l.id == NONE or visited[l.id])
+						continue;
+					bool shared { in_parent(x, l, 1 - p) };
+					double dist { here.dist_to(dirdata->get_direction(l.id, rep != l.parity)) };
+					if ((shared and not next_shared)
+							or (shared == next_shared and dist < next_dist)) {
+						next = l;
+						next_shared = shared;
+						next_dist = dist;
+					}
+				}
+			}
+			if (next.id == NONE) {
+				auto [dist, p] = grid.nearest(here, 1, NONE).front();
+				next = { p.id, p.othr != rep };
+			}
+			x = next.id;
+			rep = (rep != next.parity);
+			visited[x] = true;
+			grid.remove_direction(x);
+			order.push_back(x);
+		}
+
+		vector<bool> reps { construction::best_reps(*dirdata, order, without_second_rep) };
+		return make_unique<S>(move(order), move(reps), dirdata);
+	}
+
+} // namespace memetic
+
+/* ************************************************** */
+
+template<typename S>
+class MemeticAnnealer {
+/* Explanation of the parameters:
+ *
+ * - make_chain(start) gives a new annealer for the problem, starting
+ *   from start, or from the usual start of the run if start is null.
+ *   It is called from several threads at once.
+ *
+ * - population is how many schedules are kept.  The first generation
+ *   anneals that many chains from the usual start, each drawing from
+ *   its own random stream; every later generation breeds as many
+ *   offspring, and the best of parents and offspring together survive.
+ *
+ * - generations is how many generations of offspring are bred.
+ *
+ * - num_threads is how many chains anneal at once.  Which chain draws
+ *   which random stream is fixed beforehand, so the result does not
+ *   depend on it.
+ */
+public:
+	using ChainMaker = std::function<unique_ptr<SimAnnealer<S>>(const S*)>;
+
+	MemeticAnnealer(shared_ptr<DirectionDatabase> dirdata,
+					bool without_second_rep,
+					ChainMaker make_chain,
+					size_t population,
+					int generations,
+					size_t num_threads) :
+		dirdatabase {dirdata},
+		without_second_rep {without_second_rep},
+		make_chain {move(make_chain)},
+		population_size {std::max<size_t>(2, population)},
+		generations {generations},
+		num_threads {std::max<size_t>(1, num_threads)} {}
+	~MemeticAnnealer() = default;
+	MemeticAnnealer(MemeticAnnealer&)  = delete;
+	MemeticAnnealer(MemeticAnnealer&&) = delete;
+
+	/* Anneals every member of the first generation and every offspring
+	 * for burst_epochs epochs, then saves the single best state and a
+	 * log of the generations where a single chain would have saved its
+	 * own.  Returns the best objective.
+	 */
+	double run(unsigned long burst_epochs, const double SAVE_TOLERANCE=0.1) {
+		TRACE_SPAN("memetic: run");
+		auto start { chrono::high_resolution_clock::now() };
+		ThreadPool pool { num_threads };
+		int next_chain {0};
+
+		/* ----------------------------------------
+		 * The first generation.
+		 */
+		{
+			vector<future<Member>> bred {};
+			for (size_t k {0}; k < population_size; k++) {
+				bred.push_back(pool.submit([=] () {
+					return anneal(nullptr, next_chain + k, burst_epochs, SAVE_TOLERANCE);
+				}));
+			}
+			next_chain += population_size;
+			for (auto& b : bred)
+				population.push_back(b.get());
+		}
+		unsigned long epochs_run { population_size * burst_epochs };
+		survive();
+		log_generation(0, epochs_run, chrono::high_resolution_clock::now() - start);
+
+		/* ----------------------------------------
+		 * Later generations.  The parents of every offspring are drawn
+		 * here, on one thread, each the better of two members drawn at
+		 * random.
+		 */
+		std::mt19937_64 rand { static_cast<uint64_t>(
+				2 * population.front().chain->get_run_id() + without_second_rep) };
+		std::uniform_int_distribution<size_t> pick { 0, population_size - 1 };
+		auto tournament = [&] () {
+			size_t i { pick(rand) }, j { pick(rand) };
+			return std::min(i, j);  // the population is sorted, best first
+		};
+		for (int g {1}; g <= generations; g++) {
+			vector<future<Member>> bred {};
+			for (size_t k {0}; k < population_size; k++) {
+				size_t i { tournament() }, j { tournament() };
+				while (j == i)
+					j = pick(rand);
+				const S* a { &population[i].chain->get_best_state() };
+				const S* b { &population[j].chain->get_best_state() };
+				bred.push_back(pool.submit([=] () {
+					auto child { memetic::crossover(*a, *b, dirdatabase, without_second_rep) };
+					return anneal(child.get(), next_chain + k, burst_epochs, SAVE_TOLERANCE);
+				}));
+			}
+			next_chain += population_size;
+			for (auto& b : bred)
+				population.push_back(b.get());
+			epochs_run += population_size * burst_epochs;
+			survive();
+			log_generation(g, epochs_run, chrono::high_resolution_clock::now() - start);
+		}
+
+		auto& winner { *population.front().chain };
+		int run_id { winner.get_run_id() };
+		winner.save_best_state(winner.get_annealing_filename_for_epoch(run_id, epochs_run));
+		save_log(winner.get_annealing_filename_for_full_log(run_id));
+		return winner.get_obj_best();
+	}
+
+private:
+	struct Member {
+		double objective;
+		unique_ptr<SimAnnealer<S>> chain;
+	};
+
+	struct LogRow {
+		int generation;
+		unsigned long epochs_run;
+		double obj_mean;
+		double obj_best;
+		nanos wall_time_ns;
+	};
+
+	Member anneal(const S* from, int chain_index, unsigned long burst_epochs,
+				const double SAVE_TOLERANCE) {
+		TRACE_SPAN_ID("memetic: burst", chain_index);
+		auto chain { make_chain(from) };
+		chain->set_chain_index(chain_index);
+		chain->set_file_output(false);
+		chain->begin_run(burst_epochs, 0, SAVE_TOLERANCE);
+		chain->advance(burst_epochs);
+		chain->finish_run();
+		return Member { chain->get_obj_best(), move(chain) };
+	}
+
+	/* Keeps the best population_size members, best first.  Members whose
+	 * objective equals a better one's are most likely the same schedule,
+	 * and only survive if there are too few others. */
+	void survive() {
+		std::stable_sort(population.begin(), population.end(),
+				[] (auto& m1, auto& m2) { return m1.objective < m2.objective; });
+		vector<Member> distinct {}, repeats {};
+		for (auto& m : population) {
+			if (not distinct.empty() and m.objective
+					<= distinct.back().objective * (1.0 + SAME_OBJECTIVE))
+				repeats.push_back(move(m));
+			else
+				distinct.push_back(move(m));
+		}
+		for (size_t k {0}; distinct.size() < population_size and k < repeats.size(); k++)
+			distinct.push_back(move(repeats[k]));
+		distinct.resize(std::min(distinct.size(), population_size));
+		population = move(distinct);
+	}
+
+	void log_generation(int generation, unsigned long epochs_run, nanos elapsed) {
+		double sum {0.0};
+		for (auto& m : population)
+			sum += m.objective;
+		LogRow row { generation, epochs_run, sum / population.size(),
+					 population.front().objective, elapsed };
+		cout << "Generation " << generation << ": best " << row.obj_best
+				<< ", mean " << row.obj_mean << " after " << epochs_run
+				<< " epochs" << endl;
+		log_rows.push_back(row);
+	}
+
+	void save_log(string filename) {
+		/* As the log of a single run, the epochs counting those of every
+		 * chain and the current objective being the population's mean. */
+		ofstream o { file_writer(filename) };
+		o << setprecision(10);
+		o << "Run id: " << population.front().chain->get_run_id()
+		  << "\nBest objective (over a population of " << population_size
+		  << ") listed after each generation below."
+		  << "\n(Current objective is the mean over the population.)"
+		  << "\nEpoch, Current Objective, Best Objective, Wall Time (ns), Generation\n";
+		for (auto& row : log_rows) {
+			o << row.epochs_run << ", "
+			  << row.obj_mean << ", "
+			  << row.obj_best << ", "
+			  << row.wall_time_ns.count() << ", "
+			  << row.generation << "\n";
+		}
+		o.close();
+	}
+
+	static constexpr double SAME_OBJECTIVE { 1e-12 };
+
+	shared_ptr<DirectionDatabase> dirdatabase;
+	bool without_second_rep;
+	ChainMaker make_chain;
+	size_t population_size;
+	int generations;
+	size_t num_threads;
+
+	vector<Member> population {};
+	vector<LogRow> log_rows {};
+};
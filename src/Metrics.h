@@ -0,0 +1,164 @@
+#pragma once
+
+#include "includes.h"
+#include "Direction.h"
+
+/* ************************************************** *
+ * Slew-cost metrics.  Each is a small class whose operator()(d1, d2)
+ * gives the cost of moving the telescope from d1 to d2, and it is
+ * passed around as a template parameter (see BasicSchedule in
+ * Schedule.h and TelGreedyFor in TelGreedy.h), so that computing a cost
+ * in the inner loops is an inlined call rather than a virtual one.
+ *
+ * The annealer's moves rely on two facts about every metric here:  it
+ * is symmetric, and it depends only on how far each axis turns, i.e. on
+ * the wrapped theta difference and the absolute phi difference.  Then
+ * switching both reps of a pair of Directions leaves their cost
+ * unchanged; see reversal_delta(...) in ScheduleMoves.h.  A new metric
+ * must keep to this.
+ *
+ * Each metric other than Chebyshev is configured from a specification
+ * string, as given to the --metric option.
+ */
+namespace metric {
+
+	struct AxisMoves {
+		double theta, phi;
+	};
+
+	inline AxisMoves axis_moves(const Direction& d1, const Direction& d2) {
+		double dtheta { std::abs(d1.get_theta() - d2.get_theta()) };
+		if (dtheta > PI)
+			dtheta = TWO_PI - dtheta;
+		return { dtheta, std::abs(d1.get_phi() - d2.get_phi()) };
+	}
+
+	/* Reads the comma-separated decimals after "name:" in spec.  The
+	 * first num_positive must be positive, and any after them at least
+	 * 0. */
+	inline vector<double> read_parameters(const string& spec, size_t count,
+			size_t num_positive) {
+		vector<double> params {};
+		stringstream ss { spec.substr(spec.find(':') + 1) };
+		string item {};
+		while (getline(ss, item, ','))
+			params.push_back(stod(item));
+		if (params.size() != count) {
+			throw runtime_error("Metric \"" + spec + "\" needs "
+					+ to_string(count) + " parameters.");
+		}
+		for (size_t k {0}; k < count; k++) {
+			if (k < num_positive ? not (params[k] > 0.0) : not (params[k] >= 0.0)) {
+				throw runtime_error("Metric \"" + spec + "\" needs parameter "
+						+ to_string(k + 1) + (k < num_positive ? " to be positive."
+												: " to be at least 0."));
+			}
+		}
+		return params;
+	}
+
+	/* Both axes turn at the same rate, at the same time:  the original
+	 * distance, as in Direction::dist_between(...) and the README. */
+	struct Chebyshev {
+		double operator()(const Direction& d1, const Direction& d2) const {
+			return Direction::dist_between(d1, d2);
+		}
+	};
+
+	/* Each axis turns at its own constant rate (radians per unit time),
+	 * both at the same time.  Spec: "weighted:THETA_RATE,PHI_RATE".
+	 */
+	struct WeightedChebyshev {
+		double theta_rate {1.0}, phi_rate {1.0};
+
+		static WeightedChebyshev from_spec(const string& spec) {
+			auto p { read_parameters(spec, 2, 2) };
+			return { p[0], p[1] };
+		}
+
+		double operator()(const Direction& d1, const Direction& d2) const {
+			auto [dtheta, dphi] = axis_moves(d1, d2);
+			return std::max(dtheta / theta_rate, dphi / phi_rate);
+		}
+	};
+
+	/* Each axis accelerates at a constant rate up to a top speed, then
+	 * brakes as hard, so that a short turn never reaches the top speed
+	 * (a triangular speed profile) and a long one cruises at it for a
+	 * while (a trapezoidal profile).  The mount then needs a fixed time
+	 * to settle after any move at all.  The cost is the time taken.
+	 * Spec: "accel:THETA_SPEED,THETA_ACCEL,PHI_SPEED,PHI_ACCEL,SETTLE".
+	 */
+	struct AccelLimited {
+		double theta_speed {1.0}, theta_accel {1.0};
+		double phi_speed {1.0}, phi_accel {1.0};
+		double settle {0.0};
+
+		static AccelLimited from_spec(const string& spec) {
+			/* Speeds and accelerations, then the settling time. */
+			auto p { read_parameters(spec, 5, 4) };
+			return { p[0], p[1], p[2], p[3], p[4] };
+		}
+
+		static double axis_time(double angle, double speed, double accel) {
+			/* Reaching top speed takes speed/accel and covers half of
+			 * speed^2/accel; so does stopping. */
+			if (angle < speed * speed / accel)
+				return 2.0 * std::sqrt(angle / accel);
+			return angle / speed + speed / accel;
+		}
+
+		double operator()(const Direction& d1, const Direction& d2) const {
+			auto [dtheta, dphi] = axis_moves(d1, d2);
+			if (dtheta == 0.0 and dphi == 0.0)
+				return 0.0;
+			return std::max(axis_time(dtheta, theta_speed, theta_accel),
+							axis_time(dphi, phi_speed, phi_accel)) + settle;
+		}
+	};
+
+	/* Costs measured on the mount itself, as a table over the turn of
+	 * each axis, interpolated bilinearly.  Spec: "table:FILENAME", where
+	 * the file holds the number of rows and columns, then the costs row
+	 * by row.  Row i is for a phi turn of i * pi / (rows - 1), column j
+	 * for a theta turn of j * pi / (columns - 1).  The table is shared,
+	 * not copied, between copies of the metric.
+	 */
+	struct Table {
+		shared_ptr<const vector<double>> costs {
+				make_shared<const vector<double>>(vector<double> {0.0, PI, PI, PI}) };
+		size_t rows {2}, cols {2};
+
+		static Table from_spec(const string& spec) {
+			string filename { spec.substr(spec.find(':') + 1) };
+			ifstream in { file_reader(filename) };
+			Table t {};
+			in >> t.rows >> t.cols;
+			if (not in or t.rows < 2 or t.cols < 2) {
+				throw runtime_error("Metric table \"" + filename + "\" must"
+						" begin with its numbers of rows and columns, both"
+						" at least 2.");
+			}
+			vector<double> costs(t.rows * t.cols);
+			for (auto& c : costs)
+				in >> c;
+			if (not in)
+				throw runtime_error("Metric table \"" + filename + "\" is too short.");
+			t.costs = make_shared<const vector<double>>(move(costs));
+			return t;
+		}
+
+		double operator()(const Direction& d1, const Direction& d2) const {
+			auto [dtheta, dphi] = axis_moves(d1, d2);
+			double x { std::min(dtheta / PI, 1.0) * (cols - 1) };
+			double y { std::min(dphi / PI, 1.0) * (rows - 1) };
+			size_t j { std::min(static_cast<size_t>(x), cols - 2) };
+			size_t i { std::min(static_cast<size_t>(y), rows - 2) };
+			double fx { x - j }, fy { y - i };
+			const vector<double>& c { *costs };
+			return (1 - fy) * ((1 - fx) * c[i * cols + j]     + fx * c[i * cols + j + 1])
+				 +      fy  * ((1 - fx) * c[(i+1) * cols + j] + fx * c[(i+1) * cols + j + 1]);
+		}
+	};
+
+} // namespace metric
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "includes.h"
+#include "Direction.h"
+
+class NeighbourGrid {
+/* Buckets every rep of every Direction into a grid over the (theta, phi)
+ * torus of telescope configurations, to answer "which remaining rep is
+ * nearest to here?" without checking them all.
+ *
+ * The cells are square in the metric (theta spans twice the range of
+ * phi, so there are twice as many columns as rows), and the columns
+ * wrap around at theta = 2 pi.  A search scans rings of cells around
+ * the query, ring r holding the cells r steps away.  Anything beyond
+ * ring R is at least R cell widths away, which says when to stop.
+ *
+ * Directions may be removed as they are used, which makes a nearest
+ * neighbour tour cost about O(n) on evenly spread inputs rather than
+ * O(n^2).  Removing a Direction removes both of its reps.
+ */
+public:
+	struct Point {
+		dir_id_t id;
+		bool othr;
+	};
+
+	NeighbourGrid(shared_ptr<DirectionDatabase> dirdata,
+				  bool without_second_rep,
+				  double points_per_cell=2.0) :
+		dirdatabase {dirdata} {
+		size_t num_dir { dirdatabase->get_num_directions_defined() };
+		size_t num_points { without_second_rep ? num_dir : 2 * num_dir };
+		double num_cells { std::max(1.0, num_points / points_per_cell) };
+		rows = std::max(1, static_cast<int>(std::round(std::sqrt(num_cells / 2))));
+		cols = 2 * rows;
+		cell_width = PI / rows;
+		cells.assign(rows * cols, {});
+		where.assign(2 * num_dir, { NONE, 0 });
+		for (dir_id_t id {0}; id < num_dir; id++) {
+			for (int othr {0}; othr < (without_second_rep ? 1 : 2); othr++) {
+				insert(Point { id, (othr == 1) });
+			}
+		}
+	}
+	~NeighbourGrid() = default;
+	NeighbourGrid(const NeighbourGrid&) = default;
+	NeighbourGrid(NeighbourGrid&&) = default;
+
+	void remove_direction(dir_id_t id) {
+		for (int othr {0}; othr < 2; othr++) {
+			auto [cell, idx] = where[2 * id + othr];
+			if (cell == NONE)
+				continue;
+			auto& bucket { cells[cell] };
+			Point moved { bucket.back() };
+			bucket[idx] = moved;
+			where[2 * moved.id + moved.othr].second = idx;
+			bucket.pop_back();
+			where[2 * id + othr] = { NONE, 0 };
+		}
+	}
+
+	/* The k nearest remaining reps to d, nearest first, leaving out both
+	 * reps of the Direction with id exclude.  (Pass an id past the end
+	 * to exclude nothing.)  Fewer than k come back only if fewer remain.
+	 */
+	vector<pair<double, Point>> nearest(const Direction& d, size_t k,
+										dir_id_t exclude) const {
+		vector<pair<double, Point>> found {};
+		auto by_dist = [] (auto& p1, auto& p2) { return p1.first < p2.first; };
+		auto [row, col] = cell_of(d);
+		int max_ring { std::max(rows, cols / 2) };
+		for (int r {0}; r <= max_ring; r++) {
+			for_each_cell_in_ring(row, col, r, [&] (int cell) {
+				for (auto& p : cells[cell]) {
+					if (p.id == exclude)
+						continue;
+					double dist { d.dist_to(dirdatabase->get_direction(p.id, p.othr)) };
+					if (found.size() < k) {
+						found.push_back({ dist, p });
+						std::push_heap(found.begin(), found.end(), by_dist);
+					} else if (dist < found.front().first) {
+						std::pop_heap(found.begin(), found.end(), by_dist);
+						found.back() = { dist, p };
+						std::push_heap(found.begin(), found.end(), by_dist);
+					}
+				}
+			});
+			if (found.size() == k and found.front().first <= r * cell_width)
+				break;
+		}
+		std::sort_heap(found.begin(), found.end(), by_dist);
+		return found;
+	}
+
+private:
+	static constexpr int NONE { -1 };
+
+	pair<int, int> cell_of(const Direction& d) const {
+		int row { static_cast<int>((d.get_phi() + PI / 2) / cell_width) };
+		int col { static_cast<int>(d.get_theta() / cell_width) };
+		return { std::clamp(row, 0, rows - 1), std::clamp(col, 0, cols - 1) };
+	}
+
+	void insert(const Point& p) {
+		auto [row, col] = cell_of(dirdatabase->get_direction(p.id, p.othr));
+		int cell { row * cols + col };
+		where[2 * p.id + p.othr] = { cell, cells[cell].size() };
+		cells[cell].push_back(p);
+	}
+
+	/* Calls f(cell) once for every cell exactly r rows or (wrapped)
+	 * columns away from (row, col), and no closer. */
+	template<typename F>
+	void for_each_cell_in_ring(int row, int col, int r, F&& f) const {
+		for (int dr {-r}; dr <= r; dr++) {
+			int rr { row + dr };
+			if (rr < 0 or rr >= rows)
+				continue;
+			if (2 * r + 1 < cols) {
+				/* No column is reached twice; on the top and bottom rows
+				 * of the ring take every column, otherwise just the two
+				 * at distance r. */
+				if (std::abs(dr) == r) {
+					for (int dc {-r}; dc <= r; dc++)
+						f(rr * cols + (col + dc + cols) % cols);
+				} else {
+					f(rr * cols + (col - r + cols) % cols);
+					if (r > 0)
+						f(rr * cols + (col + r) % cols);
+				}
+			} else {
+				for (int cc {0}; cc < cols; cc++) {
+					int dc { std::abs(cc - col) };
+					dc = std::min(dc, cols - dc);
+					if (std::max(std::abs(dr), dc) == r)
+						f(rr * cols + cc);
+				}
+			}
+		}
+	}
+
+	shared_ptr<DirectionDatabase> dirdatabase;
+	int rows {}, cols {};
+	double cell_width {};
+	vector<vector<Point>> cells {};
+	vector<pair<int, size_t>> where {};  // (cell, index) of each rep
+};
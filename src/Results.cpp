@@ -0,0 +1,75 @@
+#include "Results.h"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+	/* fcntl(2) locks belong to the whole process, so the threads of one
+	 * process take turns through this first, whichever table they use. */
+	std::mutex append_mutex {};
+}
+
+ResultsTable::Row::Row(int run_id, size_t num_dir, bool without_second_rep,
+		const RunSettings& settings) :
+	run_id {run_id},
+	num_dir {num_dir},
+	without_second_rep {without_second_rep},
+	num_epochs {settings.num_epochs},
+	cool_init {settings.cool_init},
+	cool_base {settings.cool_base},
+	cool_flat_epochs {settings.cool_flat_epochs} {
+	best_at.fill(-1);
+}
+
+ResultsTable::ResultsTable(const string& filename) :
+	filename {filename} {}
+
+void ResultsTable::append(const Row& row) {
+	stringstream line {};
+	line << setprecision(10);
+	line << row.run_id << ", " << row.num_dir
+		 << ", " << (row.without_second_rep ? "no" : "yes")
+		 << ", " << row.method << ", " << row.num_epochs
+		 << ", " << row.cool_init << ", " << row.cool_base
+		 << ", " << row.cool_flat_epochs
+		 << ", " << row.greedy_objective << ", " << row.greedy_time.count()
+		 << ", " << row.objective << ", " << row.time_running.count()
+		 << ", " << row.time_to_best.count() << ", " << row.epoch_best
+		 << ", " << row.time_to_greedy.count();
+	for (double b : row.best_at)
+		line << ", " << b;
+	line << "\n";
+
+	std::lock_guard<std::mutex> guard { append_mutex };
+	std::filesystem::path folder { std::filesystem::path {filename}.parent_path() };
+	if (not folder.empty())
+		std::filesystem::create_directories(folder);
+	FileLock lock { filename + ".lock" };
+	int fd { ::open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644) };
+	if (fd < 0) {
+		throw runtime_error("Cannot open the results table \"" + filename
+				+ "\": " + std::strerror(errno));
+	}
+	struct stat st {};
+	string text { line.str() };
+	if (::fstat(fd, &st) == 0 and st.st_size == 0) {
+		string header { "RunId, NumLocs, SecondRep, Method, NumEpochs, CoolInit,"
+				" CoolBase, CoolFlatEpochs, GreedyObjective, GreedyTimeNs, Objective,"
+				" TimeNs, TimeToBestNs, EpochBest, TimeToGreedyNs" };
+		for (size_t k {0}; k < row.best_at.size(); k++)
+			header += ", Best" + to_string(100 * k / (row.best_at.size() - 1));
+		text = header + "\n" + text;
+	}
+	ssize_t written { ::write(fd, text.data(), text.size()) };
+	int error { errno };
+	::close(fd);
+	if (written != static_cast<ssize_t>(text.size())) {
+		throw runtime_error("Cannot append to the results table \"" + filename
+				+ "\": " + std::strerror(error));
+	}
+}
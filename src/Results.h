@@ -0,0 +1,89 @@
+#pragma once
+
+#include "includes.h"
+
+#include "RunSettings.h"
+#include "Schedule.h"
+#include "SimAnneal.h"
+
+class ResultsTable {
+/* One table of the results of every run id, kept up to date as runs
+ * finish, so that summaries and plots of large batches (see
+ * pyth/summary.py) read one file instead of every run's output.
+ *
+ * The table is a CSV file, output/results.csv by default, with one row
+ * per run id and rep mode, appended as each finishes:  the settings that
+ * the plots group runs by, the greedy objective and time, and the
+ * final objective, timings and convergence of the solver.  A run id
+ * solved again gets another row; the last one counts.  Columns:
+ *
+ *   - RunId, NumLocs, SecondRep (yes or no);
+ *
+ *   - Method:  anneal, islands, memetic, decompose or sky;
+ *
+ *   - NumEpochs, CoolInit, CoolBase, CoolFlatEpochs, as the positional
+ *     arguments;
+ *
+ *   - GreedyObjective and GreedyTimeNs;
+ *
+ *   - Objective, the best found, TimeNs, the time spent annealing,
+ *     TimeToBestNs and EpochBest, when the best was found, and
+ *     TimeToGreedyNs, when annealing first beat the greedy schedule;
+ *
+ *   - Best0, Best10, ..., Best100, the best objective after each tenth
+ *     of the epochs (Best0 at the start).
+ *
+ * Where a method does not say (islands, memetic annealing and
+ * decomposition only give their objective), a column is -1, as is
+ * TimeToGreedyNs where annealing never beat the greedy schedule.  Runs
+ * with lock-step lanes are not recorded.
+ *
+ * Rows are written whole, one write(2) each, while holding the lock file
+ * FILE.lock (see FileLock in includes.h), so that any number of threads
+ * and processes, on any hosts sharing the filesystem, may append to one
+ * table at once; a process dying leaves at most its own last row out.
+ */
+public:
+	ResultsTable(const string& filename=OUTPUT_FOLDER + "results.csv");
+	~ResultsTable() = default;
+	ResultsTable(ResultsTable&)  = delete;
+	ResultsTable(ResultsTable&&) = delete;
+
+	struct Row {
+		int run_id;
+		size_t num_dir;
+		bool without_second_rep;
+		string method {"anneal"};
+		long num_epochs {};
+		double cool_init {}, cool_base {};
+		long cool_flat_epochs {};
+		double greedy_objective {-1};
+		nanos greedy_time {-1};
+		double objective {-1};
+		nanos time_running {-1}, time_to_best {-1};
+		long long epoch_best {-1};
+		nanos time_to_greedy {-1};
+		std::array<double, SimAnnealer<Schedule>::NUM_CHECKPOINTS> best_at {};
+
+		Row(int run_id, size_t num_dir, bool without_second_rep,
+				const RunSettings& settings);
+
+		/* Takes everything but the greedy columns from a finished run of
+		 * annealer, whose target was the greedy objective. */
+		template<typename T>
+		void take_run(const SimAnnealer<T>& annealer) {
+			auto& summary { annealer.get_summary() };
+			objective = annealer.get_obj_best();
+			time_running = summary.time_running;
+			time_to_best = summary.time_to_best;
+			epoch_best = summary.epoch_best;
+			time_to_greedy = summary.time_to_target;
+			std::copy(summary.best_at.begin(), summary.best_at.end(), best_at.begin());
+		}
+	};
+
+	void append(const Row& row);
+
+private:
+	string filename;
+};
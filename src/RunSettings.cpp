@@ -0,0 +1,202 @@
+#include "RunSettings.h"
+
+bool is_option(const string& arg) {
+	return arg.rfind("--", 0) == 0;
+}
+
+void apply_option(RunSettings& settings, const string& arg) {
+	const string error_msg =
+			"Command line option of the wrong format.\n"
+			"Options must look like --name=value, but found \""
+			+ arg + "\"\n" + describe_options();
+	auto match = wrap_regex_match(arg, "--([a-z\\-]+)=(.*)", error_msg);
+	string name  { match[1] };
+	string value { match[2] };
+
+	/* As with the positional arguments, underscores in numbers are only
+	 * for readability (e.g., 1_000_000).  Other values, such as file
+	 * names, keep theirs. */
+	auto strip_underscores = [&] () {
+		value.erase(std::remove(value.begin(), value.end(), '_'), value.end());
+	};
+
+	auto read_decimal = [&] () {
+		strip_underscores();
+		wrap_regex_match(value, "(0|([1-9][0-9]*))(.[0-9]*)?",
+				"Option --" + name + " must be a decimal, but found \""
+				+ value + "\"");
+		return stod(value);
+	};
+
+	auto read_integer = [&] () {
+		strip_underscores();
+		wrap_regex_match(value, "[1-9][0-9]*",
+				"Option --" + name + " must be a positive integer, but found \""
+				+ value + "\"");
+		return stol(value);
+	};
+
+	if (name == "rejection-free") {
+		settings.rejection_free_below = read_decimal();
+		if (settings.rejection_free_below >= 1.0) {
+			throw runtime_error("Option --rejection-free is an acceptance rate"
+					" and must be less than 1.0.");
+		}
+	} else if (name == "accept") {
+		wrap_regex_match(value, "metropolis|threshold|lahc",
+				"Option --accept must be \"metropolis\", \"threshold\" or"
+				" \"lahc\", but found \"" + value + "\"");
+		settings.acceptance = value;
+	} else if (name == "lahc-history") {
+		settings.lahc_history = read_integer();
+	} else if (name == "islands") {
+		settings.islands = read_integer();
+	} else if (name == "migrate-every") {
+		settings.migrate_every = read_integer();
+	} else if (name == "island-lag") {
+		settings.island_lag = read_decimal();
+	} else if (name == "memetic") {
+		settings.memetic = read_integer();
+		if (settings.memetic < 2) {
+			throw runtime_error("Option --memetic is a population size and"
+					" must be at least 2.");
+		}
+	} else if (name == "generations") {
+		settings.memetic_generations = read_integer();
+	} else if (name == "schedule") {
+		wrap_regex_match(value, "array|list",
+				"Option --schedule must be \"array\" or \"list\", but found \""
+				+ value + "\"");
+		settings.two_level_list = (value == "list");
+	} else if (name == "decompose") {
+		settings.region_size = read_integer();
+	} else if (name == "run-threads") {
+		settings.run_threads = read_integer();
+	} else if (name == "start") {
+		wrap_regex_match(value, "identity|greedy|sfc|greedy-edge|nn",
+				"Option --start must be one of \"identity\", \"greedy\","
+				" \"sfc\", \"greedy-edge\" or \"nn\", but found \""
+				+ value + "\"");
+		settings.start = value;
+	} else if (name == "start-cool-init") {
+		settings.start_cool_init = read_decimal();
+	} else if (name == "nn-starts") {
+		settings.nn_starts = read_integer();
+	} else if (name == "metric") {
+		wrap_regex_match(value, "chebyshev|weighted:.+|accel:.+|table:.+",
+				"Option --metric must be \"chebyshev\", \"weighted:...\","
+				" \"accel:...\" or \"table:FILE\", but found \""
+				+ value + "\"");
+		settings.metric = value;
+	} else if (name == "sky") {
+		wrap_regex_match(value, "[-0-9.e]+(,[-0-9.e]+){3}",
+				"Option --sky must be \"LATITUDE,SIDEREAL_START,SLEW_RATE,DWELL\","
+				" but found \"" + value + "\"");
+		settings.sky = value;
+	} else if (name == "pin") {
+		wrap_regex_match(value, "none|core|node",
+				"Option --pin must be \"none\", \"core\" or \"node\", but"
+				" found \"" + value + "\"");
+		settings.pin = value;
+	} else if (name == "lanes") {
+		wrap_regex_match(value, "0|4|8|16",
+				"Option --lanes must be 0, 4, 8 or 16, but found \""
+				+ value + "\"");
+		settings.lanes = stoul(value);
+	} else if (name == "fixed-point") {
+		wrap_regex_match(value, "0|16|32",
+				"Option --fixed-point must be 0, 16 or 32, but found \""
+				+ value + "\"");
+		settings.fixed_point_bits = stoi(value);
+	} else if (name == "time-slice") {
+		strip_underscores();
+		wrap_regex_match(value, "0|([1-9][0-9]*)",
+				"Option --time-slice must be a number of epochs, but found \""
+				+ value + "\"");
+		settings.time_slice = stoul(value);
+	} else if (name == "slice-share") {
+		wrap_regex_match(value, "equal|size|order",
+				"Option --slice-share must be \"equal\", \"size\" or"
+				" \"order\", but found \"" + value + "\"");
+		settings.slice_share = value;
+	} else if (name == "renumber") {
+		wrap_regex_match(value, "none|curve",
+				"Option --renumber must be \"none\" or \"curve\", but found \""
+				+ value + "\"");
+		settings.renumber = value;
+	} else {
+		throw runtime_error("Unknown option \"--" + name + "\".\n"
+				+ describe_options());
+	}
+}
+
+string describe_options() {
+	return
+		"Optional settings, each given as --name=value:\n"
+		"  --rejection-free=RATE  switch to rejection-free annealing once\n"
+		"                         fewer than RATE of proposals are accepted,\n"
+		"                         while it pays off (small instances only)\n"
+		"  --accept=RULE          accept worse steps by metropolis (default),\n"
+		"                         threshold (threshold accepting) or lahc\n"
+		"                         (late acceptance hill climbing)\n"
+		"  --lahc-history=L       epochs looked back by --accept=lahc\n"
+		"  --islands=K            anneal each run id with K chains that share\n"
+		"                         their best states (uses K threads per run id)\n"
+		"  --migrate-every=E      epochs between island migrations\n"
+		"  --island-lag=FRAC      restart islands lagging the best by FRAC\n"
+		"  --memetic=P            anneal a population of P schedules and\n"
+		"                         breed offspring from them by crossover\n"
+		"  --generations=G        generations of offspring for --memetic\n"
+		"  --schedule=list        anneal with the two-level list schedule\n"
+		"  --decompose=SIZE       anneal regions of about SIZE directions\n"
+		"                         separately, then join them\n"
+		"  --run-threads=N        threads for work split within one run id\n"
+		"  --start=HEURISTIC      start annealing from identity (default),\n"
+		"                         greedy, sfc, greedy-edge or nn\n"
+		"  --start-cool-init=T    initial temperature when not starting\n"
+		"                         from identity (default: scaled down)\n"
+		"  --nn-starts=K          starting directions tried by --start=nn\n"
+		"  --metric=SPEC          slew cost (see src/Metrics.h): chebyshev\n"
+		"                         (default), weighted:VT,VP,\n"
+		"                         accel:VT,AT,VP,AP,SETTLE or table:FILE\n"
+		"  --sky=LAT,LST,RATE,DWELL\n"
+		"                         read directions as right ascension and\n"
+		"                         declination, and minimize the slew time\n"
+		"                         as they drift (see src/Sky.h)\n"
+		"  --pin=MODE             pin worker threads to CPUs: none (default),\n"
+		"                         core or node (NUMA node)\n"
+		"  --lanes=L              anneal each worker's run ids L at a time\n"
+		"                         in lock-step, for small instances (4, 8\n"
+		"                         or 16; default 0, off)\n"
+		"  --fixed-point=BITS     with --lanes, angles in fixed point of 16\n"
+		"                         or 32 bits (default 0, doubles)\n"
+		"  --time-slice=EPOCHS    anneal all run ids together on the\n"
+		"                         threads, EPOCHS at a time (default 0, off)\n"
+		"  --slice-share=SHARE    epochs per run id with --time-slice: equal\n"
+		"                         (default), size (by directions) or order\n"
+		"  --renumber=ORDER       renumber directions on loading, for cache\n"
+		"                         locality: none (default) or curve\n"
+		"Or, to run as a service taking problems over stdin or a Unix\n"
+		"socket (see src/SolverDaemon.h), with no positional arguments:\n"
+		"  --serve=stdio|PATH     serve on stdin/stdout or a socket at PATH\n"
+		"  --workers=N            problems solved at once\n"
+		"Or, to benchmark solver configurations on a fixed corpus (see\n"
+		"src/Benchmark.h), with no positional arguments:\n"
+		"  --bench=FOLDER         the benchmark folder, e.g. benchmark\n"
+		"  --repeats=R            runs per configuration and instance\n"
+		"  --target=GAP           target gap to the reference (default 0.03)\n"
+		"  --baseline=FILE        summary to flag regressions against\n"
+		"                         (default FOLDER/baseline.csv)\n"
+		"Or, to tune cooling settings by successive halving (see\n"
+		"src/Tuner.h), with no positional arguments:\n"
+		"  --tune=FILE            the tuning file, e.g. tuning.csv\n"
+		"  --workers=N            threads (default: all available)\n"
+		"  --samples=K            configurations drawn at random from each\n"
+		"                         group's grid (default: the whole grid)\n"
+		"Or, to share a batch of run ids between processes and hosts (see\n"
+		"src/WorkQueue.h):\n"
+		"  --queue=FILE           with the usual positional arguments, add\n"
+		"                         the run ids to the queue FILE and work\n"
+		"                         through it; with none, only work through it\n"
+		"  --workers=N            threads, with no positional arguments\n";
+}
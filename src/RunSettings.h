@@ -0,0 +1,177 @@
+#pragma once
+
+#include "includes.h"
+
+/* ************************************************** *
+ * Everything needed to solve a single run id, beyond the directions
+ * themselves.  The first group of settings comes from the positional
+ * command line arguments, which every run must specify.  The rest are
+ * optional and may be given on the command line as "--name=value";
+ * see apply_option(...) below for the names.
+ */
+struct RunSettings {
+	long   num_epochs       {};
+	long   vb_every         {};
+	double cool_init        {};
+	double cool_base        {};
+	long   cool_flat_epochs {};
+
+	/* Optional.  Once the fraction of accepted annealing proposals drops
+	 * below this rate, switch to rejection-free annealing, for as long as
+	 * it is estimated to be faster.  Zero means never switch.  Its memory
+	 * and time per change of temperature grow with the square of the
+	 * number of Directions, so it only pays off on small instances, with
+	 * long flat stretches of cooling, and beyond RF_MAX_DIRECTIONS (see
+	 * TelAnnealer.h) never switches.
+	 * Option name: --rejection-free
+	 */
+	double rejection_free_below {0.0};
+
+	/* Optional.  How annealing decides on steps that make the objective
+	 * worse (see cooling::Acceptance in SimAnneal.h):  "metropolis" (the
+	 * default), "threshold" (threshold accepting, the cooling settings
+	 * giving the thresholds) or "lahc" (late acceptance hill climbing,
+	 * looking back lahc_history epochs, the cooling settings unused).
+	 * Option names: --accept, --lahc-history
+	 */
+	string acceptance   {"metropolis"};
+	size_t lahc_history {5'000};
+
+	/* Optional.  Number of annealing chains (islands) to run on each
+	 * run id, each on its own thread, with the best state migrating
+	 * between them every migrate_every epochs.  A chain restarts from
+	 * the best state once its current objective is more than island_lag
+	 * (a fraction) above it.
+	 * Option names: --islands, --migrate-every, --island-lag
+	 */
+	int           islands       {1};
+	unsigned long migrate_every {100'000};
+	double        island_lag    {0.05};
+
+	/* Optional.  Solve by memetic annealing (Memetic.h):  a population
+	 * of this many schedules, each annealed for the usual number of
+	 * epochs, then memetic_generations generations of as many offspring,
+	 * each bred by crossover from two members and annealed just as long,
+	 * starting cooler as from --start.  The chains anneal run_threads at
+	 * a time.  Zero means annealing a single chain.
+	 * Option names: --memetic, --generations
+	 */
+	size_t memetic             {0};
+	int    memetic_generations {10};
+
+	/* Optional.  Anneal using the two-level doubly-linked list schedule
+	 * (TwoLevelSchedule.h) rather than the array one (Schedule.h).  The
+	 * list pays off for large numbers of directions.
+	 * Option name: --schedule=list (or --schedule=array, the default)
+	 */
+	bool two_level_list {false};
+
+	/* Optional.  Solve by spatial decomposition (TelDecomposer.h) into
+	 * regions of about this many directions, instead of annealing the
+	 * whole problem at once.  Zero means no decomposition.
+	 * Option name: --decompose
+	 */
+	size_t region_size {0};
+
+	/* Optional.  Threads that a single run id may use for work that
+	 * splits up within the run, such as annealing decomposed regions.
+	 * Option name: --run-threads
+	 */
+	int run_threads {1};
+
+	/* Optional.  Where annealing starts: "identity" (the directions in
+	 * id order), or a schedule from TelGreedy.h ("greedy") or one of the
+	 * heuristics in TelConstructor.h ("sfc", "greedy-edge", "nn").  A
+	 * constructed start is already fairly good, so by default annealing
+	 * then begins cooler, at cool_init scaled by the ratio of the start's
+	 * objective to that of the identity schedule; start_cool_init, if
+	 * positive, replaces that initial temperature.  The "nn" heuristic
+	 * tries nn_starts starting directions, on run_threads threads.
+	 * Option names: --start, --start-cool-init, --nn-starts
+	 */
+	string start           {"identity"};
+	double start_cool_init {0.0};
+	size_t nn_starts       {8};
+
+	/* Optional.  The slew-cost metric, as a specification for one of the
+	 * metrics in Metrics.h:  "chebyshev" (the default, as described in
+	 * the README), "weighted:...", "accel:..." or "table:FILE".  Other
+	 * metrics work with the greedy and identity starts and the array
+	 * schedule only.
+	 * Option name: --metric
+	 */
+	string metric {"chebyshev"};
+
+	/* Optional.  Read the input Directions as targets on the sky, by
+	 * right ascension (theta) and declination (phi), and minimize the
+	 * time spent slewing between them as they drift with the Earth's
+	 * rotation (see Sky.h); the value is the site, given as
+	 * "LATITUDE,SIDEREAL_START,SLEW_RATE,DWELL".  Empty means the usual
+	 * fixed mount angles.  The sky works with the array schedule, the
+	 * identity and greedy starts and the default metric only.
+	 * Option name: --sky
+	 */
+	string sky {};
+
+	/* Optional.  How worker threads are pinned to CPUs (see Affinity.h):
+	 * "none" (the default), "core" (each worker on CPUs of its own, as
+	 * many as its islands or run threads) or "node" (each worker on one
+	 * NUMA node, the workers taking the nodes in turn).
+	 * Option name: --pin
+	 */
+	string pin {"none"};
+
+	/* Optional.  Anneal the run ids of each worker in lock-step batches
+	 * of this many (4, 8 or 16), one per SIMD lane; see
+	 * LockstepAnnealer.h.  This pays off for many small instances.  Zero
+	 * means annealing each run id on its own.  Lanes work with the
+	 * identity and greedy starts, the array schedule and the default
+	 * metric only, and without islands, rejection-free annealing or
+	 * other acceptance rules.
+	 * Option name: --lanes
+	 */
+	size_t lanes {0};
+
+	/* Optional.  With lanes, keep the angles in fixed point of this many
+	 * bits (16 or 32; see FixedAngles in Direction.h) rather than as
+	 * doubles.  Zero means doubles.
+	 * Option name: --fixed-point
+	 */
+	int fixed_point_bits {0};
+
+	/* Optional.  Anneal every run id's chains together, time_slice
+	 * epochs at a time, on the worker threads (see ChainScheduler.h),
+	 * rather than each worker annealing its own run ids one after
+	 * another; slice_share is how the epochs are shared out:  "equal"
+	 * (the default), "size" (in proportion to the number of Directions)
+	 * or "order" (the run ids as listed first).  Zero means no time
+	 * slices.  Time slices work without islands, memetic annealing,
+	 * decomposition, lanes, the sky or a queue.
+	 * Option names: --time-slice, --slice-share
+	 */
+	unsigned long time_slice {0};
+	string slice_share {"equal"};
+
+	/* Optional.  Renumber each run id's Directions as they are loaded:
+	 * "none" (the default) or "curve", along the space-filling curve of
+	 * the sfc start, Direction 0 staying first (see curve_order(...) in
+	 * TelConstructor.h).  Directions close in space then sit close in
+	 * memory, which helps instances too large for the caches.  Schedules
+	 * are still written with the ids of the input, but annealing is
+	 * otherwise a different run:  the identity start follows the curve,
+	 * and the random steps draw other ids.
+	 * Option name: --renumber
+	 */
+	string renumber {"none"};
+};
+
+/* Returns true if arg looks like an option, "--name=value". */
+bool is_option(const string& arg);
+
+/* Reads one "--name=value" option into settings, or throws an error
+ * message if the option is unknown or its value is malformed.
+ */
+void apply_option(RunSettings& settings, const string& arg);
+
+/* Lists the options understood by apply_option(...), for usage messages. */
+string describe_options();
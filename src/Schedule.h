@@ -1,11 +1,47 @@
 #pragma once
 
 #include "includes.h"
+#include "Counters.h"
 #include "Direction.h"
+#include "Metrics.h"
 
-class ScheduleIterator;
+#include <limits>
+#include <type_traits>
 
-struct Schedule {
+/* ************************************************** *
+ * Representation policies.  A DualRep schedule records, for each
+ * Direction, whether it is visited in its standard or its other rep.
+ * A SingleRep schedule only ever uses the standard rep, so it stores
+ * nothing about reps at all, and every check of them compiles away.
+ */
+struct DualRep {
+	static constexpr bool single { false };
+};
+
+struct SingleRep {
+	static constexpr bool single { true };
+};
+
+template<typename Sched>
+class BasicScheduleIterator;
+
+/* The schedule is stored as arrays of Direction ids and reps.  The ids
+ * are kept as Index, which need only be wide enough for the number of
+ * Directions: instances with at most 65536 Directions can use 16-bit
+ * ids, halving the memory that every copy and reversal moves around.
+ * The interface still speaks in dir_id_t throughout.
+ *
+ * Distances between consecutive Directions are measured by Metric, one
+ * of the slew-cost metrics of Metrics.h.  The schedule holds its own
+ * copy of the metric (with whatever parameters it was configured with),
+ * and annealers reach it through dist(...), so that a custom cost model
+ * is still inlined into the loops that evaluate moves.
+ *
+ * Most code uses Schedule, the general case defined at the bottom.
+ */
+template<typename Index=dir_id_t, typename Reps=DualRep,
+		 typename Metric=metric::Chebyshev>
+struct BasicSchedule {
 	/* A schedule iterator will run through the current schedule and
 	 * provide a pointer to each direction, as appropriate. It must
 	 * therefore be able to access the current schedule.  We want this
@@ -15,50 +51,313 @@ struct Schedule {
 	 * To explain the "friend class" declaration, refer to:
 	 *     https://en.cppreference.com/w/cpp/language/friend
 	 */
-	friend class ScheduleIterator;
+	friend class BasicScheduleIterator<BasicSchedule>;
+	using iterator = BasicScheduleIterator<BasicSchedule>;
 public:
-	Schedule(shared_ptr<DirectionDatabase> dirdata=nullptr, bool do_setup=true);
-	Schedule(vector<dir_id_t>&& schd_dir_id_t,
-			 vector<bool>&& schd_dir_othr,
-			 shared_ptr<DirectionDatabase> dirdata=nullptr);
-	~Schedule() = default;
+	static_assert(std::is_unsigned_v<Index>, "Direction ids are unsigned.");
+	static constexpr bool single_rep { Reps::single };
+	using metric_type = Metric;
+
+	BasicSchedule(shared_ptr<DirectionDatabase> dirdata=nullptr, bool do_setup=true,
+				  const Metric& metric={}) :
+		metric { metric },
+		dirdata { dirdata },
+		num_dir { checked_num_dir(dirdata) },
+		schd_dir_id_t(num_dir),
+		schd_dir_othr {} {
+		if constexpr (not single_rep)
+			schd_dir_othr.assign(num_dir, false);
+		if (do_setup) {
+			for (size_t j {0}; j<num_dir; j++) {
+				/* Note: by convention, Direction IDs are the indices 0, 1, 2, ...,
+				 * through num_dir-1.  This is verified upon setup within
+				 * Direction.cpp, in place_direction(...). */
+				schd_dir_id_t[j] = j;
+			}
+		}
+	}
 
-	Schedule(const Schedule& other) = default;
-	Schedule(Schedule&&) = default;
+	BasicSchedule(vector<dir_id_t>&& sdidt,
+				  vector<bool>&& sdothr,
+				  shared_ptr<DirectionDatabase> dirdata=nullptr,
+				  const Metric& metric={}) :
+		metric { metric },
+		dirdata { dirdata },
+		num_dir { checked_num_dir(dirdata) },
+		schd_dir_id_t {},
+		schd_dir_othr {} {
+		if constexpr (std::is_same_v<Index, dir_id_t>)
+			schd_dir_id_t = move(sdidt);
+		else
+			schd_dir_id_t.assign(sdidt.begin(), sdidt.end());
+
+		if constexpr (single_rep) {
+			if (std::find(sdothr.begin(), sdothr.end(), true) != sdothr.end()) {
+				throw std::runtime_error(
+						"A single-rep schedule cannot visit a Direction"
+						" in its other rep.");
+			}
+		} else {
+			schd_dir_othr = move(sdothr);
+		}
+	}
+
+	~BasicSchedule() = default;
+
+	BasicSchedule(const BasicSchedule& other) = default;
+	BasicSchedule(BasicSchedule&&) = default;
 
 	/* Note that copy assignment should have non-void return type.  See
 	 *     https://en.cppreference.com/w/cpp/language/copy_assignment
 	 */
-	Schedule& operator=(const Schedule& other) { this->copy_from(other); return *this; }
-	Schedule& operator=(Schedule&&) = default;
+	BasicSchedule& operator=(const BasicSchedule& other) { this->copy_from(other); return *this; }
+	BasicSchedule& operator=(BasicSchedule&&) = default;
 
-	unique_ptr<Schedule> duplicate() const;
-	void copy_from(const Schedule& source);
-	double total_distance()  const;
-	ScheduleIterator begin() const;
-	ScheduleIterator end()   const;
+	unique_ptr<BasicSchedule> duplicate() const {
+		auto dupl = make_unique<BasicSchedule>(dirdata, false, metric);
+		dupl->copy_from(*this);
+		return dupl;
+	}
 
-	void flip_segment(size_t i, size_t j, bool switch_rep_rep);
+	void copy_from(const BasicSchedule& source) {
+		if (source.num_dir != this->num_dir) {
+			throw std::runtime_error(
+					"Asked to copy a schedule with "
+					+ to_string(source.num_dir)
+					+ " Directions into a schedule with "
+					+ to_string(this->num_dir)
+					+ " Directions.");
+		}
+		std::copy(source.schd_dir_id_t.begin(), source.schd_dir_id_t.end(),
+					this->schd_dir_id_t.begin());
+		if constexpr (not single_rep) {
+			std::copy(source.schd_dir_othr.begin(), source.schd_dir_othr.end(),
+						this->schd_dir_othr.begin());
+		}
+	}
+
+	double total_distance() const {
+		COUNT_PHASE(total_distance);
+		auto i1 = this->begin();
+		auto the_end = this->end();
+		if (i1 == the_end)
+			return 0;
+		/* The schedule has entries (as it should) which we can now step
+		 * through in pairs.  The iterators i1, i2 will be off by one at
+		 * all times.  For instance:
+		 *                                i1  i2
+		 * (Index within schedule) 0  1   2   3   4 ...
+		 *                                ^   ^
+		 * The call dist(*i1, *i2) computes the distance between this pair
+		 * of directions.
+		 */
+		double total_dist {0};
+		auto i2 = this->begin();
+		i2++;
+		while (i2 != the_end) {
+			total_dist += dist(*i1, *i2);
+			i1++, i2++;
+		}
+		return total_dist;
+	}
+
+	/* The cost of slewing from d1 to d2, by this schedule's metric. */
+	double dist(const Direction& d1, const Direction& d2) const {
+		return metric(d1, d2);
+	}
+
+	const Metric& get_metric() const {
+		return metric;
+	}
+
+	iterator begin() const {
+		return iterator {this};
+	}
+	iterator end() const {
+		iterator s {this};
+		s += this->num_dir;
+		return s;
+	}
+
+	/* Reverses the Directions at indices i, ..., j (inclusive), switching
+	 * each one's rep too if switch_rep.  A SingleRep schedule has no reps
+	 * to switch, and refuses to. */
+	void flip_segment(size_t i, size_t j, bool switch_rep) {
+		if (i > j) {
+			flip_segment(j, i, switch_rep);
+			return;
+		} else if (j >= this->num_dir) {
+			throw std::out_of_range(
+					"Asked to flip range within schedule between indices "
+					+ to_string(i) + " and " + to_string(j)
+					+ " (inclusive) but there are only "
+					+ to_string(num_dir) + " Directions.");
+		} else if (i == 0) {
+			throw std::runtime_error(
+					"Rescheduling the Direction at index i=0 is not permitted.");
+		} else if (single_rep and switch_rep) {
+			throw std::runtime_error(
+					"Asked to switch reps within a single-rep schedule.");
+		} else {
+			COUNT_PHASE(flip_segment);
+			/* Both i and j are included in the flipped segment, so the
+			 * reversal runs through the iterator just past j. */
+			{
+				// First, reverse the direction ids.
+				auto ptr_start_i = schd_dir_id_t.begin() + i;
+				auto ptr_past_j  = schd_dir_id_t.begin() + j + 1;
+				std::reverse(ptr_start_i, ptr_past_j);
+			}
+			if constexpr (not single_rep) {
+				// Now reverse the direction primary/other rep indicators.
+				auto ptr_start_i = schd_dir_othr.begin() + i;
+				auto ptr_past_j  = schd_dir_othr.begin() + j + 1;
+				std::reverse(ptr_start_i, ptr_past_j);
+
+				// Now, if asked to flip the representations, do so.
+				if (switch_rep) {
+					for (size_t idx { i }; idx <= j; idx++)
+						this->schd_dir_othr[idx] = not (this->schd_dir_othr[idx]);
+				}
+			}
+		}
+	}
 
 	size_t get_num_dir() const {
 		return num_dir;
 	}
+
+	/* ************************************************** *
+	 * Changing which Directions are scheduled, after the DirectionDatabase
+	 * has gained or lost one (see add_direction(...) and
+	 * remove_direction(...) in Direction.h).  Every schedule on that
+	 * database must be told separately.
+	 *
+	 * - insert_at(idx, id, othr) puts Direction id at index idx (at least
+	 *   1), moving the Directions from idx onwards one place later.
+	 *
+	 * - erase_at(idx) removes the Direction at index idx (at least 1).
+	 *
+	 * - rename(from, to) makes the entry for Direction from refer to
+	 *   Direction to instead, as when remove_direction(...) moves the
+	 *   last id into a gap.
+	 *
+	 * - index_of(id) finds Direction id within the schedule, in O(n).
+	 */
+	void insert_at(size_t idx, dir_id_t id, bool othr) {
+		if (idx == 0 or idx > num_dir) {
+			throw std::out_of_range("Cannot insert a Direction at index "
+					+ to_string(idx) + " of a schedule with "
+					+ to_string(num_dir) + " Directions.");
+		} else if (id > std::numeric_limits<Index>::max()) {
+			throw std::runtime_error("Direction id " + to_string(id)
+					+ " does not fit into the schedule's ids.");
+		}
+		schd_dir_id_t.insert(schd_dir_id_t.begin() + idx, id);
+		if constexpr (single_rep) {
+			if (othr) {
+				throw std::runtime_error(
+						"A single-rep schedule cannot visit a Direction"
+						" in its other rep.");
+			}
+		} else {
+			schd_dir_othr.insert(schd_dir_othr.begin() + idx, othr);
+		}
+		num_dir++;
+	}
+
+	void erase_at(size_t idx) {
+		if (idx == 0 or idx >= num_dir) {
+			throw std::out_of_range("Cannot erase index " + to_string(idx)
+					+ " of a schedule with " + to_string(num_dir)
+					+ " Directions.");
+		}
+		schd_dir_id_t.erase(schd_dir_id_t.begin() + idx);
+		if constexpr (not single_rep)
+			schd_dir_othr.erase(schd_dir_othr.begin() + idx);
+		num_dir--;
+	}
+
+	void rename(dir_id_t from, dir_id_t to) {
+		schd_dir_id_t[index_of(from)] = to;
+	}
+
+	size_t index_of(dir_id_t id) const {
+		auto found { std::find(schd_dir_id_t.begin(), schd_dir_id_t.end(), id) };
+		if (found == schd_dir_id_t.end()) {
+			throw std::runtime_error("Direction id " + to_string(id)
+					+ " is not in the schedule.");
+		}
+		return found - schd_dir_id_t.begin();
+	}
+
+	/* Direct lookups by index within the schedule.  These are used by
+	 * annealers that evaluate a move from the few Directions it touches
+	 * rather than through the full total_distance(). */
+	dir_id_t get_id_at(size_t idx) const {
+		return schd_dir_id_t[idx];
+	}
+	bool is_other_at(size_t idx) const {
+		if constexpr (single_rep)
+			return false;
+		else
+			return schd_dir_othr[idx];
+	}
+	const Direction& direction_at(size_t idx, bool switch_rep=false) const {
+		if constexpr (single_rep)
+			return dirdata->get_direction(schd_dir_id_t[idx], false);
+		else
+			return dirdata->get_direction(schd_dir_id_t[idx],
+							schd_dir_othr[idx] != switch_rep);
+	}
+
+	/* True if every id of the Directions in dirdata fits into Index. */
+	static bool fits(const DirectionDatabase& dirdata) {
+		return dirdata.get_num_directions_defined()
+				<= size_t { std::numeric_limits<Index>::max() } + 1;
+	}
+
 private:
+	/* Stands in for the rep indicators of a SingleRep schedule. */
+	struct NoReps {};
+
+	static size_t checked_num_dir(const shared_ptr<DirectionDatabase>& dirdata) {
+		if (not fits(*dirdata)) {
+			throw std::runtime_error("A schedule with "
+					+ to_string(sizeof(Index) * 8) + "-bit ids cannot hold "
+					+ to_string(dirdata->get_num_directions_defined())
+					+ " Directions.");
+		}
+		return dirdata->get_num_directions_defined();
+	}
+
+	Metric metric;
 	shared_ptr<DirectionDatabase> dirdata;
 	size_t num_dir;
-	vector<dir_id_t> schd_dir_id_t;
-	vector<bool>     schd_dir_othr;
+	vector<Index> schd_dir_id_t;
+	std::conditional_t<single_rep, NoReps, vector<bool>> schd_dir_othr;
 };
 
-class ScheduleIterator {
+template<typename Sched>
+class BasicScheduleIterator {
 public:
-	ScheduleIterator(const Schedule* s);
-	~ScheduleIterator() = default;
-	ScheduleIterator(ScheduleIterator&)  = default;
-	ScheduleIterator(ScheduleIterator&&) = default;
+	BasicScheduleIterator(const Sched* s) :
+		current_idx {0},
+		my_schedule {s} {}
+	~BasicScheduleIterator() = default;
+	BasicScheduleIterator(BasicScheduleIterator&)  = default;
+	BasicScheduleIterator(BasicScheduleIterator&&) = default;
 
-	bool operator!=(ScheduleIterator& other);
-	bool operator==(ScheduleIterator& other);
+	bool operator!=(BasicScheduleIterator& other) {
+		/* Simply determine if the iterators point to different indices
+		 * or if they are for different schedules.
+		 */
+		return (this->current_idx != other.current_idx
+				or this->my_schedule != other.my_schedule);
+	}
+	bool operator==(BasicScheduleIterator& other) {
+		return not (*this != other);
+	}
 	/* NOTE:
 	 * To explain why there are two ++ definitions, see the following
      * two discussions on StackOverflow:
@@ -70,14 +369,43 @@ public:
 	 * The takeaway is that ++ and ++(int) are different and represent
      * prefix and postfix.
 	 */
-	ScheduleIterator& operator++();
-	ScheduleIterator operator++(int __);
+	BasicScheduleIterator& operator++() {
+		current_idx += 1;
+		return *this;
+	}
+	BasicScheduleIterator operator++(int) {
+		BasicScheduleIterator prev_iter { *this };  // Copy construction
+		current_idx += 1;
+		return prev_iter;
+	}
 
-	ScheduleIterator& operator+=(int j);
-	const Direction& operator*();
+	BasicScheduleIterator& operator+=(size_t j) {
+		current_idx += j;
+		return *this;
+	}
+	const Direction& operator*() {
+		if (current_idx >= my_schedule->num_dir) {
+			throw std::out_of_range("Iterator is out of range: "
+						+ to_string(current_idx) + " out of "
+						+ to_string(my_schedule->num_dir));
+		}
+		return my_schedule->direction_at(current_idx);
+	}
 private:
-	int current_idx;
-	const Schedule* my_schedule;
+	size_t current_idx;
+	const Sched* my_schedule;
 };
 
-ostream& operator<<(ostream& o, const Schedule& sched);
+template<typename Index, typename Reps, typename Metric>
+ostream& operator<<(ostream& o, const BasicSchedule<Index, Reps, Metric>& sched) {
+	/* Simply print all directions as ordered in the schedule, one per line. */
+	for (auto& d : sched) {
+		o << d << '\n';
+	}
+	return o;
+}
+
+/* ************************************************** */
+
+using Schedule = BasicSchedule<dir_id_t, DualRep>;
+using ScheduleIterator = BasicScheduleIterator<Schedule>;
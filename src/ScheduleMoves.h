@@ -0,0 +1,35 @@
+#pragma once
+
+#include "includes.h"
+#include "Direction.h"
+
+/* ************************************************** *
+ * Moves shared by the optimizers that work on schedules.  Each works
+ * with any schedule type S offering the interface of Schedule (see
+ * Schedule.h).
+ */
+
+/* Change in s.total_distance() if s.flip_segment(i, j, switch_rep) were
+ * called.
+ *
+ * Reversing a segment and switching every rep in it leaves each distance
+ * within the segment unchanged:  switching both reps shifts both thetas
+ * by pi (modulo 2 pi) and negates both phis, which changes neither the
+ * wrapped theta difference nor the phi difference.  So only the edges
+ * on either side of the segment need to be computed.  Every metric in
+ * Metrics.h keeps to this, as it depends only on those two differences.
+ */
+template<typename S>
+double reversal_delta(const S& s, size_t i, size_t j, bool switch_rep) {
+	if (i > j)
+		std::swap(i, j);
+	const Direction& before_i { s.direction_at(i - 1) };
+	double delta { s.dist(before_i, s.direction_at(j, switch_rep))
+					- s.dist(before_i, s.direction_at(i)) };
+	if (j + 1 < s.get_num_dir()) {
+		const Direction& after_j { s.direction_at(j + 1) };
+		delta += s.dist(after_j, s.direction_at(i, switch_rep))
+					- s.dist(after_j, s.direction_at(j));
+	}
+	return delta;
+}
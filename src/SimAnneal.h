@@ -2,6 +2,12 @@
 
 #include "includes.h"
 
+#include <array>
+#include <functional>
+
+#include "Counters.h"
+#include "Trace.h"
+
 namespace cooling {
 
 	class CoolingFn {
@@ -11,6 +17,12 @@ namespace cooling {
 		CoolingFn(CoolingFn&)  = default;
 		CoolingFn(CoolingFn&&) = default;
 		virtual double coolingfn(long epoch) = 0;
+		/* The first epoch after epoch at which coolingfn(...) may give a
+		 * different value, so that callers may keep the value until then.
+		 * By default, the very next epoch. */
+		virtual long constant_until(long epoch) {
+			return epoch + 1;
+		}
 		string descr;
 	};
 
@@ -52,11 +64,45 @@ namespace cooling {
 		double coolingfn(long epoch) override {
 			return init_scale * pow(base, epoch / epochs_flat);
 		}
+		long constant_until(long epoch) override {
+			return (epoch / epochs_flat + 1) * epochs_flat;
+		}
 	private:
 		double init_scale, base;
 		long epochs_flat;
 	};
 
+	/* ************************************************** *
+	 * How the annealer decides whether to take a step that makes the
+	 * objective worse (steps that improve it are always taken):
+	 *
+	 * - metropolis, with probability exp(-(change) / temperature), the
+	 *   temperature following the cooling function;
+	 *
+	 * - threshold, threshold accepting (Dueck and Scheuer, 1990):  if the
+	 *   change is less than a threshold, which follows the cooling
+	 *   function in place of the temperature; and
+	 *
+	 * - late, late acceptance hill climbing (Burke and Bykov, 2017):  if
+	 *   the new objective is no worse than the current objective was a
+	 *   fixed number of epochs ago.  The cooling function is not used,
+	 *   and the history length is its only setting.
+	 *
+	 * The latter two draw no random number and compute no exponential
+	 * per proposal.
+	 */
+	enum class Acceptance { metropolis, threshold, late };
+
+	inline Acceptance acceptance_from_name(const string& name) {
+		if (name == "metropolis")
+			return Acceptance::metropolis;
+		else if (name == "threshold")
+			return Acceptance::threshold;
+		else if (name == "lahc")
+			return Acceptance::late;
+		throw runtime_error("Unknown acceptance rule \"" + name + "\".");
+	}
+
 }
 
 using nanos = std::chrono::nanoseconds;
@@ -122,9 +168,172 @@ public:
 	virtual string get_annealing_filename_for_epoch(int run_id, long epoch) = 0;
 	virtual string get_annealing_filename_for_full_log(int run_id) = 0;
 
+	/* ************************************************** *
+	 * In-place steps.
+	 *
+	 * By default every epoch copies the current state into storage, takes
+	 * a step there with sample_step(...), and computes the objective of
+	 * the copy from scratch.  A derived class whose steps change the
+	 * objective in a way that is cheap to compute may instead override
+	 * the methods below, and then rejected steps cost nothing beyond
+	 * computing that change.
+	 *
+	 * - inplace_supported() says whether the methods below are implemented.
+	 *
+	 * - propose_step(t, rand) samples a step from t, exactly as
+	 *   sample_step(...) would, but only remembers it, and returns the
+	 *   change in the objective that the step would make.
+	 *
+	 * - apply_proposed_step(t) takes the step last proposed, in place,
+	 *   and returns how far the change that propose_step(...) returned
+	 *   was off (the actual change less it).  That is zero, unless the
+	 *   change is only estimated, as for objectives whose exact change
+	 *   costs far more to find than a close estimate; the objective is
+	 *   then kept exact all the same.
+	 */
+	virtual bool inplace_supported() {
+		return false;
+	}
+	virtual double propose_step(const T&, std::mt19937_64&) {
+		throw std::runtime_error("In-place steps are not supported.");
+	}
+	virtual double apply_proposed_step(T&) {
+		throw std::runtime_error("In-place steps are not supported.");
+	}
+
+	/* ************************************************** *
+	 * Rejection-free (or "n-fold way") annealing.
+	 *
+	 * At low temperatures almost every sampled step is rejected, so most
+	 * epochs do no useful work.  A derived class that can enumerate its
+	 * whole neighbourhood of moves may instead keep the Metropolis
+	 * acceptance probability
+	 *
+	 *     w(move) = min(1, exp(-(change in objective) / temperature))
+	 *
+	 * of every move, then choose an accepted move directly with
+	 * probability proportional to w.  When there are M moves with total
+	 * weight W, the ordinary chain would have needed M / W proposals on
+	 * average to accept one, so the epoch counter advances by that much.
+	 *
+	 * Derived classes opt in by overriding all of the methods below.
+	 *
+	 * - rf_supported() says whether the methods below are implemented.
+	 *
+	 * - rf_rebuild(t, temperature) recomputes every weight for state t.
+	 *
+	 * - rf_num_moves() and rf_total_weight() give M and W above.
+	 *
+	 * - rf_step(t, rand) samples one move according to the weights,
+	 *   applies it to t in place, updates the affected weights, and
+	 *   returns the change in the objective.
+	 *
+	 * - rf_rebuild_cost() and rf_step_cost() estimate the time taken by
+	 *   rf_rebuild(...) and by rf_step(...), in ordinary proposals.
+	 *
+	 * Both may cost more than the proposals they save, so the annealer
+	 * only takes rejection-free steps while they pay off; see
+	 * rf_pays_off(...).
+	 */
+	virtual bool rf_supported() {
+		return false;
+	}
+	virtual void rf_rebuild(const T&, double) {
+		throw std::runtime_error("Rejection-free annealing is not supported.");
+	}
+	virtual double rf_num_moves() {
+		throw std::runtime_error("Rejection-free annealing is not supported.");
+	}
+	virtual double rf_total_weight() {
+		throw std::runtime_error("Rejection-free annealing is not supported.");
+	}
+	virtual double rf_step(T&, std::mt19937_64&) {
+		throw std::runtime_error("Rejection-free annealing is not supported.");
+	}
+	virtual double rf_rebuild_cost() {
+		throw std::runtime_error("Rejection-free annealing is not supported.");
+	}
+	virtual double rf_step_cost() {
+		throw std::runtime_error("Rejection-free annealing is not supported.");
+	}
+
+	/* ************************************************** *
+	 * Lazy tracking of the best state.
+	 *
+	 * Each time the objective reaches a new best, the best state must
+	 * be remembered.  Early in a run, and after each drop in temperature,
+	 * that happens on a large fraction of epochs, and copying the whole
+	 * state each time costs O(n).  A derived class whose in-place steps
+	 * are cheap to record may instead keep a journal of them, and then the
+	 * best state is only brought up to date (by replaying the journal)
+	 * when it is saved, when advance(...) returns, or when replaying the
+	 * journal would cost more than a copy.  Remembering a new best then
+	 * costs O(1), and keeping the best state costs no more than the steps
+	 * themselves, nor more than a copy per new best.
+	 *
+	 * Derived classes opt in by overriding all of the methods below.
+	 *
+	 * - journal_supported() says whether the methods below are
+	 *   implemented.  It requires in-place steps.
+	 *
+	 * - Every step taken in place, by apply_proposed_step(...) or by
+	 *   rf_step(...), must be added to the end of the journal.
+	 *
+	 * - journal_size() gives the number of steps in the journal.
+	 *
+	 * - journal_full() says whether replaying the whole journal would
+	 *   now cost more than copying the state with copy_from_to(...).
+	 *
+	 * - journal_replay(t, count) takes the first count steps of the
+	 *   journal on t, in order, and then drops them from the journal.
+	 *
+	 * - journal_clear() drops every step from the journal.
+	 */
+	virtual bool journal_supported() {
+		return false;
+	}
+	virtual size_t journal_size() {
+		throw std::runtime_error("Step journals are not supported.");
+	}
+	virtual bool journal_full() {
+		throw std::runtime_error("Step journals are not supported.");
+	}
+	virtual void journal_replay(T&, size_t) {
+		throw std::runtime_error("Step journals are not supported.");
+	}
+	virtual void journal_clear() {
+		throw std::runtime_error("Step journals are not supported.");
+	}
+
+	/* Switch to rejection-free annealing once the fraction of proposals
+	 * accepted over a window of RF_WINDOW epochs drops below accept_rate,
+	 * and for as long as it pays off (see rf_pays_off(...)).  The default
+	 * of 0 never switches.  Rejection-free annealing keeps a weight for
+	 * every move, O(n^2) of them for segment reversals on n Directions,
+	 * so derived classes refuse it beyond a size (see rf_supported());
+	 * begin_run(...) then warns and anneals as usual.
+	 */
+	void set_rejection_free_below(double accept_rate) {
+		rf_accept_rate = accept_rate;
+	}
+
+	/* Decide on worse steps by rule instead of by the Metropolis rule;
+	 * see cooling::Acceptance.  For late acceptance, history is the
+	 * number of epochs looked back.  Rejection-free annealing only
+	 * applies to the Metropolis rule, and is otherwise never switched to.
+	 */
+	void set_acceptance(cooling::Acceptance rule, size_t history=0) {
+		if (rule == cooling::Acceptance::late and history == 0)
+			throw runtime_error("Late acceptance needs a history of at least one epoch.");
+		acceptance = rule;
+		late_history = history;
+	}
+
 	/* ************************************************** */
 
 	virtual void save_best_state(string filename, bool current_also=false) final {
+		TRACE_SPAN("save_best_state");
+		materialize_best();
 		ofstream o { file_writer(filename) };
 		o.setf(ios_base::fixed);
 		o << setprecision(10);
@@ -135,7 +344,7 @@ public:
 		  << "\nCurrent epoch: " << time_curr.epoch
 		  << "\nTime running (ns): " << time_curr.wall_time_ns.count()
 		  << "\nCooling method description:\n"
-		  << coolfn->descr
+		  << acceptance_descr()
 		  << "\n" << SEPARATOR
 		  << "\nRandom start: "
 		  << get_rand_seed() << "\n"
@@ -166,6 +375,11 @@ public:
 	 *
 	 * - SAVE_TOLERANCE is how much the objective needs to decrease
 	 *   before the state is saved once more.
+	 *
+	 * A run may also be driven piece by piece: call begin_run(...) once,
+	 * then advance(...) as many times as needed (other work, such as
+	 * restart_from(...), may happen between calls), and finally
+	 * finish_run().  The run(...) method does exactly this in one go.
 	 */
 
 	virtual void run(
@@ -173,13 +387,32 @@ public:
 		unsigned long verbose_every=50,
 		const double SAVE_TOLERANCE=0.1
 	) final {
+		begin_run(num_epochs, verbose_every, SAVE_TOLERANCE);
+		advance(num_epochs);
+		finish_run();
+	}
+
+	virtual void begin_run(
+		unsigned long num_epochs,
+		unsigned long verbose_every=50,
+		const double SAVE_TOLERANCE=0.1
+	) final {
+		TRACE_SPAN_ID("anneal: begin_run", run_id);
 		/* NOTE: You cannot construct an mt instance with a non-constant
 		 * or perhaps static integer using its constructor.  However,
 		 * the URL below indicates that there is a way to reset the
 		 * starting state, the seed() method.
 		 *     https://en.cppreference.com/w/cpp/numeric/random/mersenne_twister_engine
+		 *
+		 * Chains other than chain 0 mix their index into the seed, so that
+		 * several chains on one run id explore independently.
 		 */
-		annealer_random_generator.seed(this->get_rand_seed());
+		if (chain_index == 0) {
+			annealer_random_generator.seed(this->get_rand_seed());
+		} else {
+			std::seed_seq seeds { this->get_rand_seed(), chain_index };
+			annealer_random_generator.seed(seeds);
+		}
 
 		cout.setf(ios_base::scientific);
 		cout << setprecision(10);
@@ -187,24 +420,62 @@ public:
 		/* ----------------------------------------
 		 * Set up the full annealing log.
 		 */
-
-		string filename { get_annealing_filename_for_full_log(run_id) };
-		ofstream full_log { file_writer(filename) };
-		full_log << setprecision(10);
-		full_log << "Run id: " << run_id
-				<< "\nBest objective remained constant between epochs listed below."
-				<< "\n(Current objective may have changed, however.)"
-				<< "\nEpoch, Current Objective, Best Objective, Wall Time (ns)\n";
+		if (file_output) {
+			string filename { get_annealing_filename_for_full_log(run_id) };
+			progress.full_log = file_writer(filename);
+			progress.full_log << setprecision(10);
+			progress.full_log << "Run id: " << run_id
+					<< "\nBest objective remained constant between epochs listed below."
+					<< "\n(Current objective may have changed, however.)"
+					<< "\nEpoch, Current Objective, Best Objective, Wall Time (ns)\n";
+		}
+		log_rows.clear();
+
+		if (rf_accept_rate > 0 and acceptance == cooling::Acceptance::metropolis
+				and not rf_supported()) {
+			cerr << "Warning: Run id " << run_id << " cannot switch to"
+					" rejection-free annealing, which needs memory quadratic in"
+					" the number of Directions and is limited to small"
+					" instances; annealing as usual." << endl;
+		}
 
 		state_best = state_curr->duplicate();
+		restart_journal();
 		obj_curr = objective_to_minimize(*state_curr);
 		obj_best = obj_curr;
+		summary = RunSummary {};
+		summary.best_at[0] = obj_curr;
 
 		/* Assign some memory for several different mid-calculation objects,
 		 * rather than reassigning memory at every iteration of the loop.
-		 *
-		 * The values of save_and_log and vb will be decided anew at each epoch
-		 * to determine what output there is:
+		 */
+		progress.state_storage   = state_curr->duplicate();
+		progress.obj_prev_saved  = 10 * max(obj_curr, 1.0);
+		progress.obj_prev_logged = 10 * max(obj_curr, 1.0);
+		progress.verbose_every   = verbose_every;
+		progress.save_tolerance  = SAVE_TOLERANCE;
+		progress.first_epoch     = time_curr.epoch + 1;
+		progress.final_epoch     = time_curr.epoch + num_epochs;
+		progress.vb_prev_epoch   = time_curr.epoch;
+		progress.rf_active         = false;
+		progress.rf_window_accepts = 0;
+		progress.rf_temperature    = 0.0;
+		progress.rf_epoch_carry    = 0.0;
+		progress.threshold         = 0.0;
+		progress.threshold_until   = 0;
+		progress.late_objectives.assign(
+				acceptance == cooling::Acceptance::late ? late_history : 0, obj_curr);
+		progress.next_checkpoint   = 1;
+	}
+
+	/* Runs at most max_epochs further epochs of a run set up by
+	 * begin_run(...).  Returns true if the run still has epochs left.
+	 */
+	virtual bool advance(unsigned long max_epochs) final {
+		TRACE_SPAN_ID("anneal: advance", run_id);
+		COUNT_PHASE(anneal);
+		/* The values of should_save, should_log and should_vb will be
+		 * decided anew at each epoch to determine what output there is:
 		 *
 		 * - should_vb   says whether to write to cout; and
 		 * - should_save says whether to call save_state()
@@ -212,85 +483,178 @@ public:
 		 */
 		bool should_vb {false}, should_save {false}, should_log {false};
 		std::uniform_real_distribution<double> unif {};
-
-		auto state_storage { state_curr->duplicate() };
 		double obj_storage {};
-		double obj_prev_saved  { 10 * max(obj_curr, 1.0)};
-		double obj_prev_logged { 10 * max(obj_curr, 1.0)};
+		auto& state_storage { progress.state_storage };
+
+		/* Rejection-free bookkeeping, kept in progress between calls.
+		 * See the comment above rf_supported().
+		 *
+		 * - rf_active says whether the rejection-free steps have taken over;
+		 * - rf_window_accepts counts accepted proposals in the current
+		 *   window of RF_WINDOW epochs, which decides when to switch; and
+		 * - rf_epoch_carry keeps the fractional part of M / W, so that the
+		 *   epochs skipped are unbiased even though the counter is whole.
+		 */
+		bool& rf_active { progress.rf_active };
+		unsigned long& rf_window_accepts { progress.rf_window_accepts };
+		double& rf_temperature { progress.rf_temperature };
+		double& rf_epoch_carry { progress.rf_epoch_carry };
+
+		const unsigned long final_epoch { progress.final_epoch };
+		const unsigned long first_epoch { progress.first_epoch };
+		const unsigned long stop_epoch {
+				std::min(final_epoch, time_curr.epoch + max_epochs) };
 
 		/* Start the clock and GO! */
-		using clock = std::chrono::high_resolution_clock;
 		auto start { clock::now() };
 		auto temp  { start };
 
-		for (unsigned long epochs_remaining {num_epochs};
-				epochs_remaining > 0;
-				epochs_remaining--) {
-			time_curr.epoch += 1;
-			this->sample_step(*state_curr, *state_storage, annealer_random_generator);
-			obj_storage = this->objective_to_minimize(*state_storage);
-
-			/* The next if-else pair decides whether or not the chain
-			 * will move during this epoch.  In the "if" block,
-			 * the chain automatically moves without computing any
-			 * probabilities.  This is an immediate consequence of the
-			 * form of the probabilities---see the comment within the
-             * else block.
-			 */
-			if (obj_storage < obj_curr) {
-				// Change the current state and update the objective.
-				swap(state_curr, state_storage);
-				obj_curr   = obj_storage;
-
-				if (obj_curr < obj_best) {
-					/* Because the objective went down, we must check
-					 * whether it has beaten the best objective so far.
-					 */
-					time_best.epoch = time_curr.epoch;
-					temp = clock::now();
-					time_curr.wall_time_ns += temp - start;
-					time_best.wall_time_ns  = time_curr.wall_time_ns;
-					start = temp;
-					copy_from_to(*state_curr, *state_best);
-					obj_best = obj_curr;
+		while (time_curr.epoch < stop_epoch) {
+			if (rf_active) {
+				/* Weights were computed at rf_temperature.  When the cooling
+				 * function moves on, they are all recomputed; the objective
+				 * is recomputed too so rounding in the deltas cannot build up.
+				 */
+				double temperature { coolfn->coolingfn(time_curr.epoch + 1) };
+				if (temperature != rf_temperature) {
+					rf_rebuild(*state_curr, temperature);
+					rf_temperature = temperature;
+					obj_curr = objective_to_minimize(*state_curr);
+					/* Whether the next temperatures pay off is judged by
+					 * this one.  Only leave once the steps cost twice what
+					 * they save, so as not to switch back and forth as the
+					 * windows of proposals vary. */
+					if (not rf_pays_off(time_curr.epoch,
+							rf_total_weight() / rf_num_moves(), 2.0)) {
+						rf_active = false;
+						rf_window_accepts = 0;
+						cout << "Run id " << run_id
+								<< " leaving rejection-free annealing at epoch "
+								<< time_curr.epoch << endl;
+						continue;
+					}
+				}
+				rf_epoch_carry += rf_num_moves() / rf_total_weight();
+				double skip { std::floor(rf_epoch_carry) };
+				rf_epoch_carry -= skip;
+				if (skip > final_epoch - time_curr.epoch) {
+					// The next accepted move would come after the run ends.
+					time_curr.epoch = final_epoch;
+				} else {
+					time_curr.epoch += static_cast<unsigned long>(skip);
+					obj_curr += rf_step(*state_curr, annealer_random_generator);
+					check_journal(true);
 				}
 			} else {
-				/* Here is the main appearance of the exponent related to
-				 * the Boltzman distribution.  The probability of switching
-				 * states is the exponent of the value below.  See Häggström's
-				 * book "Finite Markov Chains and Algorithmic Applications"
-                 * for details.
-				 *
-				 * Because of the if statement above, the exponent here, called
-				 * log_move_prob, is always negative.
+				time_curr.epoch += 1;
+				bool inplace { this->inplace_supported() };
+				if (inplace) {
+					obj_storage = obj_curr
+						+ this->propose_step(*state_curr, annealer_random_generator);
+				} else {
+					this->sample_step(*state_curr, *state_storage, annealer_random_generator);
+					obj_storage = this->objective_to_minimize(*state_storage);
+				}
+
+				/* The next if-else pair decides whether or not the chain
+				 * will move during this epoch.  In the "if" block,
+				 * the chain automatically moves without computing any
+				 * probabilities.  This is an immediate consequence of the
+				 * form of the probabilities---see the comment within the
+				 * else block.
 				 */
-				double log_move_prob {
-					(obj_curr - obj_storage)
-						/ coolfn->coolingfn(time_curr.epoch) };
-				if (unif(annealer_random_generator) < std::exp(log_move_prob)) {
+				if (obj_storage < obj_curr) {
 					// Change the current state and update the objective.
-					swap(state_curr, state_storage);
-					obj_curr = obj_storage;
+					obj_curr   = obj_storage + take_step(inplace, state_storage);
+					rf_window_accepts++;
+					check_journal(inplace);
+				} else if (acceptance != cooling::Acceptance::metropolis) {
+					if (accepts_worse(obj_storage)) {
+						obj_curr = obj_storage + take_step(inplace, state_storage);
+						check_journal(inplace);
+					}
+				} else {
+					/* Here is the main appearance of the exponent related to
+					 * the Boltzman distribution.  The probability of switching
+					 * states is the exponent of the value below.  See Häggström's
+					 * book "Finite Markov Chains and Algorithmic Applications"
+					 * for details.
+					 *
+					 * Because of the if statement above, the exponent here, called
+					 * log_move_prob, is always negative.
+					 */
+					double log_move_prob {
+						(obj_curr - obj_storage)
+							/ coolfn->coolingfn(time_curr.epoch) };
+					if (unif(annealer_random_generator) < std::exp(log_move_prob)) {
+						// Change the current state and update the objective.
+						obj_curr = obj_storage + take_step(inplace, state_storage);
+						rf_window_accepts++;
+						check_journal(inplace);
+					}
+				}
+				if (acceptance == cooling::Acceptance::late) {
+					auto& late_objectives { progress.late_objectives };
+					late_objectives[time_curr.epoch % late_objectives.size()] = obj_curr;
 				}
+
+				/* In-place steps only ever add up changes in the objective,
+				 * so now and then recompute it to stop rounding errors from
+				 * building up. */
+				if (inplace and time_curr.epoch % RESYNC_EVERY == 0)
+					obj_curr = objective_to_minimize(*state_curr);
+
+				if (rf_accept_rate > 0 and acceptance == cooling::Acceptance::metropolis
+						and time_curr.epoch % RF_WINDOW == 0) {
+					double accept_rate {
+						static_cast<double>(rf_window_accepts) / RF_WINDOW };
+					rf_active = (rf_supported() and accept_rate < rf_accept_rate
+							and rf_pays_off(time_curr.epoch, accept_rate));
+					rf_window_accepts = 0;
+					if (rf_active) {
+						cout << "Run id " << run_id
+								<< " switching to rejection-free annealing at epoch "
+								<< time_curr.epoch << endl;
+					}
+				}
+			}
+
+			if (obj_curr < obj_best) {
+				/* Because the objective went down, we must check
+				 * whether it has beaten the best objective so far.
+				 */
+				time_best.epoch = time_curr.epoch;
+				temp = clock::now();
+				time_curr.wall_time_ns += temp - start;
+				time_best.wall_time_ns  = time_curr.wall_time_ns;
+				start = temp;
+				remember_best();
+				obj_best = obj_curr;
 			}
 
 			/* ----------------------------------------
 			 * Determine which logs to write.
 			 */
+			bool first_or_last {
+					time_curr.epoch == first_epoch
+					or time_curr.epoch == final_epoch
+				};
 			should_log = (
-					obj_best < obj_prev_logged
-					or epochs_remaining == 1
-					or epochs_remaining == num_epochs
+					obj_best < progress.obj_prev_logged
+					or first_or_last
 				);
 			should_save = (
-					obj_best < obj_prev_saved - SAVE_TOLERANCE
-					or epochs_remaining == 1
-					or epochs_remaining == num_epochs
+					(file_output or save_callback)
+					and (obj_best < progress.obj_prev_saved - progress.save_tolerance
+						 or first_or_last)
 				);
 			should_vb = (
-					verbose_every > 0
-					and time_curr.epoch % verbose_every == 0
+					progress.verbose_every > 0
+					and time_curr.epoch / progress.verbose_every
+						!= progress.vb_prev_epoch / progress.verbose_every
 					);
+			if (should_vb)
+				progress.vb_prev_epoch = time_curr.epoch;
 
 			if (should_log or should_save) {
 				/* Need to update the clock. */
@@ -299,30 +663,163 @@ public:
 				start = stop;
 
 				if (should_save) {
-					save_best_state(get_annealing_filename_for_epoch(run_id, time_curr.epoch));
-					obj_prev_saved = obj_best;
+					if (file_output) {
+						save_best_state(get_annealing_filename_for_epoch(run_id, time_curr.epoch));
+					} else {
+						materialize_best();
+						save_callback(time_curr.epoch, obj_best, *state_best);
+					}
+					progress.obj_prev_saved = obj_best;
 				}
 
 				if (should_log) {
-					full_log << time_curr.epoch << ", "
-							<< obj_curr << ", "
-							<< obj_best << ", "
-							<< time_curr.wall_time_ns.count()
-							<< "\n";
-					obj_prev_logged = obj_best;
+					log_row(LogRow { time_curr.epoch, obj_curr, obj_best,
+									 time_curr.wall_time_ns });
+					progress.obj_prev_logged = obj_best;
 				}
 			}
 
 			if (should_vb) {
-				cout << "Epoch " << time_curr.epoch
-						<< ".  Temperature = "
-						<< coolfn->coolingfn(time_curr.epoch)
-						<< ", Objective = "
+				cout << "Epoch " << time_curr.epoch;
+				if (acceptance == cooling::Acceptance::metropolis)
+					cout << ".  Temperature = " << coolfn->coolingfn(time_curr.epoch);
+				else if (acceptance == cooling::Acceptance::threshold)
+					cout << ".  Threshold = " << coolfn->coolingfn(time_curr.epoch);
+				cout << ", Objective = "
 						<< obj_curr << " (curr) and "
 						<< obj_best << " (best)" << endl;
 			}
 		}
-		full_log.close();
+		/* Between calls, the best state is always up to date, for
+		 * get_best_state() and restart_from(...). */
+		materialize_best();
+		time_curr.wall_time_ns += clock::now() - start;
+		return (time_curr.epoch < final_epoch);
+	}
+
+	virtual void finish_run() final {
+		TRACE_SPAN_ID("anneal: finish_run", run_id);
+		if (progress.full_log.is_open())
+			progress.full_log.close();
+		progress.state_storage.reset();
+		while (progress.next_checkpoint < NUM_CHECKPOINTS)
+			summary.best_at[progress.next_checkpoint++] = obj_best;
+		summary.epoch_best = time_best.epoch;
+		summary.time_to_best = time_best.wall_time_ns;
+		summary.time_running = time_curr.wall_time_ns;
+	}
+
+	/* ************************************************** *
+	 * A summary of the last run, kept whether or not the log goes to a
+	 * file, for tables of many runs (see Results.h):  the best objective
+	 * at the start and after every tenth of the epochs, when the best
+	 * state was found, and when the best objective first dropped below
+	 * the target given to set_target(...), if it did (the time is
+	 * negative otherwise).  Complete once finish_run() is called.
+	 */
+	static constexpr size_t NUM_CHECKPOINTS { 11 };
+
+	struct RunSummary {
+		std::array<double, NUM_CHECKPOINTS> best_at {};
+		unsigned long epoch_best {};
+		nanos time_to_best {};
+		nanos time_running {};
+		nanos time_to_target { -1 };
+	};
+
+	void set_target(double obj) {
+		target = obj;
+	}
+
+	const RunSummary& get_summary() const {
+		return summary;
+	}
+
+	/* ************************************************** *
+	 * Used when several chains anneal the same problem together.
+	 *
+	 * - set_chain_index(k) makes chain k draw from its own random stream.
+	 *
+	 * - set_file_output(false) stops run(...) from writing any files.
+	 *   The rows of the full log are then only kept in get_log_rows().
+	 *
+	 * - restart_from(t, perturb_steps) replaces the current state by t,
+	 *   followed by perturb_steps random steps that are always accepted.
+	 *   The best state is kept unless t (before perturbing) is better.
+	 *
+	 * - start_from(t) makes t the state that the next run starts from,
+	 *   for instance a schedule from a construction heuristic.  Call it
+	 *   before begin_run(...).
+	 */
+	void set_chain_index(int k) {
+		chain_index = k;
+	}
+
+	void set_file_output(bool enabled) {
+		file_output = enabled;
+	}
+
+	/* With file output off, save(epoch, obj_best, best) is called
+	 * wherever run(...) would otherwise have saved the best state to a
+	 * file, for the caller to keep or write as it likes. */
+	using SaveCallback = std::function<void(unsigned long, double, const T&)>;
+
+	void set_save_callback(SaveCallback save) {
+		save_callback = move(save);
+	}
+
+	struct LogRow {
+		unsigned long epoch;
+		double obj_curr;
+		double obj_best;
+		nanos wall_time_ns;
+	};
+
+	const vector<LogRow>& get_log_rows() const {
+		return log_rows;
+	}
+
+	void restart_from(const T& t, unsigned long perturb_steps) {
+		copy_from_to(t, *state_curr);
+		obj_curr = objective_to_minimize(*state_curr);
+		if (obj_curr < obj_best) {
+			time_best = time_curr;
+			copy_from_to(*state_curr, *state_best);
+			obj_best = obj_curr;
+		}
+		auto& state_storage { progress.state_storage };
+		for (unsigned long step {0}; step < perturb_steps; step++) {
+			this->sample_step(*state_curr, *state_storage, annealer_random_generator);
+			swap(state_curr, state_storage);
+		}
+		obj_curr = objective_to_minimize(*state_curr);
+		/* The journal no longer leads from the best state to this one. */
+		if (journal_valid) {
+			this->journal_clear();
+			journal_valid = false;
+		}
+		/* Any rejection-free weights describe the old state. */
+		progress.rf_temperature = 0.0;
+	}
+
+	void start_from(const T& t) {
+		copy_from_to(t, *state_curr);
+	}
+
+	double get_obj_curr() const {
+		return obj_curr;
+	}
+
+	double get_obj_best() const {
+		return obj_best;
+	}
+
+	const T& get_best_state() const {
+		return *state_best;
+	}
+
+	unsigned long get_epoch() const {
+		return time_curr.epoch;
 	}
 
 	const int get_run_id() {
@@ -330,11 +827,163 @@ public:
 	}
 
 private:
+	using clock = std::chrono::high_resolution_clock;
+
 	struct RunningTimeStore {
-		long epoch {};
+		unsigned long epoch {};
 		nanos wall_time_ns {};
 	};
 
+	/* Everything a run needs to carry from one call of advance(...) to
+	 * the next.  See begin_run(...) for the meaning of each.
+	 */
+	struct RunProgress {
+		ofstream full_log {};
+		unique_ptr<T> state_storage {};
+		double obj_prev_saved {};
+		double obj_prev_logged {};
+		unsigned long verbose_every {};
+		double save_tolerance {};
+		unsigned long first_epoch {};
+		unsigned long final_epoch {};
+		unsigned long vb_prev_epoch {};
+		bool rf_active {false};
+		unsigned long rf_window_accepts {};
+		double rf_temperature {};
+		double rf_epoch_carry {};
+		double threshold {};
+		unsigned long threshold_until {};
+		vector<double> late_objectives {};
+		size_t next_checkpoint {};
+	};
+
+	/* Whether rejection-free steps would anneal the epochs after epoch,
+	 * up to the next change of temperature, in less time than proposals,
+	 * given the fraction accept_rate of proposals accepted.  Proposals
+	 * take one unit per epoch; rejection-free steps take a rebuild of the
+	 * weights and then rf_step_cost() per accepted move, which together
+	 * must come to less than factor times the proposals.  A cooling
+	 * function that changes every epoch never pays off.
+	 */
+	bool rf_pays_off(unsigned long epoch, double accept_rate, double factor=1.0) {
+		double epochs { static_cast<double>(
+				coolfn->constant_until(epoch + 1) - static_cast<long>(epoch + 1)) };
+		return rf_rebuild_cost() + epochs * accept_rate * rf_step_cost() < factor * epochs;
+	}
+
+	/* Whether the rule set by set_acceptance(...), other than the
+	 * Metropolis rule, takes a step to an objective of obj_new, no better
+	 * than the current one.  The threshold is only looked up again once
+	 * the cooling function may have changed; late acceptance compares
+	 * against the current objective history.size() epochs ago, which
+	 * advance(...) records after every epoch, and also takes steps that
+	 * leave the objective as it is.
+	 */
+	bool accepts_worse(double obj_new) {
+		if (acceptance == cooling::Acceptance::threshold) {
+			if (time_curr.epoch >= progress.threshold_until) {
+				progress.threshold = coolfn->coolingfn(time_curr.epoch);
+				progress.threshold_until = coolfn->constant_until(time_curr.epoch);
+			}
+			return obj_new - obj_curr < progress.threshold;
+		} else {
+			auto& late_objectives { progress.late_objectives };
+			return (obj_new <= obj_curr
+					or obj_new <= late_objectives[time_curr.epoch % late_objectives.size()]);
+		}
+	}
+
+	/* For the saved states, where pyth/summary.py groups runs by it. */
+	string acceptance_descr() const {
+		if (acceptance == cooling::Acceptance::threshold)
+			return "Threshold accepting, with thresholds following the\n" + coolfn->descr;
+		else if (acceptance == cooling::Acceptance::late)
+			return "Late acceptance hill climbing:\nhistory of "
+					+ to_string(late_history) + " epochs";
+		return coolfn->descr;
+	}
+
+	/* Returns the correction to the objective of the step; see
+	 * apply_proposed_step(...). */
+	double take_step(bool inplace, unique_ptr<T>& state_storage) {
+		if (inplace)
+			return this->apply_proposed_step(*state_curr);
+		swap(state_curr, state_storage);
+		return 0.0;
+	}
+
+	/* The journal, when valid, holds the steps taken since the current
+	 * state last equalled state_best; its first journal_best steps lead
+	 * from state_best to the actual best state.  Once it is invalid, as
+	 * after steps that are not journalled, the next best is copied in
+	 * full and the journal starts again from there.
+	 */
+	void restart_journal() {
+		journal_best = 0;
+		journal_valid = this->journal_supported();
+		if (journal_valid)
+			this->journal_clear();
+	}
+
+	void remember_best() {
+		if (journal_valid)
+			journal_best = this->journal_size();
+		else {
+			copy_from_to(*state_curr, *state_best);
+			restart_journal();
+		}
+	}
+
+	void materialize_best() {
+		if (journal_valid and journal_best > 0) {
+			this->journal_replay(*state_best, journal_best);
+			journal_best = 0;
+		}
+	}
+
+	/* After a step has been taken on the current state.  A full
+	 * journal is first used up to the best state; if it is still full,
+	 * the current state has wandered so far from the best that the next
+	 * best is cheaper to copy than to replay.  An invalid journal is
+	 * only ever emptied. */
+	void check_journal(bool inplace) {
+		if (not inplace) {
+			journal_valid = false;
+		} else if (this->journal_supported() and this->journal_full()) {
+			materialize_best();
+			if (this->journal_full()) {
+				this->journal_clear();
+				journal_valid = false;
+			}
+		}
+	}
+
+	void log_row(const LogRow& row) {
+		/* The checkpoints before this row had the best objective of the
+		 * row before, or the objective at the start before any row. */
+		auto& next { progress.next_checkpoint };
+		while (next < NUM_CHECKPOINTS and checkpoint_epoch(next) < row.epoch)
+			summary.best_at[next++] = std::min(progress.obj_prev_logged, summary.best_at[0]);
+		if (summary.time_to_target.count() < 0 and row.obj_best < target)
+			summary.time_to_target = row.wall_time_ns;
+
+		if (file_output) {
+			progress.full_log << row.epoch << ", "
+					<< row.obj_curr << ", "
+					<< row.obj_best << ", "
+					<< row.wall_time_ns.count()
+					<< "\n";
+		} else {
+			log_rows.push_back(row);
+		}
+	}
+
+	/* The last epoch of the k-th tenth of the run. */
+	unsigned long checkpoint_epoch(size_t k) const {
+		unsigned long num_epochs { progress.final_epoch + 1 - progress.first_epoch };
+		return progress.first_epoch - 1 + num_epochs * k / (NUM_CHECKPOINTS - 1);
+	}
+
 	const int run_id;
 	unique_ptr<cooling::CoolingFn> coolfn;
 	unique_ptr<T> state_curr;
@@ -344,4 +993,22 @@ private:
 	RunningTimeStore time_curr;
 	RunningTimeStore time_best;
 	std::mt19937_64 annealer_random_generator;
+	RunProgress progress {};
+
+	int chain_index {0};
+	bool file_output {true};
+	SaveCallback save_callback {};
+	vector<LogRow> log_rows {};
+	RunSummary summary {};
+	double target { -numeric_limits<double>::infinity() };
+
+	static constexpr unsigned long RF_WINDOW { 10'000 };
+	static constexpr unsigned long RESYNC_EVERY { 1'000'000 };
+	double rf_accept_rate {0.0};
+
+	cooling::Acceptance acceptance {cooling::Acceptance::metropolis};
+	size_t late_history {0};
+
+	bool journal_valid {false};
+	size_t journal_best {0};
 };
@@ -0,0 +1,277 @@
+#pragma once
+
+#include "includes.h"
+#include "Direction.h"
+#include "Schedule.h"
+
+/* ************************************************** *
+ * Targets that drift across the sky as the Earth turns.
+ *
+ * With the --sky option, each input Direction is read as a target on
+ * the celestial sphere rather than as angles of the mount:  theta is its
+ * right ascension and phi its declination, both in radians, which fill
+ * exactly the ranges of the usual input.  Where the mount must point for
+ * a target then depends on the time.  The local sidereal time advances
+ * at SIDEREAL_RATE, which turns each target's hour angle, and with it
+ * its altitude and azimuth.  The mount angles follow the convention of
+ * the README:  theta is the azimuth, and phi the angle from the zenith
+ * (90 degrees less the altitude), the other rep being (theta + pi, -phi)
+ * as ever.  Whether a target is above the horizon is not checked.
+ *
+ * A schedule starts at time 0 at its first target.  At each target the
+ * telescope stays for a fixed dwell time, tracking the target, and then
+ * slews to the next target at the rate of the site, both axes turning at
+ * once, as in the README.  A slew is costed between where both targets
+ * are when it starts, as targets drift far more slowly than the mount
+ * turns.  The objective is the total time spent slewing, in seconds.
+ */
+namespace sky {
+
+	/* Radians of sidereal time per second. */
+	constexpr double SIDEREAL_RATE { 7.2921159e-5 };
+
+	/* The observing site.  Spec, as given to --sky:
+	 * "LATITUDE,SIDEREAL_START,SLEW_RATE,DWELL", the latitude and the
+	 * local sidereal time at the start in radians, the slew rate of each
+	 * axis in radians per second, and the dwell in seconds. */
+	struct Site {
+		double latitude {0.0};
+		double sidereal_start {0.0};
+		double slew_rate {0.035};
+		double dwell {0.0};
+
+		static Site from_spec(const string& spec) {
+			vector<double> params {};
+			stringstream ss { spec };
+			string item {};
+			while (getline(ss, item, ','))
+				params.push_back(stod(item));
+			if (params.size() != 4) {
+				throw runtime_error("Sky site \"" + spec + "\" needs 4 parameters:"
+						" latitude, sidereal start, slew rate and dwell.");
+			}
+			Site site { params[0], params[1], params[2], params[3] };
+			if (std::abs(site.latitude) > PI / 2 or not (site.slew_rate > 0.0)
+					or site.dwell < 0.0) {
+				throw runtime_error("Sky site \"" + spec + "\" needs a latitude"
+						" within +-pi/2, a positive slew rate and a dwell of"
+						" at least 0.");
+			}
+			return site;
+		}
+	};
+
+	class Sky {
+	public:
+		Sky(const DirectionDatabase& targets, const Site& site) :
+			site {site},
+			sin_lat {std::sin(site.latitude)},
+			cos_lat {std::cos(site.latitude)} {
+			size_t num_dir { targets.get_num_directions_defined() };
+			stars.reserve(num_dir);
+			for (dir_id_t id {0}; id < num_dir; id++) {
+				const Direction& d { targets.get_direction(id, false) };
+				stars.push_back({ d.get_theta(), std::sin(d.get_phi()),
+								  std::cos(d.get_phi()), d.input_id });
+			}
+		}
+		~Sky() = default;
+		Sky(Sky&)  = delete;
+		Sky(Sky&&) = delete;
+
+		const Site& get_site() const {
+			return site;
+		}
+
+		size_t get_num_targets() const {
+			return stars.size();
+		}
+
+		struct Mount {
+			double theta, phi;
+		};
+
+		/* Where the mount points for target id at time t, in the given rep. */
+		Mount mount_at(dir_id_t id, bool other_rep, double t) const {
+			const Star& star { stars[id] };
+			double hour_angle { site.sidereal_start + SIDEREAL_RATE * t - star.ra };
+			double sin_ha { std::sin(hour_angle) }, cos_ha { std::cos(hour_angle) };
+			double sin_alt { star.sin_dec * sin_lat + star.cos_dec * cos_lat * cos_ha };
+			double azimuth { std::atan2(-star.cos_dec * sin_ha,
+						star.sin_dec * cos_lat - star.cos_dec * sin_lat * cos_ha) };
+			double theta { azimuth < 0.0 ? azimuth + TWO_PI : azimuth };
+			double phi { PI / 2 - std::asin(std::clamp(sin_alt, -1.0, 1.0)) };
+			if (other_rep) {
+				theta = (theta < PI ? theta + PI : theta - PI);
+				phi = -phi;
+			}
+			return { theta, phi };
+		}
+
+		/* Seconds to slew from target a, tracked until time t, to target
+		 * b.  Switching both reps leaves this unchanged, as for the
+		 * metrics of Metrics.h. */
+		double slew(dir_id_t a, bool other_a, dir_id_t b, bool other_b, double t) const {
+			Mount ma { mount_at(a, other_a, t) };
+			Mount mb { mount_at(b, other_b, t) };
+			double dtheta { std::abs(ma.theta - mb.theta) };
+			if (dtheta > PI)
+				dtheta = TWO_PI - dtheta;
+			return std::max(dtheta, std::abs(ma.phi - mb.phi)) / site.slew_rate;
+		}
+
+		/* The targets as the mount sees them at time t. */
+		shared_ptr<DirectionDatabase> directions_at(double t) const {
+			auto dirdata { make_shared<DirectionDatabase>(stars.size()) };
+			for (dir_id_t id {0}; id < stars.size(); id++) {
+				Mount m { mount_at(id, false, t) };
+				dirdata->place_direction(Direction { id, m.theta, m.phi,
+												stars[id].input_id });
+			}
+			return dirdata;
+		}
+
+	private:
+		struct Star {
+			double ra, sin_dec, cos_dec;
+			dir_id_t input_id;
+		};
+
+		Site site;
+		double sin_lat, cos_lat;
+		vector<Star> stars {};
+	};
+
+	/* ************************************************** *
+	 * The times along one schedule, kept so that the change made by a
+	 * segment reversal is found in time independent of the length of the
+	 * schedule after the segment.
+	 *
+	 * Write c_q for the time of slew q (from the q-th Direction of the
+	 * schedule to the next) and r_q for its rate of change with the time
+	 * at which it starts.  Reversing the Directions at i, ..., j leaves
+	 * everything before i as it was, and changes two slews outright, at
+	 * the ends of the segment; those two are found exactly, at the
+	 * nearest estimate of when they start.  The slews inside the segment
+	 * are the same pairs of Directions as before (the same slew forwards
+	 * or backwards, with either rep of both), only starting at other
+	 * times.  Each time moves linearly with q and with the sum P[q] of
+	 * the slews before it, so the change in all of them together, to
+	 * first order, is a combination of prefix sums of r_q, q r_q and
+	 * (P[q] + P[q+1]) r_q.  Everything after the segment merely starts
+	 * later or earlier by some shift D, which to first order grows to
+	 * D (1 + sum of r_q over the slews left) by the end.
+	 *
+	 * The error is second order in the shifts, but the slews are not
+	 * smooth in time (the Chebyshev distance switches axes, and azimuths
+	 * wrap), so it only stays small while the shifts do.  A segment whose
+	 * slews would move by more than LINEAR_SHIFT is walked instead, in
+	 * time O(j - i).  The shift after the segment is always taken to
+	 * first order; on 400 targets, changes of about a minute come out
+	 * off by a few seconds, seldom by more than twenty.  That only blurs
+	 * which steps are accepted:  taking a step rebuilds the times from the
+	 * segment on, exactly, so that errors never build up; see
+	 * apply_proposed_step(...) in SimAnneal.h.
+	 */
+	class Timeline {
+	public:
+		Timeline(shared_ptr<const Sky> sky) :
+			sky {sky} {}
+		~Timeline() = default;
+
+		/* Recomputes every time after the first i Directions of s. */
+		template<typename S>
+		void rebuild(const S& s, size_t i=0) {
+			size_t n { s.get_num_dir() };
+			double dwell { sky->get_site().dwell };
+			if (arrive.size() != n) {
+				ids.assign(n, 0);
+				reps.assign(n, false);
+				arrive.assign(n, 0.0);
+				prefix.assign(n, 0.0);
+				rate_sum.assign(n, 0.0);
+				rate_q_sum.assign(n, 0.0);
+				rate_p_sum.assign(n, 0.0);
+				i = 0;
+			}
+			for (size_t k {i}; k < n; k++) {
+				ids[k] = s.get_id_at(k);
+				reps[k] = s.is_other_at(k);
+			}
+			/* Slew q - 1 ends at Direction q, so it is the first to redo. */
+			for (size_t k { std::max<size_t>(i, 1) }; k < n; k++) {
+				size_t q { k - 1 };
+				double depart { arrive[q] + dwell };
+				double cost { sky->slew(ids[q], reps[q], ids[k], reps[k], depart) };
+				double rate { (sky->slew(ids[q], reps[q], ids[k], reps[k],
+							depart + RATE_STEP) - cost) / RATE_STEP };
+				arrive[k] = depart + cost;
+				prefix[k] = prefix[q] + cost;
+				rate_sum[k] = rate_sum[q] + rate;
+				rate_q_sum[k] = rate_q_sum[q] + q * rate;
+				rate_p_sum[k] = rate_p_sum[q] + (prefix[q] + prefix[k]) * rate;
+			}
+		}
+
+		/* The total time spent slewing. */
+		double objective() const {
+			return prefix.empty() ? 0.0 : prefix.back();
+		}
+
+		/* The change in objective() from reversing the Directions at
+		 * indices i, ..., j (1 <= i, j), switching their reps if
+		 * switch_rep, estimated as explained above. */
+		double reversal_delta(size_t i, size_t j, bool switch_rep) const {
+			if (i > j)
+				std::swap(i, j);
+			size_t n { arrive.size() };
+			double dwell { sky->get_site().dwell };
+
+			double depart { arrive[i-1] + dwell };
+			double arrive_i { depart + sky->slew(ids[i-1], reps[i-1],
+						ids[j], reps[j] != switch_rep, depart) };
+			double arrive_j {};
+			if (std::abs(arrive_i - arrive[i]) + (arrive[j] - arrive[i]) <= LINEAR_SHIFT) {
+				double inside { (arrive_i + prefix[j] + (j - 1) * dwell)
+									* (rate_sum[j] - rate_sum[i])
+								- (rate_p_sum[j] - rate_p_sum[i])
+								- 2 * dwell * (rate_q_sum[j] - rate_q_sum[i]) };
+				arrive_j = arrive_i + (j - i) * dwell + (prefix[j] - prefix[i]) + inside;
+			} else {
+				/* Too far from the times of the current schedule:  walk the
+				 * segment, from Direction j back to Direction i. */
+				arrive_j = arrive_i;
+				for (size_t k {j}; k > i; k--) {
+					depart = arrive_j + dwell;
+					arrive_j = depart + sky->slew(ids[k], reps[k] != switch_rep,
+							ids[k-1], reps[k-1] != switch_rep, depart);
+				}
+			}
+			if (j + 1 == n)
+				return arrive_j - arrive[j];
+
+			depart = arrive_j + dwell;
+			double arrive_after { depart + sky->slew(ids[i], reps[i] != switch_rep,
+						ids[j+1], reps[j+1], depart) };
+			double shift { arrive_after - arrive[j+1] };
+			return shift * (1.0 + rate_sum[n-1] - rate_sum[j+1]);
+		}
+
+	private:
+		/* Seconds over which each slew's rate of change is measured. */
+		static constexpr double RATE_STEP { 1.0 };
+		/* Seconds by which the slews inside a segment may move, at most,
+		 * for their change to be taken to first order. */
+		static constexpr double LINEAR_SHIFT { 300.0 };
+
+		shared_ptr<const Sky> sky;
+		vector<dir_id_t> ids {};
+		vector<bool> reps {};
+		vector<double> arrive {};      // when each Direction is reached
+		vector<double> prefix {};      // P[k], the slews before Direction k
+		vector<double> rate_sum {};    // sum of r_q for q < k
+		vector<double> rate_q_sum {};  // sum of q r_q for q < k
+		vector<double> rate_p_sum {};  // sum of (P[q] + P[q+1]) r_q for q < k
+	};
+
+} // namespace sky
@@ -0,0 +1,142 @@
+#include "Solver.h"
+
+#include "SimAnneal.h"
+#include "TelAnnealer.h"
+#include "TelConstructor.h"
+#include "Trace.h"
+#include "TwoLevelSchedule.h"
+
+namespace {
+	using clock_type = chrono::high_resolution_clock;
+}
+
+/* ************************************************** */
+
+Solver::Solver(shared_ptr<DirectionDatabase> dirdata, const RunSettings& settings) :
+	dirdata {dirdata},
+	settings {settings} {
+	if (not dirdata or dirdata->get_num_directions_defined() == 0)
+		throw runtime_error("A Solver needs at least one Direction.");
+	check(settings, false);
+}
+
+shared_ptr<DirectionDatabase> Solver::directions_from(const double* theta,
+		const double* phi, size_t count) {
+	auto dirdata { make_shared<DirectionDatabase>(count) };
+	for (size_t k {0}; k < count; k++)
+		dirdata->place_direction(Direction { static_cast<dir_id_t>(k), theta[k], phi[k] });
+	return dirdata;
+}
+
+void Solver::check(const RunSettings& settings, bool annealing) {
+	if (annealing and (settings.num_epochs <= 0 or settings.cool_init <= 0.0
+			or settings.cool_base <= 0.0 or settings.cool_base >= 1.0
+			or settings.cool_flat_epochs <= 0)) {
+		throw runtime_error("Settings out of range; see the usage message"
+				" for the positional arguments.");
+	} else if (settings.islands > 1 or settings.region_size > 0
+			or settings.memetic > 0 or not settings.sky.empty()) {
+		throw runtime_error("Islands, decomposition, memetic annealing and"
+				" the sky are not available in service mode or to an embedded"
+				" Solver.");
+	} else if (settings.metric != "chebyshev") {
+		throw runtime_error("Only the chebyshev metric is available in"
+				" service mode or to an embedded Solver.");
+	} else if (settings.renumber != "none") {
+		throw runtime_error("Renumbering is not available in service mode or"
+				" to an embedded Solver, whose ids are the caller's.");
+	} else if (settings.lanes > 0 or settings.fixed_point_bits > 0
+			or settings.time_slice > 0) {
+		throw runtime_error("Lock-step lanes and time slices are not available"
+				" in service mode or to an embedded Solver, which solve one"
+				" problem at a time.");
+	}
+}
+
+Solver::Result Solver::solve(const string& method, bool without_second_rep,
+		int seed, const Callbacks& callbacks) const {
+	if (method != "anneal") {
+		auto start { clock_type::now() };
+		auto sch { construction::build(method, dirdata, without_second_rep, settings) };
+		double objective { sch->total_distance() };
+		nanos elapsed { clock_type::now() - start };
+		return { move(sch), objective, elapsed, elapsed };
+	}
+
+	/* The same choice of schedule type as Main.cpp. */
+	bool fits_16 { BasicSchedule<uint16_t>::fits(*dirdata) };
+	if (settings.two_level_list)
+		return anneal<TwoLevelSchedule>(without_second_rep, seed, callbacks);
+	else if (without_second_rep and fits_16)
+		return anneal<BasicSchedule<uint16_t, SingleRep>>(without_second_rep, seed, callbacks);
+	else if (without_second_rep)
+		return anneal<BasicSchedule<dir_id_t, SingleRep>>(without_second_rep, seed, callbacks);
+	else if (fits_16)
+		return anneal<BasicSchedule<uint16_t, DualRep>>(without_second_rep, seed, callbacks);
+	else
+		return anneal<BasicSchedule<dir_id_t, DualRep>>(without_second_rep, seed, callbacks);
+}
+
+template<typename S>
+Solver::Result Solver::anneal(bool without_second_rep, int seed,
+		const Callbacks& callbacks) const {
+	TRACE_SPAN_ID("solver: anneal", seed);
+	check(settings);
+	auto start { clock_type::now() };
+
+	double cool_init { settings.cool_init };
+	unique_ptr<S> start_state {};
+	if (settings.start != "identity") {
+		auto start_sch { construction::build(settings.start, dirdata,
+								without_second_rep, settings) };
+		cool_init = construction::seeded_cool_init(settings, *start_sch, dirdata);
+		start_state = construction::convert<S>(*start_sch, dirdata);
+	}
+
+	unique_ptr<cooling::CoolingFn> coolptr {
+		new cooling::PiecewiseConstGeomCool
+				{ cool_init, settings.cool_base, settings.cool_flat_epochs }
+	};
+	TelAnnealerFor<S> annealer { seed, move(coolptr), dirdata, without_second_rep };
+	annealer.set_rejection_free_below(settings.rejection_free_below);
+	annealer.set_acceptance(cooling::acceptance_from_name(settings.acceptance),
+							settings.lahc_history);
+	annealer.set_file_output(false);
+	if (callbacks.save) {
+		auto dirdata_ { dirdata };
+		auto& save { callbacks.save };
+		annealer.set_save_callback([&save, dirdata_] (unsigned long epoch,
+					double obj_best, const S& best) {
+			save(epoch, obj_best, *construction::convert<Schedule>(best, dirdata_));
+		});
+	}
+	if (start_state)
+		annealer.start_from(*start_state);
+
+	unsigned long num_epochs { static_cast<unsigned long>(settings.num_epochs) };
+	unsigned long chunk { (callbacks.progress and callbacks.progress_every > 0)
+							? callbacks.progress_every : num_epochs };
+	annealer.begin_run(num_epochs, 0, callbacks.save_tolerance);
+	while (annealer.advance(chunk)) {
+		callbacks.progress(annealer.get_epoch(), annealer.get_obj_curr(),
+							annealer.get_obj_best());
+	}
+	annealer.finish_run();
+
+	Result result {
+		construction::convert<Schedule>(annealer.get_best_state(), dirdata),
+		annealer.get_obj_best(),
+		clock_type::now() - start,
+		nanos {0},
+		annealer.get_epoch()
+	};
+	/* The log has a row wherever the best objective dropped. */
+	for (auto& row : annealer.get_log_rows()) {
+		if (row.obj_best <= result.objective) {
+			result.time_to_best = row.wall_time_ns;
+			result.epoch_best = row.epoch;
+			break;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "includes.h"
+
+#include <functional>
+
+#include "Direction.h"
+#include "RunSettings.h"
+#include "Schedule.h"
+
+using nanos = std::chrono::nanoseconds;
+
+class Solver {
+/* The solvers as a library, for embedding in another program:  the
+ * Directions come from memory, the settings from a RunSettings, and the
+ * best schedule, its objective and timings come back in memory.  Nothing
+ * is read from or written to disk; progress reports and the states that
+ * a run from the command line would save are passed to callbacks, if
+ * given.  For example:
+ *
+ *     auto dirdata { Solver::directions_from(theta, phi, n) };
+ *     RunSettings settings {};
+ *     settings.num_epochs = 1'000'000;
+ *     ... and cool_init, cool_base and cool_flat_epochs
+ *     Solver solver { dirdata, settings };
+ *     Solver::Result result { solver.solve("anneal", false) };
+ *
+ * A Solver may solve any number of times, from any number of threads at
+ * once.  As in service mode (see SolverDaemon.h), which is built on it,
+ * islands, decomposition, lock-step lanes and metrics other than the
+ * default one are not available, as they are all built around output
+ * files or batches of run ids.
+ */
+public:
+	Solver(shared_ptr<DirectionDatabase> dirdata, const RunSettings& settings);
+	~Solver() = default;
+	Solver(Solver&)  = delete;
+	Solver(Solver&&) = delete;
+
+	/* Directions 0, ..., count - 1, with the angles theta[k] and phi[k]
+	 * (see the README for their ranges). */
+	static shared_ptr<DirectionDatabase> directions_from(const double* theta,
+			const double* phi, size_t count);
+
+	/* Throws an error message if settings ask for something that the
+	 * Solver cannot do, or, when annealing, are out of range for it. */
+	static void check(const RunSettings& settings, bool annealing=true);
+
+	/* All optional.
+	 *
+	 * - progress(epoch, obj_curr, obj_best) is called every
+	 *   progress_every epochs of annealing, while epochs remain.
+	 *
+	 * - save(epoch, obj_best, best) is called whenever a run from the
+	 *   command line would save the best state, i.e. once the best
+	 *   objective has dropped by save_tolerance, and at the first and
+	 *   last epochs.
+	 */
+	struct Callbacks {
+		unsigned long progress_every {0};
+		std::function<void(unsigned long, double, double)> progress {};
+		std::function<void(unsigned long, double, const Schedule&)> save {};
+		double save_tolerance {0.1};
+	};
+
+	/* The best schedule found and its objective.  The time taken counts
+	 * from the call, including any construction of a starting schedule;
+	 * the time to the best schedule counts from the start of annealing,
+	 * as in the annealing logs, and is the whole time for a heuristic. */
+	struct Result {
+		unique_ptr<Schedule> schedule;
+		double objective;
+		nanos time_total;
+		nanos time_to_best;
+		unsigned long epochs {0};
+		unsigned long epoch_best {0};
+	};
+
+	/* Solves by method:  "anneal", as set by the settings, or one of the
+	 * construction heuristics of TelConstructor.h ("greedy", "sfc",
+	 * "greedy-edge" or "nn").  Annealing draws from the random stream of
+	 * run id seed.
+	 */
+	Result solve(const string& method, bool without_second_rep, int seed,
+				const Callbacks& callbacks) const;
+	Result solve(const string& method, bool without_second_rep, int seed=0) const {
+		return solve(method, without_second_rep, seed, Callbacks {});
+	}
+
+private:
+	template<typename S>
+	Result anneal(bool without_second_rep, int seed, const Callbacks& callbacks) const;
+
+	shared_ptr<DirectionDatabase> dirdata;
+	RunSettings settings;
+};
@@ -0,0 +1,438 @@
+#include "SolverDaemon.h"
+
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Affinity.h"
+#include "Solver.h"
+#include "TelReplanner.h"
+#include "Trace.h"
+
+/* The schedule of a finished job, kept for re-planning.  Re-plans of
+ * one job take turns, under the mutex. */
+struct Session {
+	std::mutex lock {};
+	unique_ptr<TelReplanner> replanner {};
+};
+
+/* ************************************************** *
+ * One client.  Replies are written whole, under the mutex, so that the
+ * lines of replies from different workers never interleave.
+ */
+struct SolverDaemon::Connection {
+	int fd_in, fd_out;
+	bool owns_fds;
+	std::mutex write_mutex {};
+
+	std::map<string, shared_ptr<Session>> sessions {};
+	std::mutex sessions_mutex {};
+
+	Connection(int fd_in, int fd_out, bool owns_fds) :
+		fd_in {fd_in}, fd_out {fd_out}, owns_fds {owns_fds} {}
+
+	~Connection() {
+		if (owns_fds)
+			close(fd_in);
+	}
+
+	/* Fails quietly if the client has gone away. */
+	void send(const string& reply) {
+		lock_guard<mutex> lock {write_mutex};
+		size_t written {0};
+		while (written < reply.size()) {
+			ssize_t n { write(fd_out, reply.data() + written, reply.size() - written) };
+			if (n <= 0)
+				return;
+			written += n;
+		}
+	}
+
+	void keep(const string& name, shared_ptr<Session> session) {
+		lock_guard<mutex> lock {sessions_mutex};
+		sessions[name] = session;
+	}
+
+	void forget(const string& name) {
+		lock_guard<mutex> lock {sessions_mutex};
+		sessions.erase(name);
+	}
+
+	shared_ptr<Session> find(const string& name) {
+		lock_guard<mutex> lock {sessions_mutex};
+		auto found { sessions.find(name) };
+		if (found == sessions.end())
+			throw runtime_error("No finished job named \"" + name + "\".");
+		return found->second;
+	}
+};
+
+struct SolverDaemon::Job {
+	string name;
+	RunSettings settings;
+	bool without_second_rep {false};
+	int seed {0};
+	unsigned long progress_every {0};
+	shared_ptr<DirectionDatabase> dirdata {};
+};
+
+namespace {
+
+	/* Reads lines from a file descriptor, giving up when stopping is set
+	 * (checked every POLL_MS) so that no reader blocks a shutdown.
+	 */
+	class LineReader {
+	public:
+		LineReader(int fd, const std::atomic<bool>& stopping) :
+			fd {fd}, stopping {stopping} {}
+
+		bool read_line(string& line) {
+			constexpr int POLL_MS { 200 };
+			while (true) {
+				if (auto nl { buffer.find('\n', start) }; nl != string::npos) {
+					line.assign(buffer, start, nl - start);
+					if (not line.empty() and line.back() == '\r')
+						line.pop_back();
+					start = nl + 1;
+					return true;
+				}
+				buffer.erase(0, start);
+				start = 0;
+
+				pollfd p { fd, POLLIN, 0 };
+				int ready { poll(&p, 1, POLL_MS) };
+				if (stopping)
+					return false;
+				if (ready == 0 or (ready < 0 and errno == EINTR))
+					continue;
+				char chunk[1 << 16];
+				ssize_t n { read(fd, chunk, sizeof(chunk)) };
+				if (n <= 0) {
+					// End of input.  A last line may lack its newline.
+					if (buffer.empty())
+						return false;
+					line = buffer;
+					buffer.clear();
+					return true;
+				}
+				buffer.append(chunk, n);
+			}
+		}
+
+	private:
+		int fd;
+		const std::atomic<bool>& stopping;
+		string buffer {};
+		size_t start {0};
+	};
+
+	/* Error messages may span lines, but a reply line may not. */
+	string one_line(string message) {
+		std::replace(message.begin(), message.end(), '\n', ' ');
+		return message;
+	}
+
+	/* Each worker formats its replies here, so the buffer grows to fit
+	 * the largest schedule once and is reused for every problem after. */
+	thread_local ostringstream reply_buffer {};
+
+	ostringstream& start_reply() {
+		reply_buffer.str("");
+		reply_buffer.clear();
+		reply_buffer.setf(ios_base::fixed, ios_base::floatfield);
+		reply_buffer << setprecision(10);
+		return reply_buffer;
+	}
+
+	/* ************************************************** */
+
+	SolverDaemon::Job parse_job(const string& name, const vector<string>& lines,
+								const RunSettings& defaults) {
+		SolverDaemon::Job job { name, defaults };
+		bool given[4] {};
+		size_t k {0};
+		for (; k < lines.size() and lines[k].rfind("directions ", 0) != 0; k++) {
+			const string& line { lines[k] };
+			if (is_option(line)) {
+				apply_option(job.settings, line);
+				continue;
+			}
+			auto match = wrap_regex_match(line, "([a-z\\-]+)=([0-9_.a-z]+)",
+					"Expected a setting \"name=value\" but found \"" + line + "\"");
+			string key { match[1] };
+			string value { match[2] };
+			value.erase(std::remove(value.begin(), value.end(), '_'), value.end());
+			/* The conversions only say which of them failed, so name the
+			 * setting instead. */
+			try {
+				if (key == "epochs") {
+					job.settings.num_epochs = stol(value);
+					given[0] = true;
+				} else if (key == "cool-init") {
+					job.settings.cool_init = stod(value);
+					given[1] = true;
+				} else if (key == "cool-base") {
+					job.settings.cool_base = stod(value);
+					given[2] = true;
+				} else if (key == "cool-flat-epochs") {
+					job.settings.cool_flat_epochs = stol(value);
+					given[3] = true;
+				} else if (key == "second-rep") {
+					wrap_regex_match(value, "true|false",
+							"Setting second-rep must be true or false.");
+					job.without_second_rep = (value == "false");
+				} else if (key == "seed") {
+					job.seed = stoi(value);
+				} else if (key == "progress-every") {
+					job.progress_every = stoul(value);
+				} else {
+					throw runtime_error("Unknown setting \"" + key + "\".");
+				}
+			} catch (std::invalid_argument&) {
+				throw runtime_error("bad value '" + value + "' for " + key);
+			} catch (std::out_of_range&) {
+				throw runtime_error("bad value '" + value + "' for " + key);
+			}
+		}
+		if (not (given[0] and given[1] and given[2] and given[3])) {
+			throw runtime_error("Settings epochs, cool-init, cool-base and"
+					" cool-flat-epochs are all required.");
+		}
+		Solver::check(job.settings);
+		if (k == lines.size()) {
+			throw runtime_error("No \"directions N\" line.");
+		}
+
+		size_t num_dir { stoul(lines[k].substr(string_view("directions ").length())) };
+		if (num_dir == 0 or lines.size() - k - 1 != num_dir) {
+			throw runtime_error("Expected " + to_string(num_dir) + " Directions"
+					" but found " + to_string(lines.size() - k - 1) + ".");
+		}
+		job.dirdata = make_shared<DirectionDatabase>(num_dir);
+		for (k++; k < lines.size(); k++)
+			job.dirdata->place_direction(Direction::read_from(lines[k]));
+		return job;
+	}
+
+	template<typename S>
+	string result_reply(const string& name, double objective,
+						nanos elapsed, const S& sch) {
+		auto& o { start_reply() };
+		o << "result " << name
+		  << ' ' << objective
+		  << ' ' << elapsed.count()
+		  << ' ' << sch.get_num_dir() << '\n'
+		  << sch
+		  << "done " << name << '\n';
+		return o.str();
+	}
+
+	/* ************************************************** */
+
+	void solve(const SolverDaemon::Job& job, SolverDaemon::Connection& conn) {
+		TRACE_SPAN("daemon: solve");
+		Solver::Callbacks callbacks {};
+		callbacks.progress_every = job.progress_every;
+		callbacks.progress = [&] (unsigned long epoch, double obj_curr, double obj_best) {
+			start_reply() << "progress " << job.name
+					<< ' ' << epoch
+					<< ' ' << obj_curr
+					<< ' ' << obj_best << '\n';
+			conn.send(reply_buffer.str());
+		};
+		Solver::Result result { Solver { job.dirdata, job.settings }.solve(
+				"anneal", job.without_second_rep, job.seed, callbacks) };
+
+		/* Keep the result before saying so, for any re-plans to follow. */
+		auto session { make_shared<Session>() };
+		session->replanner = make_unique<TelReplanner>(job.seed, job.dirdata,
+				*result.schedule, job.without_second_rep);
+		conn.keep(job.name, session);
+
+		conn.send(result_reply(job.name, result.objective, result.time_total,
+								*result.schedule));
+	}
+
+} // namespace
+
+/* ************************************************** */
+
+SolverDaemon::SolverDaemon(size_t num_workers, const RunSettings& defaults) :
+	defaults {defaults},
+	pool {num_workers, [pin = defaults.pin, topology = CpuTopology::detect()] (size_t k) {
+		TRACE_THREAD_NAME("daemon worker " + to_string(k));
+		try {
+			pin_worker(topology, pin, k);
+		} catch (exception& e) {
+			cerr << "Warning: " << e.what() << endl;
+		}
+	}} {
+	/* A client hanging up must not kill the daemon. */
+	std::signal(SIGPIPE, SIG_IGN);
+}
+
+void SolverDaemon::serve_stdio() {
+	/* stdout now carries the protocol alone. */
+	auto cout_buffer { cout.rdbuf(cerr.rdbuf()) };
+	serve_connection(make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO, false));
+	cout.rdbuf(cout_buffer);
+}
+
+void SolverDaemon::serve_socket(const string& socket_path) {
+	sockaddr_un address {};
+	address.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(address.sun_path)) {
+		throw runtime_error("Socket path \"" + socket_path + "\" is too long.");
+	}
+	std::copy(socket_path.begin(), socket_path.end(), address.sun_path);
+
+	int listener { socket(AF_UNIX, SOCK_STREAM, 0) };
+	if (listener < 0)
+		throw runtime_error("Could not create a socket.");
+	unlink(socket_path.c_str());
+	if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+			or listen(listener, 16) < 0) {
+		close(listener);
+		throw runtime_error("Could not listen on socket \"" + socket_path + "\".");
+	}
+	cout << "Serving on " << socket_path << endl;
+
+	/* Each client's thread sets its flag when done, and is then joined
+	 * by this loop, so that a long-lived daemon keeps only the threads
+	 * of the clients still connected. */
+	struct Client {
+		thread t;
+		shared_ptr<std::atomic<bool>> done;
+	};
+	vector<Client> clients {};
+	while (not stopping) {
+		for (auto c { clients.begin() }; c != clients.end(); ) {
+			if (*c->done) {
+				c->t.join();
+				c = clients.erase(c);
+			} else
+				c++;
+		}
+		pollfd p { listener, POLLIN, 0 };
+		if (poll(&p, 1, 200) <= 0)
+			continue;
+		int fd { accept(listener, nullptr, nullptr) };
+		if (fd < 0)
+			continue;
+		auto conn { make_shared<Connection>(fd, fd, true) };
+		auto done { make_shared<std::atomic<bool>>(false) };
+		clients.push_back({ thread { [this, conn, done] () {
+			serve_connection(conn);
+			*done = true;
+		} }, done });
+	}
+	for (auto& c : clients)
+		c.t.join();
+	close(listener);
+	unlink(socket_path.c_str());
+}
+
+void SolverDaemon::serve_connection(shared_ptr<Connection> conn) {
+	LineReader reader { conn->fd_in, stopping };
+	string line {};
+	while (reader.read_line(line)) {
+		if (line.empty()) {
+			continue;
+		} else if (line == "quit") {
+			return;
+		} else if (line == "shutdown") {
+			stopping = true;
+			return;
+		} else if (line.rfind("insert ", 0) == 0 or line.rfind("remove ", 0) == 0
+				or line.rfind("forget ", 0) == 0) {
+			replan(line, conn);
+		} else if (line.rfind("solve ", 0) == 0) {
+			/* Read the whole request before looking at it, so that even a
+			 * malformed one leaves the reader at the next request. */
+			vector<string> request { line };
+			while (reader.read_line(line) and line != "end")
+				request.push_back(line);
+			submit(move(request), conn);
+		} else {
+			conn->send("error - Unknown command \"" + line + "\"\n");
+		}
+	}
+}
+
+void SolverDaemon::submit(vector<string>&& request, shared_ptr<Connection> conn) {
+	string name { request[0].substr(string_view("solve ").length()) };
+	Job job {};
+	try {
+		request.erase(request.begin());
+		job = parse_job(name, request, defaults);
+	} catch (exception& e) {
+		conn->send("error " + name + " " + one_line(e.what()) + "\n");
+		return;
+	}
+	conn->send("accepted " + name + "\n");
+
+	/* The future is not kept:  the job reports back by itself, errors
+	 * included. */
+	pool.submit([job = move(job), conn] () {
+		try {
+			solve(job, *conn);
+		} catch (exception& e) {
+			conn->send("error " + job.name + " " + one_line(e.what()) + "\n");
+		}
+	});
+}
+
+void SolverDaemon::replan(const string& line, shared_ptr<Connection> conn) {
+	string command { line.substr(0, line.find(' ')) };
+	string name {"-"};
+	try {
+		auto match = wrap_regex_match(line,
+				"(insert|remove|forget) ([^ ]+)( -?[0-9.]+)?( -?[0-9.]+)?",
+				"Could not read \"" + line + "\".");
+		name = match[2];
+		if (command == "forget") {
+			conn->forget(name);
+			conn->send("forgot " + name + "\n");
+			return;
+		}
+		auto session { conn->find(name) };
+		if (command == "insert" and match[3].matched and match[4].matched) {
+			double theta { stod(match[3]) };
+			double phi   { stod(match[4]) };
+			pool.submit([=] () {
+				try {
+					lock_guard<mutex> lock {session->lock};
+					auto& replanner { *session->replanner };
+					dir_id_t id { replanner.insert(theta, phi) };
+					conn->send("inserted " + name + " " + to_string(id) + "\n"
+							+ result_reply(name, replanner.get_schedule().total_distance(),
+									replanner.get_time_running(), replanner.get_schedule()));
+				} catch (exception& e) {
+					conn->send("error " + name + " " + one_line(e.what()) + "\n");
+				}
+			});
+		} else if (command == "remove" and match[3].matched and not match[4].matched) {
+			dir_id_t id { static_cast<dir_id_t>(stoul(match[3])) };
+			pool.submit([=] () {
+				try {
+					lock_guard<mutex> lock {session->lock};
+					auto& replanner { *session->replanner };
+					dir_id_t moved { replanner.remove(id) };
+					conn->send("removed " + name + " " + to_string(id)
+							+ " " + to_string(moved) + "\n"
+							+ result_reply(name, replanner.get_schedule().total_distance(),
+									replanner.get_time_running(), replanner.get_schedule()));
+				} catch (exception& e) {
+					conn->send("error " + name + " " + one_line(e.what()) + "\n");
+				}
+			});
+		} else {
+			throw runtime_error("Expected \"insert JOB THETA PHI\" or"
+					" \"remove JOB ID\".");
+		}
+	} catch (exception& e) {
+		conn->send("error " + name + " " + one_line(e.what()) + "\n");
+	}
+}
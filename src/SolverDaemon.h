@@ -0,0 +1,106 @@
+#pragma once
+
+#include "includes.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include "Direction.h"
+#include "RunSettings.h"
+#include "ThreadPool.h"
+
+class SolverDaemon {
+/* A resident solver.  Rather than one process per run id, reading its
+ * input from a file and writing its answers to files, the daemon keeps
+ * running and takes problems over stdin or a Unix domain socket, solves
+ * them on a persistent pool of worker threads, and streams progress
+ * and results back over the same channel.  Nothing touches the disk.
+ *
+ * The protocol is plain text, one item per line.  A client submits a
+ * problem as
+ *
+ *     solve JOB
+ *     epochs=1000000
+ *     cool-init=0.5
+ *     cool-base=0.996
+ *     cool-flat-epochs=25000
+ *     directions N
+ *     Direction(id=0, theta=..., phi=...)
+ *     ... (N lines in all)
+ *     end
+ *
+ * where JOB is any name without spaces.  The four settings above are
+ * required, as the positional arguments are on the command line.  The
+ * optional ones are:
+ *
+ *     second-rep=true|false   allow the second rep (default true)
+ *     seed=K                  seeds the random numbers as run id K does
+ *     progress-every=E        report progress every E epochs (default 0,
+ *                             meaning never)
+ *     --name=value            any option of RunSettings.h, overriding
+ *                             the daemon's own command line options
+ *
+ * The daemon answers, with JOB on every line so that replies to several
+ * problems in flight can be told apart:
+ *
+ *     accepted JOB
+ *     progress JOB EPOCH CURRENT_OBJECTIVE BEST_OBJECTIVE
+ *     result JOB BEST_OBJECTIVE TIME_NS N
+ *     Direction(...)   (N lines: the best schedule found)
+ *     done JOB
+ *
+ * or "error JOB MESSAGE" in place of the rest, if something goes wrong.
+ *
+ * The connection keeps each finished job's schedule, which can then be
+ * re-planned as Directions come and go (see TelReplanner.h):
+ *
+ *     insert JOB THETA PHI    answered by "inserted JOB ID", where ID is
+ *                             the new Direction's id
+ *     remove JOB ID           answered by "removed JOB ID MOVED", where
+ *                             the Direction with id MOVED now has id ID
+ *
+ * each followed by the result lines as above.  "forget JOB" lets the
+ * connection drop the job's schedule, answered by "forgot JOB".
+ *
+ * A client line "quit" ends its connection (end of input does too), and
+ * "shutdown" stops the whole daemon once the problems already submitted
+ * are finished.
+ *
+ * With --pin, each worker pins itself to its own core or NUMA node, as
+ * the workers of a batch run do (see Affinity.h).
+ *
+ * Islands and decomposition are not available here, as both are built
+ * around their output files, and neither are metrics other than the
+ * default one.
+ */
+public:
+	SolverDaemon(size_t num_workers, const RunSettings& defaults);
+	~SolverDaemon() = default;
+	SolverDaemon(SolverDaemon&)  = delete;
+	SolverDaemon(SolverDaemon&&) = delete;
+
+	/* Serves a single client on stdin and stdout, until end of input.
+	 * Anything else the program prints goes to stderr meanwhile. */
+	void serve_stdio();
+
+	/* Serves any number of clients, each on its own connection to a Unix
+	 * domain socket created at socket_path, until one of them asks for
+	 * a shutdown. */
+	void serve_socket(const string& socket_path);
+
+	struct Connection;
+	struct Job;
+
+private:
+	void serve_connection(shared_ptr<Connection> conn);
+	void submit(vector<string>&& request, shared_ptr<Connection> conn);
+	void replan(const string& line, shared_ptr<Connection> conn);
+
+	RunSettings defaults;
+	std::atomic<bool> stopping {false};
+
+	/* Declared last, so that it is destroyed first:  its destructor waits
+	 * for every submitted problem to finish. */
+	ThreadPool pool;
+};
@@ -3,35 +3,73 @@
 #include "includes.h"
 #include "SimAnneal.h"
 #include "Schedule.h"
+#include "ScheduleMoves.h"
+#include "TwoLevelSchedule.h"
+#include "WeightTree.h"
 
-class TelAnnealer : public SimAnnealer<Schedule> {
+/* The annealer works with any schedule type S offering the interface of
+ * Schedule (see Schedule.h); the two available are BasicSchedule, in any
+ * of its index widths and rep policies, and TwoLevelSchedule, whose
+ * segment reversals are cheaper on large inputs.
+ *
+ * A schedule type with S::single_rep set can only anneal without the
+ * second rep, and then never even considers switching reps.
+ *
+ * Distances are measured by S's metric (see Metrics.h), of which the
+ * annealer may be given a configured instance.
+ *
+ * The first Direction of the schedule never moves.  With fixed_end, the
+ * last one never moves either, which is how a piece of a larger schedule
+ * can be annealed between two given Directions.
+ */
+template<typename S>
+class TelAnnealerFor : public SimAnnealer<S> {
 public:
-	TelAnnealer(int run_id, unique_ptr<cooling::CoolingFn>&& cooler,
+	TelAnnealerFor(int run_id, unique_ptr<cooling::CoolingFn>&& cooler,
 					shared_ptr<DirectionDatabase> dirdata,
-					bool without_second_rep) :
-		SimAnnealer<Schedule> {
+					bool without_second_rep,
+					bool fixed_end=false,
+					const typename S::metric_type& metric={}) :
+		SimAnnealer<S> {
 			run_id,
-			std::make_unique<Schedule>(dirdata, true),
+			std::make_unique<S>(dirdata, true, metric),
 			move(cooler)},
 		dirdatabase    {dirdata},
 		num_dir        {dirdatabase->get_num_directions_defined()},
 		without_second_rep {without_second_rep},
-		idx_selecter_1 {1, num_dir-1},
-		idx_selecter_2 {1, num_dir-2},
-		unif01 {}
-		{}
+		end_movable    {fixed_end ? num_dir-1 : num_dir},
+		idx_selecter_1 {1, end_movable-1},
+		idx_selecter_2 {1, end_movable-2},
+		window_hi {end_movable-1},
+		windowed {false},
+		unif01 {},
+		rf_weights {},
+		rf_temperature {},
+		rf_step_leaves {6.0 * end_movable},
+		proposed {},
+		journal {},
+		journal_work {0},
+		max_replay_work {std::is_same_v<S, TwoLevelSchedule>
+				? 2 * static_cast<size_t>(std::ceil(std::sqrt(num_dir)))
+				: num_dir}
+		{
+			if (S::single_rep and not without_second_rep) {
+				throw std::runtime_error("A single-rep schedule type can only"
+						" be annealed without the second rep.");
+			}
+		}
 
-	virtual ~TelAnnealer() = default;
-	TelAnnealer(TelAnnealer&) = delete;
-	TelAnnealer(TelAnnealer&&) = delete;
+	virtual ~TelAnnealerFor() = default;
+	TelAnnealerFor(TelAnnealerFor&) = delete;
+	TelAnnealerFor(TelAnnealerFor&&) = delete;
 
 	virtual int get_rand_seed() override {
 		return (without_second_rep ?
 					1'000'000
-				:	0) + get_run_id();
+				:	0) + this->get_run_id();
 	}
 
-	virtual void sample_step(const Schedule& from, Schedule& storage,
+	virtual void sample_step(const S& from, S& storage,
 			std::mt19937_64& rand) override {
 		/* The TelAnnealer class provides an optimizer to perform simulated
 		 * annealing. The swaps used, which are here in the sample_step method
@@ -43,57 +81,297 @@ public:
 		 * spherical coordinate representation of the Directions; this switch
 		 * happens with probability 1/2.
 		 */
-		size_t i { idx_selecter_1(rand) };
-		size_t j { idx_selecter_2(rand) };
+		auto [i, j, switch_rep] = sample_reversal(rand);
+		storage.copy_from(from);
+		storage.flip_segment(i, j, switch_rep);
+	}
 
-		if (i == j) {
-			j = num_dir - 1;
-		}
+	/* The same steps as sample_step(...), taken in place.  Only the edges
+	 * at the two ends of a reversal change; see reversal_delta(...) in
+	 * ScheduleMoves.h.
+	 */
+	virtual bool inplace_supported() override {
+		return true;
+	}
 
-		bool switch_rep {};
-		if (without_second_rep)
-			switch_rep = false;
-		else
-			switch_rep = (unif01(rand) < 0.5);
+	virtual double propose_step(const S& s, std::mt19937_64& rand) override {
+		proposed = sample_reversal(rand);
+		return reversal_delta(s, proposed.i, proposed.j, proposed.switch_rep);
+	}
 
-		storage.copy_from(from);
-		storage.flip_segment(i, j, switch_rep);
+	virtual double apply_proposed_step(S& s) override {
+		s.flip_segment(proposed.i, proposed.j, proposed.switch_rep);
+		journal_push(proposed);
+		return 0.0;
 	}
 
-	virtual double objective_to_minimize(const Schedule& s) override {
+	/* Every step is a reversal, so the journal of steps (see
+	 * SimAnneal.h) is a list of them, replayed by flipping the same
+	 * segments again.  Replaying a reversal moves about as many entries
+	 * as the segment is long (at most about 2 sqrt(n) for the two-level
+	 * list), and copying the schedule about n, which decides when the
+	 * journal is full. */
+	virtual bool journal_supported() override {
+		return true;
+	}
+
+	virtual size_t journal_size() override {
+		return journal.size();
+	}
+
+	virtual bool journal_full() override {
+		return journal_work > num_dir;
+	}
+
+	virtual void journal_replay(S& s, size_t count) override {
+		for (size_t k {0}; k < count; k++) {
+			s.flip_segment(journal[k].i, journal[k].j, journal[k].switch_rep);
+			journal_work -= replay_work(journal[k]);
+		}
+		journal.erase(journal.begin(), journal.begin() + count);
+	}
+
+	virtual void journal_clear() override {
+		journal.clear();
+		journal_work = 0;
+	}
+
+	virtual double objective_to_minimize(const S& s) override {
 		/* Remember: the SimAnneal class treats LOWER objectives as BETTER. */
 		return s.total_distance();
 	}
 
-	virtual void write(ostream& o, const Schedule& s) override {
+	virtual void write(ostream& o, const S& s) override {
 		o << s;
 	}
 
-	virtual unique_ptr<Schedule> duplicate(const Schedule& s) override {
+	virtual unique_ptr<S> duplicate(const S& s) override {
 		return s.duplicate();
 	}
 
-	virtual void copy_from_to(const Schedule& from, Schedule& into) override {
+	virtual void copy_from_to(const S& from, S& into) override {
 		into.copy_from(from);
 	}
 
+	/* ************************************************** *
+	 * Rejection-free annealing over every segment reversal.
+	 *
+	 * The neighbourhood is all moves (i, j, switch_rep) with
+	 * 1 <= i <= j < end_movable, as in sample_step(...) above, but leaving out
+	 * the moves that change nothing (i == j without switching reps).
+	 * Move (i, j, s) is stored in leaf 2 * pair_index(i, j) + s of the
+	 * weight tree.
+	 *
+	 * Reversing a segment and switching every rep in it leaves each
+	 * distance within the segment unchanged, so a move only changes the
+	 * two edges at the ends of the segment; see reversal_delta(...) in
+	 * ScheduleMoves.h.
+	 *
+	 * There are about n^2 moves on n Directions, each a leaf of the tree,
+	 * which rf_rebuild(...) recomputes at every change of temperature and
+	 * an accepted step partly updates, about (j - i + 2) 2n leaves of it.
+	 * Computing a leaf's weight takes about RF_WEIGHT_COST proposals, and
+	 * updating one, with its path up the tree, about RF_UPDATE_COST (as
+	 * measured on the benchmark corpus).  For the annealer to see when the
+	 * steps pay off, rf_step_cost() follows the leaves updated by recent
+	 * steps.
+	 *
+	 * With flat stretches of a few thousand epochs, rebuilding alone
+	 * costs more than the proposals it saves beyond about 80 Directions,
+	 * so beyond RF_MAX_DIRECTIONS the annealer never switches.
+	 */
+	static constexpr size_t RF_MAX_DIRECTIONS { 200 };
+	static constexpr double RF_WEIGHT_COST { 0.4 };
+	static constexpr double RF_UPDATE_COST { 0.6 };
+
+	virtual bool rf_supported() override {
+		return not windowed and end_movable <= RF_MAX_DIRECTIONS;
+	}
+
+	virtual void rf_rebuild(const S& s, double temperature) override {
+		rf_temperature = temperature;
+		rf_weights.resize(2 * pair_index(end_movable - 1, end_movable - 1) + 2);
+		for (size_t i {1}; i < end_movable; i++) {
+			for (size_t j {i}; j < end_movable; j++) {
+				rf_weights.set_lazy(2 * pair_index(i, j),     rf_weight(s, i, j, false));
+				rf_weights.set_lazy(2 * pair_index(i, j) + 1, rf_weight(s, i, j, true));
+			}
+		}
+		rf_weights.rebuild();
+	}
+
+	virtual double rf_num_moves() override {
+		double num_pairs { (end_movable - 1) * end_movable / 2.0 };
+		double num_segments { num_pairs - (end_movable - 1) };
+		return (allow_switch() ? num_segments + num_pairs : num_segments);
+	}
+
+	virtual double rf_total_weight() override {
+		return rf_weights.total();
+	}
+
+	virtual double rf_rebuild_cost() override {
+		return RF_WEIGHT_COST * (2 * pair_index(end_movable - 1, end_movable - 1) + 2);
+	}
+
+	virtual double rf_step_cost() override {
+		return RF_UPDATE_COST * rf_step_leaves;
+	}
+
+	virtual double rf_step(S& s, std::mt19937_64& rand) override {
+		std::uniform_real_distribution<double> unif_total {0.0, rf_weights.total()};
+		size_t leaf { rf_weights.sample(unif_total(rand)) };
+		bool switch_rep { (leaf % 2 == 1) };
+		auto [i, j] = pair_from_index(leaf / 2);
+
+		double delta { reversal_delta(s, i, j, switch_rep) };
+		s.flip_segment(i, j, switch_rep);
+		journal_push({ i, j, switch_rep });
+
+		/* The Directions at indices i, ..., j changed, so every move whose
+		 * end edges touch one of them needs a new weight.  These are the
+		 * moves starting at i2 in [i, j+1] or ending at j2 in [i-1, j].
+		 */
+		size_t num_leaves {0};
+		for (size_t i2 {i}; i2 <= j + 1 and i2 < end_movable; i2++) {
+			for (size_t j2 {i2}; j2 < end_movable; j2++) {
+				rf_weights.set(2 * pair_index(i2, j2),     rf_weight(s, i2, j2, false));
+				rf_weights.set(2 * pair_index(i2, j2) + 1, rf_weight(s, i2, j2, true));
+			}
+			num_leaves += 2 * (end_movable - i2);
+		}
+		for (size_t j2 { std::max<size_t>(i - 1, 1) }; j2 <= j; j2++) {
+			for (size_t i2 {1}; i2 <= j2 and i2 < i; i2++) {
+				rf_weights.set(2 * pair_index(i2, j2),     rf_weight(s, i2, j2, false));
+				rf_weights.set(2 * pair_index(i2, j2) + 1, rf_weight(s, i2, j2, true));
+			}
+			num_leaves += 2 * std::min(j2, i - 1);
+		}
+		/* A running mean over the last few dozen steps. */
+		rf_step_leaves += (num_leaves - rf_step_leaves) / 32;
+		return delta;
+	}
+
+	/* Limits every reversal to the indices lo, ..., hi, for a short local
+	 * anneal after a small change to the schedule (see TelReplanner.h).
+	 * Rejection-free steps range over every reversal, so they are then
+	 * unavailable.
+	 */
+	void restrict_to(size_t lo, size_t hi) {
+		if (lo < 1 or hi >= end_movable or lo >= hi) {
+			throw std::out_of_range("Cannot restrict reversals to indices "
+					+ to_string(lo) + " through " + to_string(hi) + ".");
+		}
+		idx_selecter_1 = std::uniform_int_distribution<size_t> {lo, hi};
+		idx_selecter_2 = std::uniform_int_distribution<size_t> {lo, hi-1};
+		window_hi = hi;
+		windowed = true;
+	}
+
 	virtual string get_annealing_filename_for_epoch(int run_id, long epoch)
 														override {
 		string sr { (without_second_rep ? "no-second-rep/" : "" ) };
-		return OUTPUT_FOLDER + "run-" + to_string(run_id) +
-					"/" + sr + "simanneal-" + to_string(epoch) + ".txt";
+		return get_run_folder(run_id) + sr + "simanneal-" + to_string(epoch) + ".txt";
 	}
 
 	virtual string get_annealing_filename_for_full_log(int run_id) override {
 		string sr { (without_second_rep ? "no-second-rep/" : "" ) };
-		return OUTPUT_FOLDER + "run-" + to_string(run_id) +
-					+ "/" + sr + "simanneal-full-log.txt";
+		return get_run_folder(run_id) + sr + "simanneal-full-log.txt";
+	}
+
+protected:
+	/* Reverses the Directions at indices i, ..., j (or j, ..., i, if
+	 * j < i), switching all their reps if switch_rep. */
+	struct Reversal {
+		size_t i, j;
+		bool switch_rep;
+	};
+
+	/* For derived classes that measure steps another way. */
+	const Reversal& last_proposed() const {
+		return proposed;
 	}
 
 private:
+
+	Reversal sample_reversal(std::mt19937_64& rand) {
+		size_t i { idx_selecter_1(rand) };
+		size_t j { idx_selecter_2(rand) };
+
+		if (i == j) {
+			j = window_hi;
+		}
+
+		bool switch_rep {};
+		if (allow_switch())
+			switch_rep = (unif01(rand) < 0.5);
+		else
+			switch_rep = false;
+		return { i, j, switch_rep };
+	}
+
+	size_t replay_work(const Reversal& r) const {
+		size_t length { (r.i < r.j ? r.j - r.i : r.i - r.j) + 1 };
+		return std::min(length, max_replay_work);
+	}
+
+	void journal_push(const Reversal& r) {
+		journal.push_back(r);
+		journal_work += replay_work(r);
+	}
+
+	bool allow_switch() const {
+		if constexpr (S::single_rep)
+			return false;
+		else
+			return not without_second_rep;
+	}
+
+	double rf_weight(const S& s, size_t i, size_t j, bool switch_rep) const {
+		if ((i == j and not switch_rep) or (switch_rep and not allow_switch()))
+			return 0.0;
+		double delta { reversal_delta(s, i, j, switch_rep) };
+		return (delta <= 0 ? 1.0 : std::exp(-delta / rf_temperature));
+	}
+
+	/* Pairs 1 <= i <= j < end_movable are numbered row by row:
+	 * (1, 1), (1, 2), ..., (1, end_movable-1), (2, 2), (2, 3), ...
+	 */
+	size_t pair_index(size_t i, size_t j) const {
+		return row_start(i) + (j - i);
+	}
+	size_t row_start(size_t i) const {
+		return (i - 1) * end_movable - (i - 1) * i / 2;
+	}
+	pair<size_t, size_t> pair_from_index(size_t k) const {
+		size_t lo {1}, hi {end_movable - 1};
+		while (lo < hi) {
+			size_t mid { (lo + hi + 1) / 2 };
+			if (row_start(mid) <= k)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		return { lo, lo + (k - row_start(lo)) };
+	}
+
 	shared_ptr<DirectionDatabase> dirdatabase;
 	size_t num_dir;
 	bool without_second_rep;
+	size_t end_movable;
 	std::uniform_int_distribution<size_t> idx_selecter_1, idx_selecter_2;
+	size_t window_hi;
+	bool windowed;
 	std::uniform_real_distribution<double> unif01;
+	WeightTree rf_weights;
+	double rf_temperature;
+	/* Leaves updated per rejection-free step, as a running mean.  At
+	 * first, as for a step reversing two Directions mid-schedule. */
+	double rf_step_leaves;
+	Reversal proposed;
+	vector<Reversal> journal;
+	size_t journal_work;
+	size_t max_replay_work;
 };
+
+using TelAnnealer = TelAnnealerFor<Schedule>;
@@ -0,0 +1,540 @@
+#pragma once
+
+#include "includes.h"
+
+#include <numeric>
+
+#include "NeighbourGrid.h"
+#include "RunSettings.h"
+#include "Schedule.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+using nanos = std::chrono::nanoseconds;
+
+/* ************************************************** *
+ * Construction heuristics.  Each builds a complete schedule quickly, to
+ * be saved for comparison or to seed the annealer (which may then start
+ * from a lower temperature; see Main.cpp).
+ *
+ * The heuristics first decide an order of the Directions, and only then
+ * which rep to use for each.  For a fixed order, the best reps follow
+ * exactly from a short dynamic program; see best_reps(...).
+ *
+ * Schedules must start at Direction 0 in its standard rep.  A heuristic
+ * that produces a closed tour rather than a path starting at 0 hands it
+ * to schedule_from_cycle(...), which opens the tour at 0.
+ */
+namespace construction {
+
+	/* For the Directions in the given order, the reps giving the shortest
+	 * schedule, with the first Direction in its standard rep.  This is a
+	 * Viterbi-style pass with two states (the reps) per position.
+	 */
+	inline vector<bool> best_reps(const DirectionDatabase& db,
+			const vector<dir_id_t>& order, bool without_second_rep) {
+		size_t n { order.size() };
+		vector<bool> reps(n, false);
+		if (without_second_rep or n == 0)
+			return reps;
+
+		/* came_from[2k + r] is the rep of Direction k-1 on the shortest
+		 * schedule up to Direction k in rep r. */
+		vector<bool> came_from(2 * n, false);
+		double cost[2] { 0.0, numeric_limits<double>::infinity() };
+		for (size_t k {1}; k < n; k++) {
+			double next_cost[2] {};
+			for (int r {0}; r < 2; r++) {
+				const Direction& here { db.get_direction(order[k], (r == 1)) };
+				double via_0 { cost[0] + db.get_direction(order[k-1], false).dist_to(here) };
+				double via_1 { cost[1] + db.get_direction(order[k-1], true ).dist_to(here) };
+				came_from[2 * k + r] = (via_1 < via_0);
+				next_cost[r] = std::min(via_0, via_1);
+			}
+			cost[0] = next_cost[0];
+			cost[1] = next_cost[1];
+		}
+		bool r { cost[1] < cost[0] };
+		for (size_t k {n-1}; k > 0; k--) {
+			reps[k] = r;
+			r = came_from[2 * k + r];
+		}
+		return reps;
+	}
+
+	inline unique_ptr<Schedule> schedule_from_path(
+			shared_ptr<DirectionDatabase> dirdata,
+			vector<dir_id_t>&& order, bool without_second_rep) {
+		vector<bool> reps { best_reps(*dirdata, order, without_second_rep) };
+		return make_unique<Schedule>(move(order), move(reps), dirdata);
+	}
+
+	/* Opens a closed tour at Direction 0.  Either neighbour of 0 may come
+	 * next, so both ways round are tried. */
+	inline unique_ptr<Schedule> schedule_from_cycle(
+			shared_ptr<DirectionDatabase> dirdata,
+			const vector<dir_id_t>& cycle, bool without_second_rep) {
+		size_t n { cycle.size() };
+		size_t at_0 { static_cast<size_t>(
+				std::find(cycle.begin(), cycle.end(), 0) - cycle.begin()) };
+		vector<dir_id_t> forward(n), backward(n);
+		for (size_t k {0}; k < n; k++) {
+			forward[k]  = cycle[(at_0 + k) % n];
+			backward[k] = cycle[(at_0 + n - k) % n];
+		}
+		auto sch_f { schedule_from_path(dirdata, move(forward), without_second_rep) };
+		auto sch_b { schedule_from_path(dirdata, move(backward), without_second_rep) };
+		return sch_f->total_distance() <= sch_b->total_distance() ? move(sch_f) : move(sch_b);
+	}
+
+	/* ************************************************** *
+	 * Space-filling curve order.
+	 *
+	 * Each Direction is placed on a Hilbert curve by its angles, and the
+	 * Directions are visited in the order of the curve.  Points close on
+	 * the curve are close in space, so this gives a fair schedule in
+	 * O(n log n), far faster than any of the others.
+	 *
+	 * With only the standard rep, the curve covers the whole torus as two
+	 * squares side by side, theta in [0, pi) and [pi, 2 pi).  A Hilbert
+	 * curve runs from one bottom corner of its square to the other, so
+	 * the two halves join up and the tour closes around theta = 2 pi.
+	 *
+	 * With both reps, every Direction has exactly one rep with theta in
+	 * [0, pi), so the curve need only cover that one square, visiting
+	 * twice as many points per area.
+	 *
+	 * For Hilbert curves, see for example the chapter on them in "Hacker's
+	 * Delight" by H. S. Warren.
+	 */
+	inline uint64_t hilbert_index(uint32_t x, uint32_t y, int order_bits) {
+		uint64_t d {0};
+		for (uint32_t s { 1u << (order_bits - 1) }; s > 0; s /= 2) {
+			uint32_t rx { (x & s) > 0 };
+			uint32_t ry { (y & s) > 0 };
+			d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+			if (ry == 0) {
+				if (rx == 1) {
+					x = s - 1 - (x & (s - 1));
+					y = s - 1 - (y & (s - 1));
+				}
+				std::swap(x, y);
+			}
+			x &= s - 1;
+			y &= s - 1;
+		}
+		return d;
+	}
+
+	/* The Directions of dirdata by their place on the curve. */
+	inline vector<pair<uint64_t, dir_id_t>> curve_keys(
+			const DirectionDatabase& dirdata, bool without_second_rep) {
+		constexpr int ORDER_BITS { 16 };
+		constexpr double SIDE { 1 << ORDER_BITS };
+		auto to_grid = [&] (double t) {
+			return static_cast<uint32_t>(std::clamp(t * SIDE, 0.0, SIDE - 1));
+		};
+
+		size_t num_dir { dirdata.get_num_directions_defined() };
+		vector<pair<uint64_t, dir_id_t>> keyed {};
+		keyed.reserve(num_dir);
+		for (dir_id_t id {0}; id < num_dir; id++) {
+			const Direction* d { &dirdata.get_direction(id, false) };
+			if (not without_second_rep and d->get_theta() >= PI)
+				d = &dirdata.get_direction(id, true);
+			double theta { d->get_theta() };
+			uint32_t y { to_grid((d->get_phi() + PI / 2) / PI) };
+			uint64_t key {};
+			if (without_second_rep) {
+				uint64_t half { theta >= PI };
+				uint32_t x { to_grid(theta / PI - half) };
+				key = (half << (2 * ORDER_BITS)) + hilbert_index(x, y, ORDER_BITS);
+			} else {
+				key = hilbert_index(to_grid(theta / PI), y, ORDER_BITS);
+			}
+			keyed.push_back({ key, id });
+		}
+		std::sort(keyed.begin(), keyed.end());
+		return keyed;
+	}
+
+	inline unique_ptr<Schedule> space_filling_curve(
+			shared_ptr<DirectionDatabase> dirdata, bool without_second_rep) {
+		size_t num_dir { dirdata->get_num_directions_defined() };
+		auto keyed { curve_keys(*dirdata, without_second_rep) };
+
+		vector<dir_id_t> cycle {};
+		cycle.reserve(num_dir);
+		for (auto& [key, id] : keyed)
+			cycle.push_back(id);
+		return schedule_from_cycle(dirdata, cycle, without_second_rep);
+	}
+
+	/* The Directions in the order of the curve, Direction 0 first, for
+	 * renumbering them (see DirectionDatabase::renumbered(...)):  an
+	 * annealed schedule mostly steps between Directions close in space,
+	 * and so, renumbered, between Directions close in memory.  One
+	 * database serves both rep modes, so the order is that of the curve
+	 * with both reps, on which Directions close in either rep lie close
+	 * together, other than across theta = 0 or pi.
+	 */
+	inline vector<dir_id_t> curve_order(const DirectionDatabase& dirdata) {
+		if (dirdata.get_num_directions_defined() == 0)
+			return {};
+		vector<dir_id_t> order { 0 };
+		order.reserve(dirdata.get_num_directions_defined());
+		for (auto& [key, id] : curve_keys(dirdata, false)) {
+			if (id != 0)
+				order.push_back(id);
+		}
+		return order;
+	}
+
+	/* ************************************************** *
+	 * Nearest neighbour from a given start.
+	 *
+	 * The usual greedy tour, but searching a NeighbourGrid rather than
+	 * every unvisited Direction, and starting anywhere: the tour is closed
+	 * up and then opened at Direction 0.  Starting from 0 itself gives
+	 * the same schedule as TelGreedy.h (barring ties), only faster.
+	 */
+	inline unique_ptr<Schedule> nearest_neighbour(
+			shared_ptr<DirectionDatabase> dirdata, bool without_second_rep,
+			dir_id_t start) {
+		size_t num_dir { dirdata->get_num_directions_defined() };
+		NeighbourGrid grid { dirdata, without_second_rep };
+		vector<dir_id_t> cycle { start };
+		cycle.reserve(num_dir);
+		grid.remove_direction(start);
+		const Direction* current { &dirdata->get_direction(start, false) };
+		while (cycle.size() < num_dir) {
+			auto [dist, p] = grid.nearest(*current, 1, num_dir).front();
+			cycle.push_back(p.id);
+			grid.remove_direction(p.id);
+			current = &dirdata->get_direction(p.id, p.othr);
+		}
+		return schedule_from_cycle(dirdata, cycle, without_second_rep);
+	}
+
+	/* The best of nearest neighbour tours from num_starts starting
+	 * Directions, spread evenly over the ids (0 always among them), built
+	 * num_threads at a time. */
+	inline unique_ptr<Schedule> multi_start_nearest_neighbour(
+			shared_ptr<DirectionDatabase> dirdata, bool without_second_rep,
+			size_t num_starts, size_t num_threads) {
+		size_t num_dir { dirdata->get_num_directions_defined() };
+		num_starts = std::clamp<size_t>(num_starts, 1, num_dir);
+		vector<future<unique_ptr<Schedule>>> tours {};
+		{
+			ThreadPool pool { std::min(num_threads, num_starts) };
+			for (size_t k {0}; k < num_starts; k++) {
+				dir_id_t start { static_cast<dir_id_t>(k * num_dir / num_starts) };
+				tours.push_back(pool.submit([=] () {
+					return nearest_neighbour(dirdata, without_second_rep, start);
+				}));
+			}
+		}
+		unique_ptr<Schedule> best {};
+		for (auto& t : tours) {
+			auto sch { t.get() };
+			if (not best or sch->total_distance() < best->total_distance())
+				best = move(sch);
+		}
+		return best;
+	}
+
+	/* ************************************************** *
+	 * Greedy edge matching.
+	 *
+	 * Take the edges between nearby Directions from shortest to longest,
+	 * keeping each one unless it would give a Direction three edges or
+	 * close a loop.  (Direction 0 may only have one edge, being the start.)
+	 * What remains is a set of paths, which are then joined up nearest
+	 * end first, starting from the path through Direction 0.
+	 *
+	 * Only edges to each Direction's K_NEAREST nearest neighbours are
+	 * considered, as is usual.
+	 *
+	 * Reps need no care while matching.  Switching the rep of every
+	 * Direction on a path leaves its length unchanged, so the rep at one
+	 * end of a new edge can always be made to fit by switching that whole
+	 * path (unless it is the path through Direction 0, but then the path
+	 * at the other end can be switched instead).  Each path's switches
+	 * are tracked by a union-find structure with parities.
+	 *
+	 * For greedy matching, see D. S. Johnson and L. A. McGeoch, "The
+	 * traveling salesman problem: a case study in local optimization",
+	 * in "Local Search in Combinatorial Optimization", E. Aarts and
+	 * J. K. Lenstra (eds.), Wiley (1997).
+	 */
+	class PathForest {
+	public:
+		PathForest(size_t num_dir) :
+			parent(num_dir), parity(num_dir, false), rep(num_dir, false) {
+			std::iota(parent.begin(), parent.end(), 0);
+		}
+
+		/* The root of x's path, and the parity of switches between them. */
+		pair<dir_id_t, bool> find(dir_id_t x) {
+			bool p {false};
+			dir_id_t root {x};
+			while (parent[root] != root) {
+				p = (p != parity[root]);
+				root = parent[root];
+			}
+			/* Compress the path, keeping each parity relative to root. */
+			bool q {p};
+			while (parent[x] != root and x != root) {
+				dir_id_t up { parent[x] };
+				bool up_q { q != parity[x] };
+				parent[x] = root;
+				parity[x] = q;
+				x = up;
+				q = up_q;
+			}
+			return { root, p };
+		}
+
+		bool rep_of(dir_id_t x) {
+			auto [root, p] = find(x);
+			return rep[x] != (p != parity[root]);
+		}
+
+		/* Switches every rep on the path through x. */
+		void switch_path(dir_id_t x) {
+			auto root { find(x).first };
+			parity[root] = not parity[root];
+		}
+
+		void join(dir_id_t a, dir_id_t b) {
+			dir_id_t root_a { find(a).first };
+			dir_id_t root_b { find(b).first };
+			parent[root_b] = root_a;
+			/* Keep root_b's overall parity once root_a is above it. */
+			parity[root_b] = (parity[root_b] != parity[root_a]);
+		}
+
+	private:
+		vector<dir_id_t> parent;
+		vector<bool> parity;  // parity[root] holds the root's own switch
+	public:
+		vector<bool> rep;     // reps before any switches
+	};
+
+	inline unique_ptr<Schedule> greedy_edge(
+			shared_ptr<DirectionDatabase> dirdata, bool without_second_rep) {
+		constexpr size_t K_NEAREST { 8 };
+		size_t num_dir { dirdata->get_num_directions_defined() };
+		if (num_dir < 3)
+			return nearest_neighbour(dirdata, without_second_rep, 0);
+
+		NeighbourGrid grid { dirdata, without_second_rep };
+
+		struct Edge {
+			double dist;
+			dir_id_t a, b;
+			bool rep_a, rep_b;
+		};
+		vector<Edge> edges {};
+		edges.reserve(num_dir * K_NEAREST * (without_second_rep ? 1 : 2));
+		for (dir_id_t a {0}; a < num_dir; a++) {
+			for (int r {0}; r < (without_second_rep ? 1 : 2); r++) {
+				for (auto& [dist, p] : grid.nearest(
+						dirdata->get_direction(a, (r == 1)), K_NEAREST, a)) {
+					if (a < p.id)
+						edges.push_back({ dist, a, p.id, (r == 1), p.othr });
+				}
+			}
+		}
+		std::sort(edges.begin(), edges.end(),
+				[] (auto& e1, auto& e2) { return e1.dist < e2.dist; });
+
+		/* ----------------------------------------
+		 * Match.  adj[2x], adj[2x+1] are x's neighbours, or num_dir.
+		 */
+		PathForest paths { num_dir };
+		vector<dir_id_t> adj(2 * num_dir, num_dir);
+		vector<int> degree(num_dir, 0);
+		auto max_degree = [] (dir_id_t x) { return x == 0 ? 1 : 2; };
+		for (auto& e : edges) {
+			if (degree[e.a] >= max_degree(e.a) or degree[e.b] >= max_degree(e.b))
+				continue;
+			if (paths.find(e.a).first == paths.find(e.b).first)
+				continue;
+			/* A Direction with no edges yet is a path of its own, so its
+			 * rep is free; otherwise, switch a path to fit. */
+			bool rep_a { e.rep_a }, rep_b { e.rep_b };
+			bool on_a_0 { paths.find(e.a).first == paths.find(0).first };
+			if (paths.rep_of(e.a) != rep_a) {
+				if (on_a_0) {
+					rep_a = not rep_a;
+					rep_b = not rep_b;
+				} else {
+					paths.switch_path(e.a);
+				}
+			}
+			if (paths.rep_of(e.b) != rep_b)
+				paths.switch_path(e.b);
+			paths.join(e.a, e.b);
+			adj[2 * e.a + degree[e.a]++] = e.b;
+			adj[2 * e.b + degree[e.b]++] = e.a;
+		}
+
+		/* ----------------------------------------
+		 * Join the paths.  Only path ends stay in the grid, and both
+		 * ends of a path leave it once the path is used.
+		 */
+		NeighbourGrid ends { dirdata, without_second_rep };
+		for (dir_id_t x {0}; x < num_dir; x++) {
+			if (degree[x] == 2)
+				ends.remove_direction(x);
+		}
+		vector<dir_id_t> order {};
+		vector<bool> reps {};
+		order.reserve(num_dir);
+		reps.reserve(num_dir);
+		auto walk_path = [&] (dir_id_t x) {
+			ends.remove_direction(x);
+			dir_id_t prev { static_cast<dir_id_t>(num_dir) };
+			while (x != num_dir) {
+				order.push_back(x);
+				reps.push_back(paths.rep_of(x));
+				dir_id_t next { adj[2 * x] != prev ? adj[2 * x] : adj[2 * x + 1] };
+				prev = x;
+				x = next;
+			}
+			ends.remove_direction(prev);
+			return prev;
+		};
+		/* Direction 0 has standard rep unless its path was switched. */
+		if (paths.rep_of(0))
+			paths.switch_path(0);
+		dir_id_t last { walk_path(0) };
+		while (order.size() < num_dir) {
+			auto [dist, p] = ends.nearest(
+					dirdata->get_direction(last, reps.back()), 1, num_dir).front();
+			if (paths.rep_of(p.id) != p.othr)
+				paths.switch_path(p.id);
+			last = walk_path(p.id);
+		}
+
+		/* The reps are now consistent along every path, but a join may
+		 * still do better with a later path switched.  For this order,
+		 * best_reps(...) finds the best reps outright. */
+		return schedule_from_path(dirdata, move(order), without_second_rep);
+	}
+
+	/* ************************************************** *
+	 * Seeding the annealer.
+	 */
+
+	/* The schedule from the heuristic with the given name, as in the
+	 * --start option.  Here "greedy" is nearest neighbour from Direction
+	 * 0, the tour of TelGreedy.h, built without saving anything. */
+	inline unique_ptr<Schedule> build(const string& method,
+			shared_ptr<DirectionDatabase> dirdata, bool without_second_rep,
+			const RunSettings& settings) {
+		if (method == "greedy") {
+			return nearest_neighbour(dirdata, without_second_rep, 0);
+		} else if (method == "sfc") {
+			return space_filling_curve(dirdata, without_second_rep);
+		} else if (method == "greedy-edge") {
+			return greedy_edge(dirdata, without_second_rep);
+		} else if (method == "nn") {
+			return multi_start_nearest_neighbour(dirdata, without_second_rep,
+					settings.nn_starts, settings.run_threads);
+		}
+		throw runtime_error("Unknown construction heuristic \"" + method + "\".");
+	}
+
+	/* The initial temperature for annealing from start: the one asked
+	 * for, or else cool_init scaled by how much better start is than the
+	 * identity schedule. */
+	template<typename Sched=Schedule>
+	double seeded_cool_init(const RunSettings& settings,
+			const Sched& start, shared_ptr<DirectionDatabase> dirdata) {
+		if (settings.start_cool_init > 0.0)
+			return settings.start_cool_init;
+		double identity_dist { Sched { dirdata, true, start.get_metric() }.total_distance() };
+		return settings.cool_init * start.total_distance() / identity_dist;
+	}
+
+	/* A copy of sch in the schedule type S. */
+	template<typename S, typename From=Schedule>
+	unique_ptr<S> convert(const From& sch, shared_ptr<DirectionDatabase> dirdata) {
+		vector<dir_id_t> ids {};
+		vector<bool> othr {};
+		ids.reserve(sch.get_num_dir());
+		othr.reserve(sch.get_num_dir());
+		for (size_t k {0}; k < sch.get_num_dir(); k++) {
+			ids.push_back(sch.get_id_at(k));
+			othr.push_back(sch.is_other_at(k));
+		}
+		return make_unique<S>(move(ids), move(othr), dirdata);
+	}
+
+} // namespace construction
+
+/* ************************************************** */
+
+class TelConstructor {
+/* Runs one of the construction heuristics above on a run id, and saves
+ * its schedule alongside the other solutions, in the format of
+ * TelGreedy.h.  The heuristics are named as in the --start option:
+ * "sfc", "greedy-edge" and "nn".
+ */
+public:
+	TelConstructor(int run_id, shared_ptr<DirectionDatabase> dirdata,
+				bool without_second_rep, const RunSettings& settings) :
+		run_id {run_id},
+		dirdatabase {dirdata},
+		without_second_rep {without_second_rep},
+		settings {settings},
+		time_running {}
+		{}
+	~TelConstructor() = default;
+	TelConstructor(TelConstructor&) = delete;
+	TelConstructor(TelConstructor&&) = delete;
+
+	TelConstructor& operator=(TelConstructor&) = delete;
+	TelConstructor& operator=(TelConstructor&&) = delete;
+
+	string get_save_filename(int run_id, const string& method) {
+		string sr { (without_second_rep ? "no-second-rep/" : "" ) };
+		return get_run_folder(run_id) + sr + method + "-solution.txt";
+	}
+
+	unique_ptr<Schedule> run_and_save(const string& method) {
+		TRACE_SPAN_ID("construct", run_id);
+		auto start { chrono::high_resolution_clock::now() };
+		auto sch { construction::build(method, dirdatabase,
+										without_second_rep, settings) };
+		auto stop { chrono::high_resolution_clock::now() };
+		time_running = stop - start;
+		save(get_save_filename(run_id, method), method, *sch);
+		return sch;
+	}
+
+private:
+	int run_id;
+	shared_ptr<DirectionDatabase> dirdatabase;
+	bool without_second_rep;
+	const RunSettings& settings;
+	nanos time_running;
+
+	void save(string filename, const string& method, const Schedule& sch) {
+		TRACE_SPAN("construct: save");
+		ofstream o { file_writer(filename)};
+		o.setf(ios_base::fixed);
+		o << setprecision(10);
+		o << "Run id: " << run_id
+		  << "\nObjective: " << sch.total_distance()
+		  << "\nTime running (ns): " << time_running.count()
+		  << "\n" << SEPARATOR
+		  << "\nConstruction (" << method << ") solution:\n"
+		  << sch
+		  << SEPARATOR
+		  << endl;
+		o.close();
+	}
+};
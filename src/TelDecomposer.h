@@ -0,0 +1,367 @@
+#pragma once
+
+#include "includes.h"
+
+#include <optional>
+
+#include "RunSettings.h"
+#include "Schedule.h"
+#include "ScheduleMoves.h"
+#include "TelAnnealer.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+using nanos = std::chrono::nanoseconds;
+
+class TelDecomposer {
+/* Solves a large problem by splitting the sky into regions, annealing
+ * each region separately (and in parallel), and joining the pieces.
+ * The steps, each in its own method below, are:
+ *
+ * 1. partition():  lay a grid over the (theta, phi) torus of telescope
+ *    configurations.  Each Direction may sit in either of two cells,
+ *    one per rep.  It joins the cell of its first rep, unless that cell
+ *    is already full (holding the region size) and the other is less
+ *    full, so that neighbours stay together but no region grows far
+ *    past the region size.  (Without the second rep, it always joins
+ *    the cell of its first.)
+ *
+ * 2. order_regions():  visit the non-empty cells in nearest-neighbour
+ *    order of their centres, starting from the cell of Direction 0.
+ *
+ * 3. choose_ends():  between consecutive regions, the exit of one and
+ *    the entry of the next are the closest pair found near the border.
+ *
+ * 4. anneal_regions():  anneal each region's piece of the schedule on
+ *    a thread pool, keeping its entry first and its exit last.
+ *
+ * 5. stitch() and repair_boundaries():  join the pieces in order, then
+ *    try every reversal within a small window around each join.
+ */
+public:
+	TelDecomposer(int run_id, shared_ptr<DirectionDatabase> dirdata,
+				bool without_second_rep, const RunSettings& settings) :
+		run_id {run_id},
+		dirdatabase    {dirdata},
+		num_dir        {dirdatabase->get_num_directions_defined()},
+		without_second_rep {without_second_rep},
+		settings {settings},
+		regions {},
+		sch {nullptr},
+		time_running {}
+		{}
+	~TelDecomposer() = default;
+	TelDecomposer(TelDecomposer&) = delete;
+	TelDecomposer(TelDecomposer&&) = delete;
+
+	TelDecomposer& operator=(TelDecomposer&) = delete;
+	TelDecomposer& operator=(TelDecomposer&&) = delete;
+
+	string get_save_filename(int run_id) {
+		string sr { (without_second_rep ? "no-second-rep/" : "" ) };
+		return get_run_folder(run_id) + sr + "decomposition-solution.txt";
+	}
+
+	double run_and_save() {
+		TRACE_SPAN_ID("decompose", run_id);
+		auto start { chrono::high_resolution_clock::now() };
+		partition();
+		order_regions();
+		choose_ends();
+		anneal_regions();
+		stitch();
+		obj_before_repair = sch->total_distance();
+		repair_boundaries();
+		auto stop { chrono::high_resolution_clock::now() };
+		time_running = stop - start;
+		save(get_save_filename(run_id));
+		return sch->total_distance();
+	}
+
+private:
+	struct Region {
+		vector<dir_id_t> ids {};
+		vector<bool>     othr {};
+		double theta_centre {}, phi_centre {};
+		size_t entry {}, exit {};      // indices into ids
+		vector<dir_id_t> solved_ids {};
+		vector<bool>     solved_othr {};
+	};
+
+	static constexpr size_t REPAIR_WINDOW  { 8 };
+	static constexpr size_t BORDER_SAMPLE  { 64 };
+	static constexpr long MIN_REGION_EPOCHS { 10'000 };
+
+	/* ************************************************** */
+
+	void partition() {
+		size_t target { std::max<size_t>(1, (num_dir + settings.region_size - 1)
+												/ settings.region_size) };
+		/* Roughly square cells, since the metric is a maximum over the two
+		 * angles, and theta covers twice the range of phi.  An even number
+		 * of phi bands puts a Direction's two reps in different bands. */
+		int bands_phi { 2 * std::max(1, static_cast<int>(
+								std::round(std::sqrt(target / 2.0) / 2))) };
+		int bands_theta { std::max(1, static_cast<int>(
+								std::round(target / double(bands_phi)))) };
+
+		auto cell_of = [&] (const Direction& d) {
+			int kt { static_cast<int>(d.get_theta() / TWO_PI * bands_theta) };
+			int kp { static_cast<int>((d.get_phi() + PI / 2) / PI * bands_phi) };
+			kt = std::clamp(kt, 0, bands_theta - 1);
+			kp = std::clamp(kp, 0, bands_phi - 1);
+			return kp * bands_theta + kt;
+		};
+
+		vector<Region> cells (bands_theta * bands_phi);
+		for (dir_id_t id {0}; id < num_dir; id++) {
+			int c_prime { cell_of(dirdatabase->get_direction(id, false)) };
+			int c_other { cell_of(dirdatabase->get_direction(id, true)) };
+			size_t n_prime { cells[c_prime].ids.size() };
+			size_t n_other { cells[c_other].ids.size() };
+			bool use_other { not without_second_rep and id != 0
+						and n_prime >= settings.region_size and n_other < n_prime };
+			Region& r { cells[use_other ? c_other : c_prime] };
+			r.ids.push_back(id);
+			r.othr.push_back(use_other);
+		}
+
+		regions.clear();
+		for (auto& r : cells) {
+			if (r.ids.empty())
+				continue;
+			/* The average theta must respect the wrap-around at 2 pi. */
+			double sum_sin {0}, sum_cos {0}, sum_phi {0};
+			for (size_t k {0}; k < r.ids.size(); k++) {
+				const Direction& d { dirdatabase->get_direction(r.ids[k], r.othr[k]) };
+				sum_sin += std::sin(d.get_theta());
+				sum_cos += std::cos(d.get_theta());
+				sum_phi += d.get_phi();
+			}
+			r.theta_centre = std::atan2(sum_sin, sum_cos);
+			if (r.theta_centre < 0)
+				r.theta_centre += TWO_PI;
+			r.phi_centre = sum_phi / r.ids.size();
+			regions.push_back(move(r));
+		}
+	}
+
+	void order_regions() {
+		/* Direction 0 is always placed first, so its region leads. */
+		size_t first { 0 };
+		for (size_t k {0}; k < regions.size(); k++) {
+			if (regions[k].ids.front() == 0)
+				first = k;
+		}
+		std::swap(regions[0], regions[first]);
+
+		for (size_t k {1}; k < regions.size(); k++) {
+			Direction here { 0, regions[k-1].theta_centre, regions[k-1].phi_centre };
+			size_t best_k {k};
+			double best_dist { numeric_limits<double>::max() };
+			for (size_t k2 {k}; k2 < regions.size(); k2++) {
+				Direction there { 0, regions[k2].theta_centre, regions[k2].phi_centre };
+				double d { here.dist_to(there) };
+				if (d < best_dist) {
+					best_dist = d;
+					best_k = k2;
+				}
+			}
+			std::swap(regions[k], regions[best_k]);
+		}
+	}
+
+	void choose_ends() {
+		regions[0].entry = 0;  // Direction 0, as placed by partition()
+		for (size_t k {0}; k + 1 < regions.size(); k++) {
+			Region& r1 { regions[k] };
+			Region& r2 { regions[k+1] };
+			/* Only the Directions of each region nearest the other's centre
+			 * are considered, which is enough to find a close pair. */
+			auto near_centre = [&] (const Region& r, const Region& other,
+									std::optional<size_t> skip) {
+				Direction centre { 0, other.theta_centre, other.phi_centre };
+				vector<pair<double, size_t>> by_dist {};
+				for (size_t idx {0}; idx < r.ids.size(); idx++) {
+					if (skip and *skip == idx)
+						continue;
+					by_dist.push_back({ centre.dist_to(
+							dirdatabase->get_direction(r.ids[idx], r.othr[idx])), idx });
+				}
+				size_t keep { std::min(BORDER_SAMPLE, by_dist.size()) };
+				std::partial_sort(by_dist.begin(), by_dist.begin() + keep, by_dist.end());
+				by_dist.resize(keep);
+				return by_dist;
+			};
+			std::optional<size_t> skip_entry {};
+			if (r1.ids.size() > 1)
+				skip_entry = r1.entry;
+			auto cand1 { near_centre(r1, r2, skip_entry) };
+			auto cand2 { near_centre(r2, r1, std::nullopt) };
+
+			double best_dist { numeric_limits<double>::max() };
+			for (auto& [d1, idx1] : cand1) {
+				const Direction& a { dirdatabase->get_direction(r1.ids[idx1], r1.othr[idx1]) };
+				for (auto& [d2, idx2] : cand2) {
+					double d { a.dist_to(
+							dirdatabase->get_direction(r2.ids[idx2], r2.othr[idx2])) };
+					if (d < best_dist) {
+						best_dist = d;
+						r1.exit  = idx1;
+						r2.entry = idx2;
+					}
+				}
+			}
+		}
+	}
+
+	/* ************************************************** */
+
+	void solve_region(Region& r, bool fixed_end) {
+		/* Build a small database for the region, with the entry as
+		 * Direction 0, the exit (if fixed) last, and every Direction in
+		 * its chosen rep.  Local ids map back through local_to_idx. */
+		size_t m { r.ids.size() };
+		vector<size_t> local_to_idx {};
+		local_to_idx.reserve(m);
+		local_to_idx.push_back(r.entry);
+		for (size_t idx {0}; idx < m; idx++) {
+			if (idx != r.entry and not (fixed_end and idx == r.exit))
+				local_to_idx.push_back(idx);
+		}
+		if (fixed_end and r.exit != r.entry)
+			local_to_idx.push_back(r.exit);
+
+		auto subdata { make_shared<DirectionDatabase>(m) };
+		for (dir_id_t local {0}; local < m; local++) {
+			size_t idx { local_to_idx[local] };
+			const Direction& d { dirdatabase->get_direction(r.ids[idx], r.othr[idx]) };
+			subdata->place_direction(Direction { local, d.get_theta(), d.get_phi() });
+		}
+
+		r.solved_ids.clear();
+		r.solved_othr.clear();
+		size_t end_movable { fixed_end ? m - 1 : m };
+		if (end_movable < 3) {
+			// Too small to anneal; keep the order as built.
+			for (size_t idx : local_to_idx) {
+				r.solved_ids.push_back(r.ids[idx]);
+				r.solved_othr.push_back(r.othr[idx]);
+			}
+			return;
+		}
+
+		/* Each region gets its share of the epochs, by size, and the
+		 * cooling schedule is compressed to match. */
+		double share { double(m) / num_dir };
+		long epochs { std::max(MIN_REGION_EPOCHS,
+						static_cast<long>(settings.num_epochs * share)) };
+		long flat_epochs { std::max(1L,
+						static_cast<long>(settings.cool_flat_epochs
+										* double(epochs) / settings.num_epochs)) };
+		unique_ptr<cooling::CoolingFn> coolptr {
+			new cooling::PiecewiseConstGeomCool
+					{ settings.cool_init, settings.cool_base, flat_epochs }
+		};
+		TelAnnealer annealer { run_id, move(coolptr), subdata,
+								without_second_rep, fixed_end };
+		annealer.set_file_output(false);
+		annealer.set_rejection_free_below(settings.rejection_free_below);
+		annealer.set_acceptance(cooling::acceptance_from_name(settings.acceptance),
+							 settings.lahc_history);
+		annealer.run(epochs, 0);
+
+		const Schedule& best { annealer.get_best_state() };
+		for (size_t pos {0}; pos < m; pos++) {
+			size_t idx { local_to_idx[best.get_id_at(pos)] };
+			r.solved_ids.push_back(r.ids[idx]);
+			r.solved_othr.push_back(r.othr[idx] != best.is_other_at(pos));
+		}
+	}
+
+	void anneal_regions() {
+		ThreadPool pool { static_cast<size_t>(std::max(1, settings.run_threads)) };
+		vector<future<void>> done {};
+		for (size_t k {0}; k < regions.size(); k++) {
+			bool fixed_end { k + 1 < regions.size() };
+			done.push_back(pool.submit([this, k, fixed_end] () {
+				solve_region(regions[k], fixed_end);
+			}));
+		}
+		for (auto& f : done)
+			f.get();
+	}
+
+	void stitch() {
+		vector<dir_id_t> s_ids {};
+		vector<bool>     s_othr {};
+		s_ids.reserve(num_dir);
+		s_othr.reserve(num_dir);
+		borders.clear();
+		for (auto& r : regions) {
+			if (not s_ids.empty())
+				borders.push_back(s_ids.size());
+			s_ids.insert(s_ids.end(), r.solved_ids.begin(), r.solved_ids.end());
+			s_othr.insert(s_othr.end(), r.solved_othr.begin(), r.solved_othr.end());
+		}
+		sch = make_unique<Schedule>(move(s_ids), move(s_othr), dirdatabase);
+	}
+
+	void repair_boundaries() {
+		/* First-improvement search over every reversal (i, j, switch_rep)
+		 * with both ends within REPAIR_WINDOW of a join, repeated around
+		 * each join until nothing improves. */
+		for (size_t b : borders) {
+			size_t lo { std::max<size_t>(1, b > REPAIR_WINDOW ? b - REPAIR_WINDOW : 1) };
+			size_t hi { std::min(num_dir - 1, b + REPAIR_WINDOW) };
+			bool improved {true};
+			while (improved) {
+				improved = false;
+				for (size_t i {lo}; i <= hi; i++) {
+					for (size_t j {i}; j <= hi; j++) {
+						for (int sr {0}; sr < 2; sr++) {
+							bool switch_rep { (sr == 1) };
+							if (switch_rep and without_second_rep)
+								continue;
+							if (reversal_delta(*sch, i, j, switch_rep) < -IMPROVEMENT_EPS) {
+								sch->flip_segment(i, j, switch_rep);
+								improved = true;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void save(string filename) {
+		TRACE_SPAN("decompose: save");
+		ofstream o { file_writer(filename)};
+		o.setf(ios_base::fixed);
+		o << setprecision(10);
+		o << "Run id: " << run_id
+		  << "\nObjective: " << sch->total_distance()
+		  << "\nTime running (ns): " << time_running.count()
+		  << "\nRegions: " << regions.size()
+		  << "\nObjective before boundary repair: " << obj_before_repair
+		  << "\n" << SEPARATOR
+		  << "\nDecomposition solution:\n"
+		  << *sch
+		  << SEPARATOR
+		  << endl;
+		o.close();
+	}
+
+	static constexpr double IMPROVEMENT_EPS { 1e-12 };
+
+	int run_id;
+	shared_ptr<DirectionDatabase> dirdatabase;
+	size_t num_dir;
+	bool without_second_rep;
+	RunSettings settings;
+	vector<Region> regions;
+	vector<size_t> borders {};
+	unique_ptr<Schedule> sch;
+	double obj_before_repair {};
+	nanos time_running;
+};
@@ -4,35 +4,51 @@
 
 #include <unordered_set>
 
+#include "Counters.h"
 #include "Schedule.h"
+#include "Trace.h"
 
 using nanos = std::chrono::nanoseconds;
 
-class TelGreedy {
+/* Nearest neighbour from Direction #0, where "nearest" is by Metric (see
+ * Metrics.h); TelGreedy is the usual Chebyshev case.
+ */
+template<typename Metric>
+class TelGreedyFor {
 public:
-	TelGreedy(int run_id, shared_ptr<DirectionDatabase> dirdata,
-				bool without_second_rep) :
+	using schedule_type = BasicSchedule<dir_id_t, DualRep, Metric>;
+
+	TelGreedyFor(int run_id, shared_ptr<DirectionDatabase> dirdata,
+				bool without_second_rep, const Metric& metric={}) :
 		run_id {run_id},
 		dirdatabase    {dirdata},
 		num_dir        {dirdatabase->get_num_directions_defined()},
 		sch {nullptr},
 		without_second_rep {without_second_rep},
+		metric {metric},
 		time_running {}
 		{}
-	~TelGreedy() = default;
-	TelGreedy(TelGreedy&) = delete;
-	TelGreedy(TelGreedy&&) = delete;
+	~TelGreedyFor() = default;
+	TelGreedyFor(TelGreedyFor&) = delete;
+	TelGreedyFor(TelGreedyFor&&) = delete;
 
-	TelGreedy& operator=(TelGreedy&) = delete;
-	TelGreedy& operator=(TelGreedy&&) = delete;
+	TelGreedyFor& operator=(TelGreedyFor&) = delete;
+	TelGreedyFor& operator=(TelGreedyFor&&) = delete;
 
 	string get_save_filename(int run_id) {
 		string sr { (without_second_rep ? "no-second-rep/" : "" ) };
-		return OUTPUT_FOLDER + "run-" + to_string(run_id) +
-					"/" + sr + "greedy-solution.txt";
+		return get_run_folder(run_id) + sr + "greedy-solution.txt";
 	}
 
 	double run_and_save() {
+		double dist { run() };
+		save(get_save_filename(run_id));
+		return dist;
+	}
+
+	/* As run_and_save(), without saving. */
+	double run() {
+		TRACE_SPAN_ID("greedy", run_id);
 		vector<dir_id_t> s_ids {};
 		vector<bool>     s_othr {};
 		s_ids.reserve(num_dir);
@@ -53,6 +69,7 @@ public:
 		auto start { chrono::high_resolution_clock::now() };
 		s_ids.push_back(0);
 		s_othr.push_back(false);
+		COUNT_PHASE(greedy);
 		while (not unvisited.empty()) {
 			dir_id_t best_id   { 1 }; // will be reset
 			bool     best_othr { false };
@@ -63,7 +80,7 @@ public:
 					bool use_othr { (othr == 1) };
 					if (use_othr and without_second_rep)
 						continue;
-					double potential_dist { current_dir->dist_to(
+					double potential_dist { metric(*current_dir,
 								dirdatabase->get_direction(uv, use_othr)) };
 					if (potential_dist < best_dist) {
 						best_id = uv;
@@ -79,20 +96,30 @@ public:
 		}
 		auto stop { chrono::high_resolution_clock::now() };
 		time_running = stop - start;
-		sch = make_unique<Schedule>(move(s_ids), move(s_othr), dirdatabase);
-		save(get_save_filename(run_id));
+		sch = make_unique<schedule_type>(move(s_ids), move(s_othr), dirdatabase, metric);
 		return sch->total_distance();
 	}
 
+	/* The schedule found by the last run_and_save(). */
+	const schedule_type& get_schedule() const {
+		return *sch;
+	}
+
+	nanos get_time_running() const {
+		return time_running;
+	}
+
 private:
 	int run_id;
 	shared_ptr<DirectionDatabase> dirdatabase;
 	size_t num_dir;
-	unique_ptr<Schedule> sch;
+	unique_ptr<schedule_type> sch;
 	bool without_second_rep;
+	Metric metric;
 	nanos time_running;
 
 	void save(string filename) {
+		TRACE_SPAN("greedy: save");
 		ofstream o { file_writer(filename)};
 		o.setf(ios_base::fixed);
 		o << setprecision(10);
@@ -107,3 +134,5 @@ private:
 		o.close();
 	}
 };
+
+using TelGreedy = TelGreedyFor<metric::Chebyshev>;
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "includes.h"
+
+#include "Schedule.h"
+#include "SimAnneal.h"
+#include "TelAnnealer.h"
+
+using nanos = std::chrono::nanoseconds;
+
+class TelReplanner {
+/* Keeps a good schedule good while Directions come and go, without
+ * annealing again from scratch.
+ *
+ * A new Direction goes wherever (and in whichever rep) it adds the
+ * least distance: cheapest insertion, in O(n).  A Direction that is
+ * dropped is simply cut out, joining its two neighbours.  Either way the
+ * rest of the schedule stays as it was, so the only part likely to be
+ * improvable is near the change.  A short anneal follows, at a low
+ * temperature and with reversals limited to the window of positions
+ * around the change; see TelAnnealerFor::restrict_to(...).  On its
+ * default settings a re-plan takes a few milliseconds.
+ *
+ * The replanner changes the DirectionDatabase it is given, which must
+ * not be in use elsewhere meanwhile.
+ */
+public:
+	TelReplanner(int run_id, shared_ptr<DirectionDatabase> dirdata,
+				const Schedule& start, bool without_second_rep,
+				size_t window=32, unsigned long burst_epochs=20'000) :
+		run_id {run_id},
+		dirdatabase {dirdata},
+		sch {start.duplicate()},
+		without_second_rep {without_second_rep},
+		window {window},
+		burst_epochs {burst_epochs},
+		num_bursts {0},
+		time_running {}
+		{}
+	~TelReplanner() = default;
+	TelReplanner(TelReplanner&) = delete;
+	TelReplanner(TelReplanner&&) = delete;
+
+	TelReplanner& operator=(TelReplanner&) = delete;
+	TelReplanner& operator=(TelReplanner&&) = delete;
+
+	/* Adds a Direction at (theta, phi), returning its new id. */
+	dir_id_t insert(double theta, double phi) {
+		auto start { chrono::high_resolution_clock::now() };
+		dir_id_t id { dirdatabase->add_direction(theta, phi) };
+
+		/* Inserting at index k puts the new Direction between those now at
+		 * k-1 and k; at the very end, only the first edge is new. */
+		size_t best_idx {1};
+		bool best_othr {false};
+		double best_added { numeric_limits<double>::infinity() };
+		size_t n { sch->get_num_dir() };
+		for (int othr {0}; othr < (without_second_rep ? 1 : 2); othr++) {
+			const Direction& d { dirdatabase->get_direction(id, (othr == 1)) };
+			for (size_t k {1}; k <= n; k++) {
+				const Direction& before { sch->direction_at(k - 1) };
+				double added { before.dist_to(d) };
+				if (k < n) {
+					const Direction& after { sch->direction_at(k) };
+					added += d.dist_to(after) - before.dist_to(after);
+				}
+				if (added < best_added) {
+					best_added = added;
+					best_idx = k;
+					best_othr = (othr == 1);
+				}
+			}
+		}
+		sch->insert_at(best_idx, id, best_othr);
+		polish_around(best_idx);
+		time_running = chrono::high_resolution_clock::now() - start;
+		return id;
+	}
+
+	/* Drops Direction id.  Returns the id of the Direction that took over
+	 * id in the database; see DirectionDatabase::remove_direction(...). */
+	dir_id_t remove(dir_id_t id) {
+		auto start { chrono::high_resolution_clock::now() };
+		size_t idx { sch->index_of(id) };
+		dir_id_t moved { dirdatabase->remove_direction(id) };
+		sch->erase_at(idx);
+		if (moved != id)
+			sch->rename(moved, id);
+		polish_around(std::min(idx, sch->get_num_dir() - 1));
+		time_running = chrono::high_resolution_clock::now() - start;
+		return moved;
+	}
+
+	const Schedule& get_schedule() const {
+		return *sch;
+	}
+
+	/* Time taken by the last insert(...) or remove(...). */
+	nanos get_time_running() const {
+		return time_running;
+	}
+
+private:
+	/* The burst starts at BURST_TEMP times the average edge length, and
+	 * halves BURST_HALVINGS times over its epochs. */
+	static constexpr double BURST_TEMP { 0.1 };
+	static constexpr long BURST_HALVINGS { 8 };
+
+	void polish_around(size_t idx) {
+		size_t n { sch->get_num_dir() };
+		size_t lo { idx > window ? idx - window : 1 };
+		size_t hi { std::min(idx + window, n - 1) };
+		if (n < 3 or lo >= hi or burst_epochs == 0)
+			return;
+
+		double mean_edge { sch->total_distance() / (n - 1) };
+		unique_ptr<cooling::CoolingFn> coolptr {
+			new cooling::PiecewiseConstGeomCool
+					{ BURST_TEMP * mean_edge, 0.5,
+					  std::max(1L, static_cast<long>(burst_epochs) / BURST_HALVINGS) }
+		};
+		TelAnnealer annealer { run_id, move(coolptr), dirdatabase, without_second_rep };
+		annealer.restrict_to(lo, hi);
+		annealer.set_file_output(false);
+		annealer.set_chain_index(++num_bursts);  // a fresh random stream each time
+		annealer.start_from(*sch);
+		annealer.begin_run(burst_epochs, 0);
+		annealer.advance(burst_epochs);
+		annealer.finish_run();
+		sch->copy_from(annealer.get_best_state());
+	}
+
+	int run_id;
+	shared_ptr<DirectionDatabase> dirdatabase;
+	unique_ptr<Schedule> sch;
+	bool without_second_rep;
+	size_t window;
+	unsigned long burst_epochs;
+	int num_bursts;
+	nanos time_running;
+};
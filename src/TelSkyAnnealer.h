@@ -0,0 +1,66 @@
+#pragma once
+
+#include "includes.h"
+#include "Sky.h"
+#include "TelAnnealer.h"
+
+/* Anneals a schedule of drifting targets (see Sky.h) with the steps of
+ * TelAnnealer, minimizing the time spent slewing.  A step's change in
+ * objective is estimated from a sky::Timeline of the current state, at
+ * a cost independent of the number of Directions after the step, and a
+ * step taken rebuilds the timeline from where the schedule changed.
+ *
+ * The timeline is of whichever state objective_to_minimize(...) last
+ * saw, which is the current state whenever the annealer changes it by
+ * any other means than a step (at the start of a run, on a restart and
+ * when resynchronizing).  Rejection-free annealing keeps exact weights
+ * of every step, which would each take O(n) to update here, so it is
+ * never switched to.
+ */
+class TelSkyAnnealer : public TelAnnealer {
+public:
+	TelSkyAnnealer(int run_id, unique_ptr<cooling::CoolingFn>&& cooler,
+				shared_ptr<const sky::Sky> sky,
+				shared_ptr<DirectionDatabase> dirdata,
+				bool without_second_rep) :
+		TelAnnealer {run_id, move(cooler), dirdata, without_second_rep},
+		timeline {sky},
+		timeline_of {nullptr},
+		estimate {0.0} {}
+
+	virtual ~TelSkyAnnealer() = default;
+	TelSkyAnnealer(TelSkyAnnealer&) = delete;
+	TelSkyAnnealer(TelSkyAnnealer&&) = delete;
+
+	virtual double objective_to_minimize(const Schedule& s) override {
+		timeline.rebuild(s);
+		timeline_of = &s;
+		return timeline.objective();
+	}
+
+	virtual double propose_step(const Schedule& s, std::mt19937_64& rand) override {
+		if (timeline_of != &s)
+			objective_to_minimize(s);
+		TelAnnealer::propose_step(s, rand);
+		const Reversal& r { last_proposed() };
+		estimate = timeline.reversal_delta(r.i, r.j, r.switch_rep);
+		return estimate;
+	}
+
+	virtual double apply_proposed_step(Schedule& s) override {
+		double before { timeline.objective() };
+		TelAnnealer::apply_proposed_step(s);
+		const Reversal& r { last_proposed() };
+		timeline.rebuild(s, std::min(r.i, r.j));
+		return (timeline.objective() - before) - estimate;
+	}
+
+	virtual bool rf_supported() override {
+		return false;
+	}
+
+private:
+	sky::Timeline timeline;
+	const Schedule* timeline_of;
+	double estimate;
+};
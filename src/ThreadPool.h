@@ -0,0 +1,92 @@
+#pragma once
+
+#include "includes.h"
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+class ThreadPool {
+/* A fixed number of worker threads taking tasks from a shared queue.
+ * Each call to submit(f) returns a future for the result of f(), and
+ * any exception thrown by f is rethrown from that future's get().
+ * The destructor finishes every task already submitted, then joins.
+ *
+ * If given, on_start(k) runs first on worker k, e.g. to pin it to CPUs
+ * (see Affinity.h).
+ *
+ * For the general pattern, see chapter 9 of the book "C++ Concurrency
+ * in Action" by A. Williams.
+ */
+public:
+	ThreadPool(size_t num_threads, function<void(size_t)> on_start={}) {
+		workers.reserve(num_threads);
+		for (size_t t {0}; t < num_threads; t++) {
+			workers.emplace_back([this, t, on_start] () {
+				if (on_start)
+					on_start(t);
+				work();
+			});
+		}
+	}
+
+	~ThreadPool() {
+		{
+			lock_guard<mutex> lock {queue_mutex};
+			stopping = true;
+		}
+		task_ready.notify_all();
+		for (auto& w : workers)
+			w.join();
+	}
+
+	ThreadPool(ThreadPool&)  = delete;
+	ThreadPool(ThreadPool&&) = delete;
+
+	/* NOTE:  std::function must be copyable, but packaged_task is only
+	 * movable, hence the shared_ptr around it.
+	 */
+	template<typename F>
+	auto submit(F&& f) -> future<decltype(f())> {
+		using result_t = decltype(f());
+		auto task { make_shared<packaged_task<result_t()>>(std::forward<F>(f)) };
+		future<result_t> result { task->get_future() };
+		{
+			lock_guard<mutex> lock {queue_mutex};
+			tasks.push([task] () { (*task)(); });
+		}
+		task_ready.notify_one();
+		return result;
+	}
+
+	size_t size() const {
+		return workers.size();
+	}
+
+private:
+	void work() {
+		while (true) {
+			function<void()> task {};
+			{
+				unique_lock<mutex> lock {queue_mutex};
+				task_ready.wait(lock, [this] () {
+					return stopping or not tasks.empty();
+				});
+				if (tasks.empty())
+					return;
+				task = move(tasks.front());
+				tasks.pop();
+			}
+			task();
+		}
+	}
+
+	vector<thread> workers {};
+	queue<function<void()>> tasks {};
+	mutex queue_mutex {};
+	condition_variable task_ready {};
+	bool stopping {false};
+};
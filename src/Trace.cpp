@@ -0,0 +1,170 @@
+#include "Trace.h"
+
+#ifdef TSA_TRACE
+
+#include <deque>
+#include <mutex>
+
+namespace trace {
+
+	namespace {
+		/* Spans kept per thread, once its ring buffer wraps around, and
+		 * kept in all of finished threads, in retired below. */
+		constexpr size_t RING_SIZE { 1 << 16 };
+
+		struct Event {
+			const char* name;
+			long long id, start_ns, dur_ns;
+		};
+
+		struct Ring {
+			int tid {};
+			string thread_name {};
+			/* Grows up to RING_SIZE, then next wraps around. */
+			vector<Event> events {};
+			size_t next {0};
+		};
+
+		/* A span of a finished thread, with that thread's tid and name. */
+		struct RetiredEvent {
+			int tid;
+			shared_ptr<const string> thread_name;
+			Event event;
+		};
+
+		std::mutex registry_mutex {};
+		/* The rings of the threads still running. */
+		vector<shared_ptr<Ring>> rings {};
+		/* The latest spans of finished threads, oldest first, so that a
+		 * service starting a thread per client keeps no more than this. */
+		std::deque<RetiredEvent> retired {};
+		int next_tid {0};
+
+		long long now_ns() {
+			static const auto trace_start { chrono::steady_clock::now() };
+			return chrono::duration_cast<chrono::nanoseconds>(
+					chrono::steady_clock::now() - trace_start).count();
+		}
+
+		/* Calls f on the spans of r, oldest first. */
+		template<typename F>
+		void for_each_event(const Ring& r, F f) {
+			size_t count { r.events.size() };
+			size_t oldest { count == RING_SIZE ? r.next : 0 };
+			for (size_t k {0}; k < count; k++)
+				f(r.events[(oldest + k) % count]);
+		}
+
+		/* Owns the calling thread's ring; when the thread exits, moves
+		 * its spans to retired and unregisters the ring. */
+		struct RingOwner {
+			shared_ptr<Ring> ring {};
+
+			~RingOwner() {
+				if (not ring)
+					return;
+				std::lock_guard<std::mutex> lock {registry_mutex};
+				auto name { make_shared<const string>(ring->thread_name) };
+				for_each_event(*ring, [&] (const Event& e) {
+					retired.push_back({ ring->tid, name, e });
+				});
+				while (retired.size() > RING_SIZE)
+					retired.pop_front();
+				rings.erase(std::find(rings.begin(), rings.end(), ring));
+			}
+		};
+
+		/* The calling thread's ring, registered on first use. */
+		Ring& my_ring() {
+			thread_local RingOwner owner {};
+			if (not owner.ring) {
+				owner.ring = make_shared<Ring>();
+				std::lock_guard<std::mutex> lock {registry_mutex};
+				owner.ring->tid = next_tid++;
+				rings.push_back(owner.ring);
+			}
+			return *owner.ring;
+		}
+
+		void write_escaped(ostream& o, const string& s) {
+			o << '"';
+			for (char c : s) {
+				if (c == '"' or c == '\\')
+					o << '\\';
+				o << c;
+			}
+			o << '"';
+		}
+	}
+
+	Span::Span(const char* name, long long id) :
+		name {name},
+		id {id},
+		start_ns {now_ns()} {}
+
+	Span::~Span() {
+		Ring& r { my_ring() };
+		Event e { name, id, start_ns, now_ns() - start_ns };
+		if (r.events.size() < RING_SIZE)
+			r.events.push_back(e);
+		else
+			r.events[r.next] = e;
+		if (++r.next == RING_SIZE)
+			r.next = 0;
+	}
+
+	void name_thread(const string& name) {
+		my_ring().thread_name = name;
+	}
+
+	/* Threads still recording meanwhile may have their latest spans
+	 * left out, so call this once the workers have finished. */
+	void write(const string& filename) {
+		std::lock_guard<std::mutex> lock {registry_mutex};
+		ofstream o { file_writer(filename) };
+		o << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+		bool first {true};
+		auto separate = [&] () {
+			o << (first ? "" : ",\n");
+			first = false;
+		};
+		o.setf(ios_base::fixed);
+		o << setprecision(3);
+		auto write_name = [&] (int tid, const string& name) {
+			if (name.empty())
+				return;
+			separate();
+			o << "{\"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+			  << ", \"name\": \"thread_name\", \"args\": {\"name\": ";
+			write_escaped(o, name);
+			o << "}}";
+		};
+		auto write_event = [&] (int tid, const Event& e) {
+			separate();
+			/* Chrome traces count in microseconds. */
+			o << "{\"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+			  << ", \"name\": ";
+			write_escaped(o, e.name);
+			o << ", \"ts\": " << e.start_ns / 1000.0
+			  << ", \"dur\": " << e.dur_ns / 1000.0;
+			if (e.id >= 0)
+				o << ", \"args\": {\"id\": " << e.id << "}";
+			o << "}";
+		};
+		int last_tid {-1};
+		for (auto& r : retired) {
+			if (r.tid != last_tid)
+				write_name(r.tid, *r.thread_name);
+			last_tid = r.tid;
+			write_event(r.tid, r.event);
+		}
+		for (auto& r : rings) {
+			write_name(r->tid, r->thread_name);
+			for_each_event(*r, [&] (const Event& e) { write_event(r->tid, e); });
+		}
+		o << "\n]}" << endl;
+	}
+
+} // namespace trace
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "includes.h"
+
+/* ************************************************** *
+ * Timeline tracing, to see which thread ran which run id and how long
+ * each phase (loading, greedy, annealing, saving) took.
+ *
+ * Tracing is compiled in only when TSA_TRACE is defined (compile with
+ * -DTSA_TRACE), and otherwise every TRACE_... macro below expands to
+ * nothing, so a normal build pays nothing for it.  A traced batch run
+ * or service writes its trace to output/trace.json on exit.
+ *
+ * - TRACE_SPAN("name") records the time from that line to the end of the
+ *   enclosing block.  TRACE_SPAN_ID("name", id) records an integer with
+ *   it, such as the run id.  The name must be a string literal.
+ *
+ * - TRACE_THREAD_NAME(str) labels the calling thread in the trace.
+ *
+ * - TRACE_WRITE(filename) writes everything recorded so far, from all
+ *   threads, as a Chrome trace (JSON), which chrome://tracing and
+ *   https://ui.perfetto.dev can display.
+ *
+ * Each thread records into a ring buffer of its own, so spans never
+ * contend for a lock; once a buffer is full, a thread's oldest spans
+ * are overwritten.  When a thread exits, its spans join those of other
+ * finished threads, of which only the latest are kept, so a service
+ * starting a thread per client does not grow without bound.  Spans are
+ * meant for phases lasting at least microseconds, not for single epochs.
+ */
+
+#ifdef TSA_TRACE
+
+namespace trace {
+
+	class Span {
+	public:
+		Span(const char* name, long long id=-1);
+		~Span();
+		Span(Span&)  = delete;
+		Span(Span&&) = delete;
+	private:
+		const char* name;
+		long long id;
+		long long start_ns;
+	};
+
+	void name_thread(const string& name);
+	void write(const string& filename);
+
+} // namespace trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) ::trace::Span TRACE_CONCAT(trace_span_, __LINE__) { name }
+#define TRACE_SPAN_ID(name, id) ::trace::Span TRACE_CONCAT(trace_span_, __LINE__) { name, id }
+#define TRACE_THREAD_NAME(str) ::trace::name_thread(str)
+#define TRACE_WRITE(filename) ::trace::write(filename)
+
+#else
+
+#define TRACE_SPAN(name) ((void) 0)
+#define TRACE_SPAN_ID(name, id) ((void) 0)
+#define TRACE_THREAD_NAME(str) ((void) 0)
+#define TRACE_WRITE(filename) ((void) 0)
+
+#endif
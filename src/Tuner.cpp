@@ -0,0 +1,343 @@
+#include "Tuner.h"
+
+#include <set>
+
+#include "SimAnneal.h"
+#include "TelAnnealer.h"
+#include "ThreadPool.h"
+
+namespace {
+	/* The items of a cell, separated by spaces. */
+	vector<string> split_items(const string& cell) {
+		vector<string> items {};
+		stringstream ss { cell };
+		string item {};
+		while (ss >> item)
+			items.push_back(strip_underscores(item));
+		return items;
+	}
+
+	/* Run ids, each either a single id or a range such as 10000-10023. */
+	vector<int> read_run_ids(const string& cell) {
+		vector<int> ids {};
+		for (auto& item : split_items(cell)) {
+			auto match = wrap_regex_match(item, "([0-9]+)(-([0-9]+))?",
+					"Run ids must be numbers or ranges A-B, but found \"" + item + "\"");
+			int first { stoi(match[1]) };
+			int last { match[3].matched ? stoi(match[3]) : first };
+			for (int id {first}; id <= last; id++)
+				ids.push_back(id);
+		}
+		return ids;
+	}
+
+	/* Writes n with underscores between groups of three digits, as in
+	 * run_details.csv. */
+	string with_underscores(long n) {
+		string digits { to_string(n) };
+		string out {};
+		for (size_t k {0}; k < digits.size(); k++) {
+			if (k > 0 and (digits.size() - k) % 3 == 0)
+				out += '_';
+			out += digits[k];
+		}
+		return out;
+	}
+
+	/* The epochs that rung k of num_rungs runs up to:  a fraction 1/2,
+	 * 1/4, ... of num_epochs for each rung before the last. */
+	long rung_epochs(long num_epochs, int k, int num_rungs) {
+		double fraction { std::ldexp(1.0, k - (num_rungs - 1)) };
+		return std::max(1L, static_cast<long>(std::ceil(num_epochs * fraction)));
+	}
+
+	bool same_cooling(const Tuner::Config& a, const Tuner::Config& b) {
+		return a.cool_init == b.cool_init and a.cool_base == b.cool_base
+				and a.cool_flat_epochs == b.cool_flat_epochs;
+	}
+}
+
+/* ************************************************** */
+
+Tuner::Tuner(const string& tuning_file, size_t workers, size_t samples) :
+	workers {workers},
+	samples {samples},
+	groups {},
+	instances {} {
+	if (workers == 0)
+		throw runtime_error("Tuning needs at least one worker.");
+	read_tuning_file(tuning_file);
+}
+
+void Tuner::read_tuning_file(const string& tuning_file) {
+	/* Every sample is drawn from one fixed stream, so that a tuning run
+	 * can be repeated. */
+	std::mt19937_64 rand {0};
+	for (auto& row : read_csv(tuning_file, 7)) {
+		Group group {};
+		group.num_dir = stoul(strip_underscores(row[0]));
+		group.run_ids = read_run_ids(row[1]);
+		group.second_rep = (row[2] == "yes" or row[2] == "y" or row[2] == "true");
+		if (group.run_ids.empty()) {
+			throw runtime_error("The group of " + to_string(group.num_dir)
+					+ " directions has no run ids.");
+		}
+
+		vector<long> epochs {}, flats {};
+		vector<double> inits {}, bases {};
+		for (auto& v : split_items(row[3]))
+			epochs.push_back(stol(v));
+		for (auto& v : split_items(row[4]))
+			inits.push_back(stod(v));
+		for (auto& v : split_items(row[5]))
+			bases.push_back(stod(v));
+		for (auto& v : split_items(row[6]))
+			flats.push_back(stol(v));
+		for (long e : epochs)
+			for (double i : inits)
+				for (double b : bases)
+					for (long f : flats)
+						group.configs.push_back(Config { e, i, b, f });
+		for (auto& c : group.configs) {
+			if (c.num_epochs <= 0 or c.cool_init <= 0.0 or c.cool_base <= 0.0
+					or c.cool_base >= 1.0 or c.cool_flat_epochs <= 0) {
+				throw runtime_error("The group of " + to_string(group.num_dir)
+						+ " directions has cooling settings out of range.");
+			}
+		}
+		if (group.configs.empty()) {
+			throw runtime_error("The group of " + to_string(group.num_dir)
+					+ " directions has no candidate settings.");
+		}
+		if (samples > 0 and samples < group.configs.size()) {
+			std::shuffle(group.configs.begin(), group.configs.end(), rand);
+			group.configs.resize(samples);
+		}
+
+		for (int run_id : group.run_ids) {
+			if (instances.count(run_id) == 0)
+				instances[run_id] = load_directions(run_id);
+			if (instances[run_id]->get_num_directions_defined() != group.num_dir) {
+				throw runtime_error("Run id " + to_string(run_id) + " does not"
+						" have " + to_string(group.num_dir) + " directions.");
+			}
+		}
+		groups.push_back(move(group));
+	}
+}
+
+void Tuner::run() {
+	vector<pair<Group, Config>> results {};
+	for (auto& group : groups) {
+		Config winner { tune(group) };
+		results.push_back({ group, winner });
+	}
+	write_results(results);
+}
+
+Tuner::Config Tuner::tune(Group& group) {
+	const size_t num_configs { group.configs.size() };
+	const size_t num_inst { group.run_ids.size() };
+
+	/* Configurations differing only in epochs would race alike, so only
+	 * the first of each cooling races. */
+	vector<size_t> alive {};
+	for (size_t c {0}; c < num_configs; c++) {
+		if (std::none_of(alive.begin(), alive.end(), [&] (size_t a) {
+					return same_cooling(group.configs[a], group.configs[c]); }))
+			alive.push_back(c);
+	}
+	const size_t num_raced { alive.size() };
+	const int halvings { num_raced <= 2 ? 0 : std::min(MAX_HALVINGS,
+			static_cast<int>(std::ceil(std::log2(num_raced))) - 1) };
+	const int num_rungs { halvings + 1 };
+	cout << "Tuning " << num_raced << " cooling settings on " << num_inst
+			<< " instances of " << group.num_dir << " directions, in "
+			<< num_rungs << " rungs..." << endl;
+
+	/* The race runs up to the fewest epochs of any configuration; the
+	 * chains are set up for the most, to choose NumEpochs afterwards. */
+	long min_epochs { group.configs.front().num_epochs };
+	long max_epochs { min_epochs };
+	for (auto& config : group.configs) {
+		min_epochs = std::min(min_epochs, config.num_epochs);
+		max_epochs = std::max(max_epochs, config.num_epochs);
+	}
+
+	/* One chain per configuration and instance.  Every configuration
+	 * anneals an instance from the same random stream, so that they are
+	 * compared on equal terms. */
+	vector<vector<unique_ptr<TelAnnealer>>> chains(num_configs);
+	for (size_t c : alive) {
+		const Config& config { group.configs[c] };
+		for (int run_id : group.run_ids) {
+			unique_ptr<cooling::CoolingFn> coolptr {
+				new cooling::PiecewiseConstGeomCool
+						{ config.cool_init, config.cool_base, config.cool_flat_epochs }
+			};
+			auto chain { make_unique<TelAnnealer>(run_id, move(coolptr),
+						instances.at(run_id), not group.second_rep) };
+			chain->set_file_output(false);
+			chain->begin_run(max_epochs, 0);
+			chains[c].push_back(move(chain));
+		}
+	}
+
+	ThreadPool pool { workers };
+	auto advance_to = [&] (const vector<unique_ptr<TelAnnealer>>& these, long target) {
+		vector<future<void>> done {};
+		for (auto& chain : these) {
+			TelAnnealer* ch { chain.get() };
+			done.push_back(pool.submit([ch, target] () {
+				ch->advance(target - ch->get_epoch());
+			}));
+		}
+		return done;
+	};
+	for (int k {0}; k < num_rungs; k++) {
+		long target { rung_epochs(min_epochs, k, num_rungs) };
+		vector<future<void>> done {};
+		for (size_t c : alive) {
+			for (auto& d : advance_to(chains[c], target))
+				done.push_back(move(d));
+		}
+		for (auto& d : done)
+			d.get();
+
+		/* Score against the best objective reached on each instance. */
+		vector<double> best(num_inst, numeric_limits<double>::infinity());
+		for (size_t c : alive)
+			for (size_t i {0}; i < num_inst; i++)
+				best[i] = std::min(best[i], chains[c][i]->get_obj_best());
+		for (size_t c : alive) {
+			Config& config { group.configs[c] };
+			double gap_sum {0};
+			for (size_t i {0}; i < num_inst; i++)
+				gap_sum += chains[c][i]->get_obj_best() / best[i] - 1;
+			config.score = gap_sum / num_inst;
+			config.last_rung = k;
+			config.epochs_run = target;
+		}
+
+		/* Better scores first; among equal ones, the earlier. */
+		std::stable_sort(alive.begin(), alive.end(), [&] (size_t a, size_t b) {
+			return group.configs[a].score < group.configs[b].score;
+		});
+		if (k < halvings) {
+			/* Keep a geometrically shrinking number, down to two for the
+			 * last rung. */
+			double keep_fraction { std::pow(2.0 / num_raced, (k + 1.0) / halvings) };
+			size_t keep { std::max<size_t>(2,
+					static_cast<size_t>(std::ceil(num_raced * keep_fraction))) };
+			for (size_t idx {keep}; idx < alive.size(); idx++)
+				chains[alive[idx]].clear();
+			alive.resize(std::min(keep, alive.size()));
+		}
+		const Config& leader { group.configs[alive.front()] };
+		cout << "Rung " << k << ": " << alive.size() << " configurations kept;"
+				<< " leading with mean gap " << to_string(leader.score)
+				<< " after " << leader.epochs_run << " epochs" << endl;
+	}
+
+	/* Then NumEpochs, among the candidates with the winner's cooling:  the
+	 * winner's chains go on through each in turn. */
+	const size_t lead { alive.front() };
+	vector<size_t> by_epochs {};
+	for (size_t c {0}; c < num_configs; c++) {
+		if (same_cooling(group.configs[c], group.configs[lead]))
+			by_epochs.push_back(c);
+	}
+	std::sort(by_epochs.begin(), by_epochs.end(), [&] (size_t a, size_t b) {
+		return group.configs[a].num_epochs < group.configs[b].num_epochs;
+	});
+	vector<vector<double>> objs {};
+	for (size_t c : by_epochs) {
+		for (auto& d : advance_to(chains[lead], group.configs[c].num_epochs))
+			d.get();
+		objs.push_back({});
+		for (auto& chain : chains[lead])
+			objs.back().push_back(chain->get_obj_best());
+	}
+	size_t winner { by_epochs.back() };
+	for (size_t e {0}; e < by_epochs.size(); e++) {
+		double gap_sum {0};
+		for (size_t i {0}; i < num_inst; i++)
+			gap_sum += objs[e][i] / objs.back()[i] - 1;
+		if (gap_sum / num_inst <= EPOCHS_TOLERANCE) {
+			winner = by_epochs[e];
+			break;
+		}
+	}
+	/* Those that did not race take the standing of the one that did. */
+	for (size_t c {0}; c < num_configs; c++) {
+		for (size_t raced {0}; raced < c; raced++) {
+			if (same_cooling(group.configs[raced], group.configs[c])) {
+				group.configs[c].last_rung = group.configs[raced].last_rung;
+				group.configs[c].score = group.configs[raced].score;
+				group.configs[c].epochs_run = group.configs[raced].epochs_run;
+				break;
+			}
+		}
+	}
+	group.configs[winner].epochs_run = group.configs[winner].num_epochs;
+	cout << "Choosing " << group.configs[winner].num_epochs << " of the "
+			<< by_epochs.size() << " candidate epochs" << endl;
+
+	for (size_t c : alive)
+		for (auto& chain : chains[c])
+			chain->finish_run();
+	return group.configs[winner];
+}
+
+void Tuner::write_results(const vector<pair<Group, Config>>& results) {
+	const string out_folder { OUTPUT_FOLDER + "tuning/" };
+
+	ofstream o { file_writer(out_folder + "configs.csv") };
+	o << setprecision(10);
+	o << "NumLocs, SecondRep, NumEpochs, CoolInit, CoolBase, CoolFlatEpochs,"
+		 " LastRung, EpochsRun, Score\n";
+	for (auto& [group, winner] : results) {
+		for (auto& c : group.configs) {
+			o << group.num_dir << ", " << (group.second_rep ? "yes" : "no")
+			  << ", " << c.num_epochs << ", " << c.cool_init << ", " << c.cool_base
+			  << ", " << c.cool_flat_epochs << ", " << c.last_rung
+			  << ", " << c.epochs_run << ", " << c.score << "\n";
+		}
+	}
+	o.close();
+
+	ofstream d { file_writer(out_folder + "run_details.csv") };
+	d << setprecision(10);
+	d << "# --------------------------------------------------\n"
+		 "# Cooling settings found by successive halving (--tune), one row\n"
+		 "# per group of the tuning file.  The columns are explained in\n"
+		 "# run_details.csv at the top of the repository.  FirstIdx and\n"
+		 "# Count are those of the instances tuned on, in as many rows as\n"
+		 "# it takes to cover them with ranges of consecutive run ids.\n"
+		 "# --------------------------------------------------\n"
+		 "Ignore, NumThreads, PlotOnly, CountPlotAll, CountAnimate, FirstIdx,"
+		 " Count, NumLocs,   NumEpochs,  VbEvery, CoolInit, CoolBase, CoolFlatEpochs\n";
+	cout.unsetf(ios_base::floatfield);
+	for (auto& [group, winner] : results) {
+		/* run.sh reads FirstIdx and Count as a range of run ids. */
+		std::set<int> run_ids { group.run_ids.begin(), group.run_ids.end() };
+		for (auto it { run_ids.begin() }; it != run_ids.end(); ) {
+			int first { *it };
+			size_t count {0};
+			for (; it != run_ids.end() and *it == first + static_cast<int>(count); ++it)
+				count++;
+			d << "     , " << std::max<size_t>(1, std::thread::hardware_concurrency())
+			  << ",  , 0, 1, " << with_underscores(first) << ", " << count
+			  << ", " << group.num_dir << ", " << with_underscores(winner.num_epochs)
+			  << ", " << with_underscores(std::max(1L, winner.num_epochs / 10))
+			  << ", " << winner.cool_init << ", " << winner.cool_base
+			  << ", " << with_underscores(winner.cool_flat_epochs) << "\n";
+		}
+		cout << "Best for " << group.num_dir << " directions: NumEpochs "
+				<< winner.num_epochs << ", CoolInit " << winner.cool_init
+				<< ", CoolBase " << winner.cool_base << ", CoolFlatEpochs "
+				<< winner.cool_flat_epochs << endl;
+	}
+	d.close();
+	cout << "Results written to " << out_folder << endl;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "includes.h"
+
+#include <map>
+
+#include "Direction.h"
+#include "RunSettings.h"
+
+class Tuner {
+/* Finds cooling settings (NumEpochs, CoolInit, CoolBase, CoolFlatEpochs)
+ * for each problem size by successive halving, all within one process,
+ * rather than by a full run of the program per trial.
+ *
+ * The tuning file (see tuning.csv at the top of the repository) has one
+ * row per group of instances, usually one per NumLocs:  the number of
+ * Directions, the run ids to tune on (loaded once, from the usual input
+ * files), whether the second rep is allowed, and for each of the four
+ * settings a list of candidate values separated by spaces.  The group's
+ * configurations are every combination of candidates, or, if samples is
+ * positive, that many of them drawn at random.
+ *
+ * Successive halving (Jamieson and Talwalkar, 2016) runs every
+ * configuration on every instance for a small fraction of the epochs,
+ * keeps the better configurations, runs those further, and so on, until
+ * the last few run the fewest NumEpochs of the group.  Every
+ * configuration runs the same epochs at each rung, so that the race
+ * compares cooling and not running time; of configurations differing
+ * only in NumEpochs, just one races, the others sharing its standing.
+ * Since a run of E epochs is, in its first E/8 epochs, exactly a run of
+ * E/8 epochs (the cooling does not depend on E), each rung simply
+ * continues the chains of the rung before; see SimAnnealer::advance(...).
+ * A configuration's score at a rung is its mean gap to the best
+ * objective any surviving configuration reached on each instance, so
+ * that large and small instances count alike.  Every chain is a task for
+ * one of workers threads.
+ *
+ * More epochs never do worse, so NumEpochs is chosen apart from the
+ * race:  the winner's chains continue through each candidate NumEpochs
+ * in turn, and the tuned value is the fewest that comes within
+ * EPOCHS_TOLERANCE (as a mean gap) of the most.
+ *
+ * The results go to output/tuning/:  configs.csv, every configuration
+ * with the last rung it reached and its score there, and
+ * run_details.csv, the winning settings of each group as rows of
+ * run_details.csv, ready to copy over or to run with run.sh, one row
+ * per range of consecutive run ids tuned on.
+ */
+public:
+	Tuner(const string& tuning_file, size_t workers, size_t samples);
+	~Tuner() = default;
+	Tuner(Tuner&)  = delete;
+	Tuner(Tuner&&) = delete;
+
+	/* Tunes every group, writing the results as described above. */
+	void run();
+
+	/* At most this many halvings per group, so that the first rung runs
+	 * at least 1/2^MAX_HALVINGS of the fewest NumEpochs of the group,
+	 * which every rung's epochs are fractions of. */
+	static constexpr int MAX_HALVINGS { 4 };
+
+	/* The mean gap to the most candidate epochs that fewer epochs may
+	 * leave, for the tuned NumEpochs. */
+	static constexpr double EPOCHS_TOLERANCE { 0.005 };
+
+	struct Config {
+		long   num_epochs;
+		double cool_init;
+		double cool_base;
+		long   cool_flat_epochs;
+		int    last_rung {0};
+		long   epochs_run {0};
+		double score {0.0};
+	};
+
+	struct Group {
+		size_t num_dir;
+		vector<int> run_ids;
+		bool second_rep;
+		vector<Config> configs;
+	};
+
+private:
+	void read_tuning_file(const string& tuning_file);
+	Config tune(Group& group);
+	void write_results(const vector<pair<Group, Config>>& results);
+
+	size_t workers;
+	size_t samples;
+	vector<Group> groups;
+	std::map<int, shared_ptr<DirectionDatabase>> instances;
+};
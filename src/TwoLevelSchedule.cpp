@@ -0,0 +1,385 @@
+#include "includes.h"
+#include "Counters.h"
+#include "TwoLevelSchedule.h"
+
+TwoLevelSchedule::TwoLevelSchedule(shared_ptr<DirectionDatabase> dirdata, bool,
+				 const metric_type&) :
+	dirdata { dirdata },
+	num_dir { dirdata->get_num_directions_defined() },
+	nodes {},
+	segs {},
+	first_seg {NONE},
+	group_size {},
+	max_segs {},
+	scratch {} {
+	/* As in Schedule, the identity schedule uses the Direction IDs
+	 * 0, 1, 2, ..., num_dir-1 in order.  Without do_setup, the list is
+	 * still built this way, since a list must always be consistent. */
+	vector<dir_id_t> ids (num_dir);
+	for (size_t j {0}; j<num_dir; j++) {
+		ids[j] = j;
+	}
+	build(ids, vector<bool>(num_dir, false));
+}
+
+TwoLevelSchedule::TwoLevelSchedule(vector<dir_id_t>&& sdidt,
+				 vector<bool>&& sdothr,
+				 shared_ptr<DirectionDatabase> dirdata) :
+		dirdata { dirdata },
+		num_dir { dirdata->get_num_directions_defined() },
+		nodes {},
+		segs {},
+		first_seg {NONE},
+		group_size {},
+		max_segs {},
+		scratch {} {
+	build(sdidt, sdothr);
+}
+
+void TwoLevelSchedule::build(const vector<dir_id_t>& ids, const vector<bool>& othr) {
+	/* Segments of group_size nodes each, about sqrt(n) of them.  The
+	 * list is rebuilt once splits have doubled the number of segments.
+	 */
+	group_size = std::max(8, static_cast<int>(std::sqrt(num_dir)));
+	size_t num_groups { (num_dir + group_size - 1) / group_size };
+	max_segs = 2 * num_groups + 8;
+
+	nodes.resize(num_dir);
+	segs.clear();
+	segs.reserve(max_segs + 2);
+	first_seg = (num_dir > 0 ? 0 : NONE);
+	for (size_t g {0}; g < num_groups; g++) {
+		node_t start ( g * group_size );
+		node_t stop  ( std::min(num_dir, (g + 1) * group_size) );
+		segs.push_back(Segment {
+				false, false,
+				start, stop - 1,
+				(g + 1 < num_groups ? static_cast<int>(g + 1) : NONE),
+				(g > 0 ? static_cast<int>(g - 1) : NONE),
+				static_cast<int>(g),
+				stop - start });
+		for (node_t n {start}; n < stop; n++) {
+			nodes[n] = Node {
+					ids[n], othr[n],
+					static_cast<int>(g),
+					(n + 1 < stop ? n + 1 : NONE),
+					(n > start ? n - 1 : NONE),
+					n - start };
+		}
+	}
+}
+
+void TwoLevelSchedule::rebuild() {
+	vector<dir_id_t> ids {};
+	vector<bool> othr {};
+	ids.reserve(num_dir);
+	othr.reserve(num_dir);
+	for (node_t n {first()}; n != NONE; n = next(n)) {
+		ids.push_back(nodes[n].id);
+		othr.push_back(is_other(n));
+	}
+	build(ids, othr);
+}
+
+void TwoLevelSchedule::renumber_segments() {
+	int rank {0};
+	for (int s {first_seg}; s != NONE; s = segs[s].next)
+		segs[s].rank = rank++;
+}
+
+unique_ptr<TwoLevelSchedule> TwoLevelSchedule::duplicate() const {
+	return make_unique<TwoLevelSchedule>(*this);
+}
+
+void TwoLevelSchedule::copy_from(const TwoLevelSchedule& source) {
+	if (source.num_dir != this->num_dir) {
+		throw std::runtime_error(
+				"Asked to copy a schedule with "
+				+ to_string(source.num_dir)
+				+ " Directions into a schedule with "
+				+ to_string(this->num_dir)
+				+ " Directions.");
+	}
+	nodes = source.nodes;
+	segs  = source.segs;
+	first_seg  = source.first_seg;
+	group_size = source.group_size;
+	max_segs   = source.max_segs;
+}
+
+double TwoLevelSchedule::total_distance() const {
+	COUNT_PHASE(total_distance);
+	double total_dist {0};
+	node_t n1 { first() };
+	if (n1 == NONE)
+		return 0;
+	for (node_t n2 { next(n1) }; n2 != NONE; n1 = n2, n2 = next(n2))
+		total_dist += dist(direction_of(n1), direction_of(n2));
+	return total_dist;
+}
+
+TwoLevelScheduleIterator TwoLevelSchedule::begin() const {
+	return TwoLevelScheduleIterator {this, first()};
+}
+TwoLevelScheduleIterator TwoLevelSchedule::end() const {
+	return TwoLevelScheduleIterator {this, NONE};
+}
+
+/* ************************************************** */
+
+TwoLevelSchedule::node_t TwoLevelSchedule::first() const {
+	return (first_seg == NONE ? NONE : seg_first(first_seg));
+}
+
+TwoLevelSchedule::node_t TwoLevelSchedule::next(node_t n) const {
+	node_t m { next_in_seg(n) };
+	if (m != NONE)
+		return m;
+	int s { segs[nodes[n].seg].next };
+	return (s == NONE ? NONE : seg_first(s));
+}
+
+TwoLevelSchedule::node_t TwoLevelSchedule::prev(node_t n) const {
+	node_t m { prev_in_seg(n) };
+	if (m != NONE)
+		return m;
+	int s { segs[nodes[n].seg].prev };
+	return (s == NONE ? NONE : seg_last(s));
+}
+
+long TwoLevelSchedule::order_of(node_t n) const {
+	/* Any number increasing along the schedule will do.  Ranks within a
+	 * segment lie well within (-num_dir, num_dir), so segment ranks are
+	 * spaced out by more than that. */
+	const Segment& s { segs[nodes[n].seg] };
+	long within { s.reversed ? -nodes[n].rank : nodes[n].rank };
+	return s.rank * (2 * static_cast<long>(num_dir) + 1) + within;
+}
+
+bool TwoLevelSchedule::between(node_t a, node_t b, node_t c) const {
+	long oa { order_of(a) }, ob { order_of(b) }, oc { order_of(c) };
+	return (oa <= ob and ob <= oc) or (oc <= ob and ob <= oa);
+}
+
+TwoLevelSchedule::node_t TwoLevelSchedule::node_at(size_t idx) const {
+	if (idx >= num_dir) {
+		throw std::out_of_range("Index is out of range: "
+					+ to_string(idx) + " out of "
+					+ to_string(num_dir));
+	}
+	int s { first_seg };
+	while (idx >= static_cast<size_t>(segs[s].size)) {
+		idx -= segs[s].size;
+		s = segs[s].next;
+	}
+	/* Walk from whichever end of the segment is closer. */
+	if (idx < static_cast<size_t>(segs[s].size) / 2) {
+		node_t n { seg_first(s) };
+		for (; idx > 0; idx--)
+			n = next_in_seg(n);
+		return n;
+	} else {
+		node_t n { seg_last(s) };
+		for (idx = segs[s].size - 1 - idx; idx > 0; idx--)
+			n = prev_in_seg(n);
+		return n;
+	}
+}
+
+/* ************************************************** */
+
+void TwoLevelSchedule::split_before(node_t n) {
+	/* Afterwards, n is the first node of its segment.  Only the smaller
+	 * of the two parts moves into the new segment, and it keeps the
+	 * reversed and flipped bits, so none of its links or reps change.
+	 *
+	 * In stored order the segment is [head .. x] followed by [y .. tail],
+	 * where x, y are p, n (or n, p if reversed) and p is the node just
+	 * before n in schedule order.
+	 */
+	node_t p { prev_in_seg(n) };
+	if (p == NONE)
+		return;
+	int s { nodes[n].seg };
+	bool rev { segs[s].reversed };
+	node_t x { rev ? n : p };
+	node_t y { rev ? p : n };
+	nodes[x].next = NONE;
+	nodes[y].prev = NONE;
+
+	int size_head_part { nodes[x].rank - nodes[segs[s].head].rank + 1 };
+	int size_tail_part { segs[s].size - size_head_part };
+	bool move_head_part { size_head_part <= size_tail_part };
+
+	int t { static_cast<int>(segs.size()) };
+	segs.push_back(segs[s]);
+	Segment& seg_s { segs[s] };
+	Segment& seg_t { segs[t] };
+	if (move_head_part) {
+		seg_t.head = seg_s.head; seg_t.tail = x; seg_t.size = size_head_part;
+		seg_s.head = y; seg_s.size = size_tail_part;
+	} else {
+		seg_t.head = y; seg_t.tail = seg_s.tail; seg_t.size = size_tail_part;
+		seg_s.tail = x; seg_s.size = size_head_part;
+	}
+	for (node_t m {seg_t.head}; m != NONE; m = nodes[m].next)
+		nodes[m].seg = t;
+
+	/* The stored head part comes first in schedule order, unless the
+	 * segment is reversed. */
+	bool t_goes_first { move_head_part != rev };
+	if (t_goes_first) {
+		seg_t.prev = seg_s.prev;
+		seg_t.next = s;
+		if (seg_s.prev != NONE)
+			segs[seg_s.prev].next = t;
+		else
+			first_seg = t;
+		seg_s.prev = t;
+	} else {
+		seg_t.next = seg_s.next;
+		seg_t.prev = s;
+		if (seg_s.next != NONE)
+			segs[seg_s.next].prev = t;
+		seg_s.next = t;
+	}
+}
+
+void TwoLevelSchedule::split_after(node_t n) {
+	node_t m { next_in_seg(n) };
+	if (m != NONE)
+		split_before(m);
+}
+
+void TwoLevelSchedule::reverse_within_segment(node_t a, node_t b, bool switch_rep) {
+	/* Here a and b share a segment.  Reverse the stored sub-list from u
+	 * to v (u stored first), reusing the same ranks, and switch reps. */
+	int s { nodes[a].seg };
+	node_t u { a }, v { b };
+	if (nodes[u].rank > nodes[v].rank)
+		std::swap(u, v);
+	node_t before { nodes[u].prev };
+	node_t after  { nodes[v].next };
+	int first_rank { nodes[u].rank };
+
+	scratch.clear();
+	for (node_t m {u}; m != after; m = nodes[m].next)
+		scratch.push_back(m);
+	std::reverse(scratch.begin(), scratch.end());
+
+	node_t last { before };
+	for (size_t k {0}; k < scratch.size(); k++) {
+		node_t m { scratch[k] };
+		nodes[m].prev = last;
+		nodes[m].rank = first_rank + k;
+		if (switch_rep)
+			nodes[m].othr = not nodes[m].othr;
+		if (last != NONE)
+			nodes[last].next = m;
+		last = m;
+	}
+	nodes[last].next = after;
+	if (after != NONE)
+		nodes[after].prev = last;
+	if (before == NONE)
+		segs[s].head = scratch.front();
+	if (after == NONE)
+		segs[s].tail = last;
+}
+
+void TwoLevelSchedule::flip_segment(size_t i, size_t j, bool switch_rep) {
+	if (i > j) {
+		flip_segment(j, i, switch_rep);
+		return;
+	} else if (j >= this->num_dir) {
+		throw std::out_of_range(
+				"Asked to flip range within schedule between indices "
+				+ to_string(i) + " and " + to_string(j)
+				+ " (inclusive) but there are only "
+				+ to_string(num_dir) + " Directions.");
+	} else if (i == 0) {
+		throw std::runtime_error(
+				"Rescheduling the Direction at index i=0 is not permitted.");
+	}
+	COUNT_PHASE(flip_segment);
+
+	node_t a { node_at(i) };
+	node_t b { node_at(j) };
+	if (nodes[a].seg == nodes[b].seg) {
+		reverse_within_segment(a, b, switch_rep);
+		return;
+	}
+
+	split_before(a);
+	split_after(b);
+
+	/* Now the segments from seg(a) through seg(b) hold exactly the
+	 * Directions i, ..., j.  Reverse their order, and their bits. */
+	int sa { nodes[a].seg }, sb { nodes[b].seg };
+	int before { segs[sa].prev }, after { segs[sb].next };
+	int last { before };
+	int s { sb };
+	while (s != before) {
+		int s_prev { segs[s].prev };
+		segs[s].reversed = not segs[s].reversed;
+		if (switch_rep)
+			segs[s].flipped = not segs[s].flipped;
+		segs[s].prev = last;
+		if (last != NONE)
+			segs[last].next = s;
+		else
+			first_seg = s;
+		last = s;
+		s = s_prev;
+	}
+	segs[last].next = after;
+	if (after != NONE)
+		segs[after].prev = last;
+
+	if (segs.size() > max_segs)
+		rebuild();
+	else
+		renumber_segments();
+}
+
+ostream& operator<<(ostream& o, const TwoLevelSchedule& sched) {
+	/* Simply print all directions as ordered in the schedule, one per line. */
+	for (auto& d : sched) {
+		o << d << '\n';
+	}
+	return o;
+}
+
+/* ************************************************** */
+
+TwoLevelScheduleIterator::TwoLevelScheduleIterator(const TwoLevelSchedule* s,
+											TwoLevelSchedule::node_t n) :
+	current_node {n},
+	my_schedule {s} {}
+
+bool TwoLevelScheduleIterator::operator!=(TwoLevelScheduleIterator& other) {
+	return (this->current_node != other.current_node
+			or this->my_schedule != other.my_schedule);
+}
+
+bool TwoLevelScheduleIterator::operator==(TwoLevelScheduleIterator& other) {
+	return not (*this != other);
+}
+
+TwoLevelScheduleIterator TwoLevelScheduleIterator::operator++(int) {
+	TwoLevelScheduleIterator prev_iter { *this };  // Copy construction
+	current_node = my_schedule->next(current_node);
+	return prev_iter;
+}
+
+TwoLevelScheduleIterator& TwoLevelScheduleIterator::operator++() {
+	current_node = my_schedule->next(current_node);
+	return *this;
+}
+
+const Direction& TwoLevelScheduleIterator::operator*() {
+	if (current_node == TwoLevelSchedule::NONE) {
+		throw std::out_of_range("Iterator is past the end of the schedule.");
+	}
+	return my_schedule->direction_of(current_node);
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "includes.h"
+#include "Direction.h"
+#include "Metrics.h"
+
+class TwoLevelScheduleIterator;
+
+struct TwoLevelSchedule {
+/* A schedule stored as a two-level doubly-linked list, offering the
+ * same interface as Schedule (see Schedule.h) so that annealers may
+ * use either one.
+ *
+ * Schedule keeps its Directions in arrays, so flip_segment(i, j, ...)
+ * costs O(j - i), which is O(n) on average.  Here the Directions are
+ * instead grouped into about sqrt(n) segments:
+ *
+ *   - Each segment is a doubly-linked list of its own Directions,
+ *     with a "reversed" bit saying whether the list should be read
+ *     backwards and a "flipped" bit saying whether every Direction's
+ *     rep should be read switched.
+ *
+ *   - The segments themselves form a second doubly-linked list, in
+ *     schedule order, and each carries its rank within that list.
+ *
+ * Reversing the Directions at indices i, ..., j then means splitting
+ * the segments at both ends (so that i begins a segment and j ends
+ * one), then reversing the order of the segments in between and
+ * toggling their bits.  Splits never make segments larger, but they
+ * do make more of them; once there are too many, the whole list is
+ * rebuilt from scratch.  Every cost is therefore O(sqrt(n)), at least
+ * on average.
+ *
+ * Direction i of the schedule is found by walking the segments, also
+ * in O(sqrt(n)).  The list queries first(), next(...), prev(...) and
+ * between(...) work on node handles instead, and take O(1).
+ *
+ * Distances are always the Chebyshev metric of Metrics.h.
+ *
+ * For the two-level list idea, see M. L. Fredman, D. S. Johnson,
+ * L. A. McGeoch and G. Ostheimer, "Data structures for traveling
+ * salesmen", J. Algorithms 18 (1995), 432–479.
+ */
+	friend class TwoLevelScheduleIterator;
+public:
+	using node_t = int;
+	static constexpr node_t NONE { -1 };
+	static constexpr bool single_rep { false };
+	using metric_type = metric::Chebyshev;
+
+	TwoLevelSchedule(shared_ptr<DirectionDatabase> dirdata=nullptr, bool do_setup=true,
+			 const metric_type& metric={});
+	TwoLevelSchedule(vector<dir_id_t>&& schd_dir_id_t,
+			 vector<bool>&& schd_dir_othr,
+			 shared_ptr<DirectionDatabase> dirdata=nullptr);
+	~TwoLevelSchedule() = default;
+
+	TwoLevelSchedule(const TwoLevelSchedule& other) = default;
+	TwoLevelSchedule(TwoLevelSchedule&&) = default;
+	TwoLevelSchedule& operator=(const TwoLevelSchedule& other) { this->copy_from(other); return *this; }
+	TwoLevelSchedule& operator=(TwoLevelSchedule&&) = default;
+
+	unique_ptr<TwoLevelSchedule> duplicate() const;
+	void copy_from(const TwoLevelSchedule& source);
+	double total_distance()  const;
+	TwoLevelScheduleIterator begin() const;
+	TwoLevelScheduleIterator end()   const;
+
+	void flip_segment(size_t i, size_t j, bool switch_rep);
+
+	size_t get_num_dir() const {
+		return num_dir;
+	}
+
+	double dist(const Direction& d1, const Direction& d2) const {
+		return metric_type{}(d1, d2);
+	}
+
+	dir_id_t get_id_at(size_t idx) const {
+		return nodes[node_at(idx)].id;
+	}
+	bool is_other_at(size_t idx) const {
+		return is_other(node_at(idx));
+	}
+	const Direction& direction_at(size_t idx, bool switch_rep=false) const {
+		return direction_of(node_at(idx), switch_rep);
+	}
+
+	/* ************************************************** *
+	 * List queries on node handles.  The handles stay attached to their
+	 * Directions through every flip_segment(...), until the next
+	 * rebuild, which happens within flip_segment(...) as needed.
+	 */
+	node_t node_at(size_t idx) const;
+	node_t first() const;
+	node_t next(node_t n) const;  // NONE after the last node
+	node_t prev(node_t n) const;  // NONE before the first node
+
+	/* True if b lies on the part of the schedule from a to c (inclusive),
+	 * in either direction. */
+	bool between(node_t a, node_t b, node_t c) const;
+
+	dir_id_t id_of(node_t n) const {
+		return nodes[n].id;
+	}
+	bool is_other(node_t n) const {
+		return nodes[n].othr != segs[nodes[n].seg].flipped;
+	}
+	const Direction& direction_of(node_t n, bool switch_rep=false) const {
+		return dirdata->get_direction(nodes[n].id, is_other(n) != switch_rep);
+	}
+
+private:
+	/* Links and ranks are stored as seen by a segment that is neither
+	 * reversed nor flipped.  A node's next and prev never leave its own
+	 * segment; they are NONE at the segment's ends.  Ranks are
+	 * consecutive within each segment.
+	 */
+	struct Node {
+		dir_id_t id;
+		bool othr;
+		int seg;
+		node_t next, prev;
+		int rank;
+	};
+
+	struct Segment {
+		bool reversed, flipped;
+		node_t head, tail;
+		int next, prev;
+		int rank;
+		int size;
+	};
+
+	void build(const vector<dir_id_t>& ids, const vector<bool>& othr);
+	void rebuild();
+	void renumber_segments();
+
+	node_t seg_first(int s) const {
+		return segs[s].reversed ? segs[s].tail : segs[s].head;
+	}
+	node_t seg_last(int s) const {
+		return segs[s].reversed ? segs[s].head : segs[s].tail;
+	}
+	node_t next_in_seg(node_t n) const {
+		return segs[nodes[n].seg].reversed ? nodes[n].prev : nodes[n].next;
+	}
+	node_t prev_in_seg(node_t n) const {
+		return segs[nodes[n].seg].reversed ? nodes[n].next : nodes[n].prev;
+	}
+	long order_of(node_t n) const;
+
+	void split_before(node_t n);
+	void split_after(node_t n);
+	void reverse_within_segment(node_t a, node_t b, bool switch_rep);
+
+	shared_ptr<DirectionDatabase> dirdata;
+	size_t num_dir;
+	vector<Node> nodes;
+	vector<Segment> segs;
+	int first_seg;
+	int group_size;
+	size_t max_segs;
+
+	/* Scratch space for rebuild() and reverse_within_segment(...). */
+	vector<node_t> scratch;
+};
+
+class TwoLevelScheduleIterator {
+public:
+	TwoLevelScheduleIterator(const TwoLevelSchedule* s, TwoLevelSchedule::node_t n);
+	~TwoLevelScheduleIterator() = default;
+	TwoLevelScheduleIterator(TwoLevelScheduleIterator&)  = default;
+	TwoLevelScheduleIterator(TwoLevelScheduleIterator&&) = default;
+
+	bool operator!=(TwoLevelScheduleIterator& other);
+	bool operator==(TwoLevelScheduleIterator& other);
+	TwoLevelScheduleIterator& operator++();
+	TwoLevelScheduleIterator operator++(int);
+	const Direction& operator*();
+private:
+	TwoLevelSchedule::node_t current_node;
+	const TwoLevelSchedule* my_schedule;
+};
+
+ostream& operator<<(ostream& o, const TwoLevelSchedule& sched);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "includes.h"
+
+class WeightTree {
+/* A complete binary tree of non-negative weights.  Every leaf holds
+ * one weight, and every internal node holds the sum of its two
+ * children, so that the root is the total weight.  This supports
+ *
+ *   - set(k, w):     change leaf k in O(log n), and
+ *   - sample(u):     find the leaf where the running sum of weights
+ *                    first exceeds u, also in O(log n).
+ *
+ * Drawing u uniformly from [0, total()) then picks leaf k with
+ * probability weight(k) / total().  Unlike a Fenwick tree, set(...)
+ * recomputes its parents from scratch rather than adding differences,
+ * so many updates do not accumulate rounding error in the total.
+ */
+public:
+	WeightTree(size_t num_leaves=0) { resize(num_leaves); }
+	~WeightTree() = default;
+	WeightTree(const WeightTree&) = default;
+	WeightTree(WeightTree&&) = default;
+	WeightTree& operator=(const WeightTree&) = default;
+	WeightTree& operator=(WeightTree&&) = default;
+
+	void resize(size_t num_leaves) {
+		this->num_leaves = num_leaves;
+		first_leaf = 1;
+		while (first_leaf < num_leaves)
+			first_leaf *= 2;
+		tree.assign(2 * first_leaf, 0.0);
+	}
+
+	size_t size() const {
+		return num_leaves;
+	}
+
+	double total() const {
+		return tree[1];
+	}
+
+	double weight(size_t k) const {
+		return tree[first_leaf + k];
+	}
+
+	void set(size_t k, double w) {
+		size_t node { first_leaf + k };
+		tree[node] = w;
+		for (node /= 2; node > 0; node /= 2)
+			tree[node] = tree[2 * node] + tree[2 * node + 1];
+	}
+
+	/* Setting many leaves at once?  Write them with set_lazy(...) and
+	 * then call rebuild() once, which costs O(n) instead of O(n log n).
+	 */
+	void set_lazy(size_t k, double w) {
+		tree[first_leaf + k] = w;
+	}
+
+	void rebuild() {
+		for (size_t node { first_leaf - 1 }; node > 0; node--)
+			tree[node] = tree[2 * node] + tree[2 * node + 1];
+	}
+
+	size_t sample(double u) const {
+		size_t node {1};
+		while (node < first_leaf) {
+			double left { tree[2 * node] };
+			if (u < left) {
+				node = 2 * node;
+			} else {
+				u -= left;
+				node = 2 * node + 1;
+			}
+		}
+		/* Rounding might walk past the last real leaf, or onto a leaf
+		 * of zero weight; step back to the nearest leaf with weight.
+		 */
+		size_t k { std::min(node - first_leaf, num_leaves - 1) };
+		while (k > 0 and weight(k) <= 0.0)
+			k--;
+		return k;
+	}
+
+private:
+	size_t num_leaves {};
+	size_t first_leaf {1};
+	vector<double> tree {};
+};
@@ -0,0 +1,157 @@
+#include "WorkQueue.h"
+
+#include <cerrno>
+#include <filesystem>
+#include <set>
+#include <signal.h>
+#include <unistd.h>
+
+namespace {
+	string host_name() {
+		char name[256] {};
+		if (::gethostname(name, sizeof(name) - 1) != 0)
+			return "localhost";
+		return name;
+	}
+}
+
+/* ************************************************** */
+
+WorkQueue::WorkQueue(const string& filename, const string& staging_folder) :
+	filename {filename},
+	staging_folder {staging_folder},
+	mutex {} {}
+
+string WorkQueue::this_owner() {
+	return host_name() + ":" + to_string(::getpid());
+}
+
+template<typename F>
+void WorkQueue::update(F&& change) {
+	std::lock_guard<std::mutex> guard { mutex };
+	FileLock lock { filename + ".lock" };
+	vector<Entry> entries { read_entries() };
+	if (change(entries))
+		write_entries(entries);
+}
+
+void WorkQueue::enqueue(const vector<int>& run_ids, const string& args) {
+	update([&] (vector<Entry>& entries) {
+		std::set<int> queued {};
+		for (auto& e : entries)
+			queued.insert(e.run_id);
+		bool changed {false};
+		for (int run_id : run_ids) {
+			if (queued.insert(run_id).second) {
+				entries.push_back({ run_id, "pending", "-", args });
+				changed = true;
+			}
+		}
+		return changed;
+	});
+}
+
+std::optional<WorkQueue::Claim> WorkQueue::claim() {
+	std::optional<Claim> claimed {};
+	update([&] (vector<Entry>& entries) {
+		bool changed { reclaim_abandoned(entries) };
+		for (auto& e : entries) {
+			if (e.state == "pending") {
+				e.state = "claimed";
+				e.owner = this_owner();
+				claimed = Claim { e.run_id, e.args };
+				changed = true;
+				break;
+			}
+		}
+		return changed;
+	});
+	return claimed;
+}
+
+void WorkQueue::finish(int run_id, bool succeeded) {
+	const string owner { this_owner() };
+	update([&] (vector<Entry>& entries) {
+		for (auto& e : entries) {
+			if (e.run_id == run_id and e.state == "claimed" and e.owner == owner) {
+				e.state = (succeeded ? "done" : "failed");
+				return true;
+			}
+		}
+		return false;
+	});
+}
+
+bool WorkQueue::reclaim_abandoned(vector<Entry>& entries) const {
+	const string host { host_name() + ":" };
+	const pid_t self { ::getpid() };
+	std::set<string> gone {};
+	for (auto& e : entries) {
+		if (e.state != "claimed" or e.owner.rfind(host, 0) != 0)
+			continue;
+		pid_t pid { static_cast<pid_t>(stol(e.owner.substr(host.length()))) };
+		if (pid != self and ::kill(pid, 0) != 0 and errno == ESRCH) {
+			cout << "Run id " << e.run_id << " was claimed by " << e.owner
+					<< ", which is gone; putting it back in the queue." << endl;
+			gone.insert(e.owner);
+			e.state = "pending";
+			e.owner = "-";
+		}
+	}
+	if (staging_folder.empty() or gone.empty())
+		return not gone.empty();
+
+	vector<std::filesystem::path> folders {};
+	std::error_code error {};
+	for (auto& f : std::filesystem::directory_iterator { staging_folder, error }) {
+		string name { f.path().filename().string() };
+		size_t dash { name.rfind('-') };
+		if (dash != string::npos and gone.count(name.substr(0, dash)) > 0)
+			folders.push_back(f.path());
+	}
+	for (auto& folder : folders) {
+		std::filesystem::remove_all(folder, error);
+		if (error) {
+			cerr << "Warning: Cannot delete the staging folder " << folder
+					<< " of a process that is gone: " << error.message() << endl;
+		}
+	}
+	return true;
+}
+
+/* ************************************************** */
+
+vector<WorkQueue::Entry> WorkQueue::read_entries() const {
+	vector<Entry> entries {};
+	if (not std::filesystem::exists(filename))
+		return entries;
+	ifstream in { file_reader(filename) };
+	string line {};
+	while (getline(in, line)) {
+		if (line.empty() or line[0] == '#')
+			continue;
+		stringstream ss { line };
+		Entry e {};
+		if (not (ss >> e.run_id >> e.state >> e.owner)) {
+			throw runtime_error("Malformed line \"" + line + "\" in the queue \""
+					+ filename + "\".");
+		}
+		getline(ss >> std::ws, e.args);
+		entries.push_back(move(e));
+	}
+	return entries;
+}
+
+void WorkQueue::write_entries(const vector<Entry>& entries) const {
+	const string temp_filename { filename + ".tmp." + this_owner() };
+	ofstream o { file_writer(temp_filename) };
+	o << "# Work queue; see src/WorkQueue.h.\n"
+		 "# RunId State Owner Args\n";
+	for (auto& e : entries)
+		o << e.run_id << " " << e.state << " " << e.owner << " " << e.args << "\n";
+	o.close();
+	if (not o) {
+		throw runtime_error("Cannot write the queue \"" + temp_filename + "\".");
+	}
+	std::filesystem::rename(temp_filename, filename);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "includes.h"
+
+#include <mutex>
+#include <optional>
+
+class WorkQueue {
+/* A queue of run ids on disk, shared by any number of processes, on any
+ * hosts that share the filesystem, so that a large batch of run ids can
+ * be spread over all of them.  Every process claims run ids one at a
+ * time, as its workers become free, until none is left.
+ *
+ * The queue file is plain text, one line per run id:
+ *
+ *     RUN_ID STATE OWNER ARGS...
+ *
+ * where STATE is pending, claimed, done or failed, OWNER is the
+ * HOST:PID of the process holding the claim (or - when there is none),
+ * and ARGS are the arguments to run the run id with:  positional
+ * arguments 2-6 of the command line and any options.  Each run id keeps
+ * the arguments of whoever added it, so that rows of run_details.csv
+ * with different settings may share one queue.
+ *
+ * Every change happens while holding an exclusive fcntl(2) lock on a
+ * separate lock file, QUEUE_FILE.lock, which also works over NFS; the
+ * new queue is written in full to a temporary file and renamed over the
+ * old one, so that a process dying at any point leaves a whole queue
+ * behind.  The lock is released by the system when a process dies.
+ *
+ * A process that dies leaves its claims behind.  Any later process on
+ * the same host sees that the owner is gone and puts them back as
+ * pending, so restarting a worker where one crashed is enough to finish
+ * the batch; runs already done are never redone.  The folders named
+ * OWNER-K in staging_folder, if given, belong to the process OWNER, and
+ * are deleted along with its claims, partial output and all.
+ */
+public:
+	WorkQueue(const string& filename, const string& staging_folder={});
+	~WorkQueue() = default;
+	WorkQueue(WorkQueue&)  = delete;
+	WorkQueue(WorkQueue&&) = delete;
+
+	/* Adds those of run_ids not yet in the queue, to run with args. */
+	void enqueue(const vector<int>& run_ids, const string& args);
+
+	struct Claim {
+		int run_id;
+		string args;
+	};
+
+	/* Claims a pending run id for this process, or returns nothing once
+	 * no run id is pending. */
+	std::optional<Claim> claim();
+
+	/* Records that a run id claimed by this process has finished. */
+	void finish(int run_id, bool succeeded);
+
+	/* HOST:PID of this process, as in the queue file. */
+	static string this_owner();
+
+private:
+	struct Entry {
+		int run_id;
+		string state;
+		string owner;
+		string args;
+	};
+
+	/* Reads the queue, lets change(...) change its entries, and writes
+	 * them back, all while holding the lock. */
+	template<typename F>
+	void update(F&& change);
+
+	vector<Entry> read_entries() const;
+	void write_entries(const vector<Entry>& entries) const;
+
+	/* Puts back the claims of processes on this host that are gone, and
+	 * deletes their staging folders; true if there were any. */
+	bool reclaim_abandoned(vector<Entry>& entries) const;
+
+	string filename;
+	string staging_folder;
+	/* fcntl(2) locks belong to the whole process, so the threads of one
+	 * process take turns through this first. */
+	std::mutex mutex;
+};
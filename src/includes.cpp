@@ -1,21 +1,61 @@
 #include "includes.h"
 
+#include <cerrno>
+#include <cstring>
 #include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
 
 string get_input_filename(int run_id) {
 	return INPUT_FOLDER + "directions-" + to_string(run_id) + ".txt";
 }
 
+namespace {
+	thread_local string run_folder_root { OUTPUT_FOLDER };
+}
+
+string get_run_folder(int run_id) {
+	return run_folder_root + "run-" + to_string(run_id) + "/";
+}
+
+void set_run_folder_root(const string& root) {
+	run_folder_root = root;
+}
+
 ofstream file_writer(string filename) {
 	filesystem::path p {filename};
 	filesystem::path folder_path {p.parent_path()};
-	if (not filesystem::exists(folder_path)) {
+	if (not folder_path.empty() and not filesystem::exists(folder_path)) {
 		filesystem::create_directories(folder_path);
 	}
 	ofstream o { filename };
 	return o;
 }
 
+FileLock::FileLock(const string& filename) :
+	fd { ::open(filename.c_str(), O_RDWR | O_CREAT, 0644) } {
+	if (fd < 0) {
+		throw runtime_error("Cannot open the lock file \"" + filename
+				+ "\": " + std::strerror(errno));
+	}
+	struct flock lock {};
+	lock.l_type = F_WRLCK;
+	lock.l_whence = SEEK_SET;
+	while (::fcntl(fd, F_SETLKW, &lock) != 0) {
+		if (errno != EINTR) {
+			int error { errno };
+			::close(fd);
+			throw runtime_error("Cannot lock \"" + filename + "\": "
+					+ std::strerror(error));
+		}
+	}
+}
+
+FileLock::~FileLock() {
+	/* Closing the file releases the lock. */
+	::close(fd);
+}
+
 ifstream file_reader(string filename) {
 	filesystem::path p {filename};
 	if (not filesystem::exists(filename)) {
@@ -25,6 +65,44 @@ ifstream file_reader(string filename) {
 	return i;
 }
 
+vector<vector<string>> read_csv(const string& filename, size_t num_columns) {
+	ifstream in { file_reader(filename) };
+	vector<vector<string>> rows {};
+	bool header_seen {false};
+	string line {};
+	while (getline(in, line)) {
+		if (line.empty() or line[0] == '#'
+				or line.find_first_not_of(" \t\r") == string::npos)
+			continue;
+		vector<string> cells {};
+		stringstream ss { line };
+		string cell {};
+		while (getline(ss, cell, ',')) {
+			auto first { cell.find_first_not_of(" \t\r") };
+			auto last { cell.find_last_not_of(" \t\r") };
+			cells.push_back(first == string::npos ? ""
+						: cell.substr(first, last - first + 1));
+		}
+		/* A trailing comma leaves the last column empty. */
+		if (line.back() == ',')
+			cells.push_back("");
+		if (cells.size() != num_columns) {
+			throw runtime_error("Expected " + to_string(num_columns)
+					+ " columns in \"" + filename + "\" but found "
+					+ to_string(cells.size()) + " in the line \"" + line + "\".");
+		}
+		if (header_seen)
+			rows.push_back(move(cells));
+		header_seen = true;
+	}
+	return rows;
+}
+
+string strip_underscores(string s) {
+	s.erase(std::remove(s.begin(), s.end(), '_'), s.end());
+	return s;
+}
+
 
 /* ************************************************** *
  * This function is used in
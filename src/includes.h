@@ -3,6 +3,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 
 #include <memory>
 
@@ -28,9 +29,44 @@ static const string OUTPUT_FOLDER ("./output/");
 /* Location of each input file. */
 string get_input_filename(int run_id);
 
+/* The folder of the output files of run_id, OUTPUT_FOLDER/run-<id>/ by
+ * default.  A thread may instead stage the output of its runs under
+ * another folder, to move them into place once complete (see
+ * WorkQueue.h), by giving set_run_folder_root(...) the folder to use in
+ * place of OUTPUT_FOLDER; this affects the calling thread only.
+ */
+string get_run_folder(int run_id);
+void set_run_folder_root(const string& root);
+
 ofstream file_writer(string filename);
 ifstream file_reader(string filename);
 
+/* Holds an exclusive fcntl(2) lock on a file, created if need be, while
+ * in scope.  Such locks work over NFS and are released by the system
+ * when a process dies, but belong to the whole process, so the threads
+ * of one process must take turns by other means.  Closing any other
+ * descriptor of the same file also releases the lock, so lock a file
+ * kept for the purpose, such as FILE.lock. */
+class FileLock {
+public:
+	FileLock(const string& filename);
+	~FileLock();
+	FileLock(FileLock&)  = delete;
+	FileLock(FileLock&&) = delete;
+private:
+	int fd;
+};
+
+/* The rows of a CSV file such as the benchmark's corpus.csv, split at
+ * commas and trimmed, leaving out comments (lines beginning with '#'),
+ * blank lines and the header, which must have num_columns columns as
+ * must every row. */
+vector<vector<string>> read_csv(const string& filename, size_t num_columns);
+
+/* Numbers in files may have underscores, as on the command line (e.g.,
+ * 1_000_000); this removes them. */
+string strip_underscores(string s);
+
 /* ************************************************** *
  * Try to match s to the regex, and if so return the match object through which
  * regex groups are accessible via match[...].  Otherwise, throw an error